@@ -0,0 +1,285 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "ndarray.hpp"
+
+
+
+
+//=============================================================================
+static volatile double sink;
+
+template<typename Function>
+double time_best_of(int num_trials, Function&& fn)
+{
+    auto best = 1e10;
+
+    for (int n = 0; n < num_trials; ++n)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        fn();
+        auto t1 = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+    }
+    return best;
+}
+
+void report(const char* name, std::size_t bytes, double seconds)
+{
+    std::printf("%-40s %8.3f ms %8.2f GB/s\n", name, seconds * 1e3, bytes / seconds * 1e-9);
+}
+
+void report_flops(const char* name, std::size_t flops, double seconds)
+{
+    std::printf("%-40s %8.3f ms %8.2f GFLOP/s\n", name, seconds * 1e3, flops / seconds * 1e-9);
+}
+
+
+
+
+//=============================================================================
+void benchmark_copy()
+{
+    auto A = nd::linspace(0.0, 1.0, 1 << 24) | nd::to_shared();
+    auto B = A | nd::reshape(256, 256, 256);
+    auto bytes = A.size() * sizeof(double) * 2;
+    auto target = std::vector<double>(A.size());
+
+    std::printf("\ncopy bandwidth (%zu MB arrays)\n", A.size() * sizeof(double) >> 20);
+    report("memcpy (warm target)", bytes, time_best_of(5, [&] { std::memcpy(target.data(), A.data(), A.size() * sizeof(double)); }));
+    report("memcpy (fresh target)", bytes, time_best_of(5, [&]
+    {
+        auto fresh = std::unique_ptr<double[]>(new double[A.size()]);
+        std::memcpy(fresh.get(), A.data(), A.size() * sizeof(double));
+        sink = fresh[A.size() / 2];
+    }));
+    report("shared_array (1d) | to_shared()", bytes, time_best_of(5, [&] { A | nd::to_shared(); }));
+    report("shared_array (3d) | to_shared()", bytes, time_best_of(5, [&] { B | nd::to_shared(); }));
+    report("lazy identity (3d) | to_shared()", bytes, time_best_of(5, [&] { B | nd::map([] (auto x) { return x; }) | nd::to_shared(); }));
+}
+
+
+
+
+//=============================================================================
+void benchmark_reductions()
+{
+    auto A = nd::linspace(0.0, 1.0, 1 << 24) | nd::to_shared();
+    auto bytes = A.size() * sizeof(double);
+
+    std::printf("\nreductions (%zu MB arrays)\n", bytes >> 20);
+    report("sum, rank 1", bytes, time_best_of(5, [&] { sink = A | nd::sum(); }));
+    report("sum, rank 3", bytes, time_best_of(5, [&] { sink = A | nd::reshape(256, 256, 256) | nd::sum(); }));
+    report("sum, rank 4", bytes, time_best_of(5, [&] { sink = A | nd::reshape(64, 64, 64, 64) | nd::sum(); }));
+    report("max, rank 4", bytes, time_best_of(5, [&] { sink = A | nd::reshape(64, 64, 64, 64) | nd::max(); }));
+    report("all, rank 4", bytes, time_best_of(5, [&] { sink = (A | nd::reshape(64, 64, 64, 64)) >= 0.0 | nd::all(); }));
+    report("sum, rank 3, in parallel", bytes, time_best_of(5, [&] { sink = A | nd::reshape(256, 256, 256) | nd::sum().in_parallel(); }));
+    report("sum, rank 3, deterministic", bytes, time_best_of(5, [&] { sink = A | nd::reshape(256, 256, 256) | nd::sum().deterministic().in_parallel(); }));
+
+    auto B = A | nd::reshape(4096, 4096);
+
+    for (std::size_t axis = 0; axis < 2; ++axis)
+    {
+        auto name = std::string("sum along axis ") + std::to_string(axis);
+
+        report((name + ", 4096 x 4096").c_str(), bytes, time_best_of(3, [&] { sink = (B | nd::collect(nd::sum()).along_axis(axis))(0); }));
+        report((name + ", lazy source").c_str(), bytes, time_best_of(3, [&] { sink = (B | nd::map([] (double x) { return x; }) | nd::collect(nd::sum()).along_axis(axis) | nd::to_shared())(0); }));
+    }
+}
+
+
+
+
+//=============================================================================
+void benchmark_transpose()
+{
+    auto A = nd::linspace(0.0, 1.0, 1 << 24) | nd::to_shared() | nd::reshape(4096, 4096);
+    auto bytes = A.size() * sizeof(double) * 2;
+    auto lambda_transpose = [] (auto array)
+    {
+        return nd::make_array([array] (auto i) { return array(i[1], i[0]); }, nd::make_shape(array.shape(1), array.shape(0)));
+    };
+
+    std::printf("\ntranspose (4096 x 4096 doubles)\n");
+    report("lambda transpose | to_shared()", bytes, time_best_of(3, [&] { lambda_transpose(A) | nd::to_shared(); }));
+    report("permute_axes(1, 0) | to_shared()", bytes, time_best_of(3, [&] { A | nd::permute_axes(1, 0) | nd::to_shared(); }));
+    report("permute_axes(1, 0) | to_shared_parallel()", bytes, time_best_of(3, [&] { A | nd::permute_axes(1, 0) | nd::to_shared_parallel(); }));
+}
+
+
+
+
+//=============================================================================
+void benchmark_arithmetic()
+{
+    auto pool = nd::buffer_pool_t();
+    auto scope = pool.use();
+    auto A = nd::linspace(1.0, 2.0, 1 << 14) | nd::to_shared() | nd::reshape(128, 128);
+    auto B = nd::linspace(2.0, 3.0, 1 << 14) | nd::to_shared() | nd::reshape(128, 128);
+    auto flops = A.size();
+
+    auto per_index = [A, B] (auto function)
+    {
+        return nd::make_array([A, B, function] (auto&& i) { return function(A(i), B(i)); }, A.shape());
+    };
+    auto compare = [&] (const char* name, auto function, auto expression)
+    {
+        report_flops((std::string(name) + ", per index").c_str(), flops, time_best_of(200, [&] { sink = (per_index(function) | nd::to_shared()).data()[7]; }));
+        report_flops((std::string(name) + ", vectorized").c_str(), flops, time_best_of(200, [&] { sink = (expression() | nd::to_shared()).data()[7]; }));
+    };
+
+    std::printf("\narithmetic (128 x 128 doubles)\n");
+    compare("A + B", std::plus<>(), [&] { return A + B; });
+    compare("A - B", std::minus<>(), [&] { return A - B; });
+    compare("A * B", std::multiplies<>(), [&] { return A * B; });
+    compare("A / B", std::divides<>(), [&] { return A / B; });
+    compare("A < B", std::less<>(), [&] { return A < B; });
+    compare("A == B", std::equal_to<>(), [&] { return A == B; });
+    compare("A + B * 2", [] (double a, double b) { return a + b * 2.0; }, [&] { return A + B * 2.0; });
+
+    auto row = nd::linspace(0.0, 1.0, 128) | nd::to_shared();
+    auto col = nd::linspace(0.0, 1.0, 128) | nd::to_shared() | nd::reshape(128, 1);
+    report_flops("A + 2 (scalar)", flops, time_best_of(200, [&] { sink = ((A + 2.0) | nd::to_shared()).data()[7]; }));
+    report_flops("A + row (broadcast)", flops, time_best_of(200, [&] { sink = ((A + row) | nd::to_shared()).data()[7]; }));
+    report_flops("A * col (broadcast)", flops, time_best_of(200, [&] { sink = ((A * col) | nd::to_shared()).data()[7]; }));
+
+    auto X = nd::linspace(1.0, 2.0, 1024) | nd::to_shared();
+    auto Y = nd::linspace(2.0, 3.0, 1024) | nd::to_shared();
+    auto detected = nd::simd_level();
+    auto compare_levels = [&] (const char* name, auto expression)
+    {
+        for (auto level : {nd::simd_level_t::scalar, detected})
+        {
+            nd::simd_level() = level;
+            auto label = std::string(name) + (level == nd::simd_level_t::scalar ? ", scalar loop" : ", pack kernel");
+            report_flops(label.c_str(), 100 * X.size(), time_best_of(50, [&]
+            {
+                for (int n = 0; n < 100; ++n)
+                {
+                    sink = (expression() | nd::to_shared()).data()[7];
+                }
+            }));
+        }
+        nd::simd_level() = detected;
+    };
+
+    std::printf("\npack kernels (1024 doubles, 100 evaluations)\n");
+    compare_levels("X + Y", [&] { return X + Y; });
+    compare_levels("X * Y + X", [&] { return X * Y + X; });
+    compare_levels("X < Y", [&] { return X < Y; });
+}
+
+
+
+
+//=============================================================================
+void benchmark_stencil()
+{
+    auto u = nd::linspace(0.0, 1.0, 258 * 258 * 258) | nd::to_shared() | nd::reshape(258, 258, 258);
+    auto w = nd::make_unique_array<double>(3, 3, 3);
+    w(1, 1, 1) = -6.0;
+    w(0, 1, 1) = w(2, 1, 1) = w(1, 0, 1) = w(1, 2, 1) = w(1, 1, 0) = w(1, 1, 2) = 1.0;
+    auto weights = std::move(w).shared();
+    auto flops = std::size_t(256 * 256 * 256) * 8;
+
+    auto hand_written = [&]
+    {
+        auto result = nd::make_unique_array<double>(256, 256, 256);
+        auto s = u.data();
+        auto r = result.data();
+
+        for (std::size_t i = 1; i < 257; ++i)
+        {
+            for (std::size_t j = 1; j < 257; ++j)
+            {
+                auto c = s + (i * 258 + j) * 258;
+                auto t = r + ((i - 1) * 256 + (j - 1)) * 256;
+
+                for (std::size_t k = 1; k < 257; ++k)
+                {
+                    t[k - 1] = c[k - 258 * 258] + c[k + 258 * 258] + c[k - 258] + c[k + 258] + c[k - 1] + c[k + 1] - 6.0 * c[k];
+                }
+            }
+        }
+        sink = r[7];
+    };
+
+    std::printf("\n7-point laplacian (256^3 doubles)\n");
+    report_flops("hand-written loop", flops, time_best_of(5, hand_written));
+    report_flops("stencil(weights) | to_shared()", flops, time_best_of(5, [&] { sink = (u | nd::stencil(weights) | nd::to_shared()).data()[7]; }));
+    report_flops("stencil(kernel) | to_shared()", flops, time_best_of(5, [&]
+    {
+        auto kernel = [] (auto at) { return at(-1, 0, 0) + at(1, 0, 0) + at(0, -1, 0) + at(0, 1, 0) + at(0, 0, -1) + at(0, 0, 1) - 6.0 * at(0, 0, 0); };
+        sink = (u | nd::stencil(kernel, 1) | nd::to_shared()).data()[7];
+    }));
+    report_flops("stencil(weights, periodic) | to_shared()", flops, time_best_of(5, [&] { sink = (u | nd::stencil(weights, nd::boundary_t::periodic) | nd::to_shared()).data()[7]; }));
+    report_flops("shift_by and binary_op | to_shared()", flops, time_best_of(5, [&]
+    {
+        auto c = u | nd::select_from(1, 1, 1).to(257, 257, 257);
+        auto sum = (u | nd::select_from(0, 1, 1).to(256, 257, 257)) + (u | nd::select_from(2, 1, 1).to(258, 257, 257))
+                 + (u | nd::select_from(1, 0, 1).to(257, 256, 257)) + (u | nd::select_from(1, 2, 1).to(257, 258, 257))
+                 + (u | nd::select_from(1, 1, 0).to(257, 257, 256)) + (u | nd::select_from(1, 1, 2).to(257, 257, 258)) - c * 6.0;
+        sink = (sum | nd::to_shared()).data()[7];
+    }));
+    report_flops("stencil(weights) | to_shared_parallel()", flops, time_best_of(5, [&] { sink = (u | nd::stencil(weights) | nd::to_shared_parallel()).data()[7]; }));
+}
+
+
+
+
+//=============================================================================
+void benchmark_repeat_stencil()
+{
+    auto v = nd::linspace(0.0, 1.0, 384 * 512 * 512) | nd::to_shared() | nd::reshape(384, 512, 512);
+    auto w = nd::make_unique_array<double>(3, 3, 3);
+    w(1, 1, 1) = 0.4;
+    w(0, 1, 1) = w(2, 1, 1) = w(1, 0, 1) = w(1, 2, 1) = w(1, 1, 0) = w(1, 1, 2) = 0.1;
+    auto weights = std::move(w).shared();
+    auto S = nd::stencil(weights, nd::boundary_t::periodic);
+    auto flops = v.size() * 8 * 8;
+
+    // The array (768 MB) is larger than the last-level cache, so each sweep
+    // streams it from memory and back; repeat_stencil does that once for
+    // every few steps.
+    std::printf("\n8 steps of a periodic 7-point stencil (384 x 512 x 512 doubles)\n");
+    report_flops("8 sweeps of stencil | to_shared()", flops, time_best_of(3, [&]
+    {
+        auto u = v;
+
+        for (int n = 0; n < 8; ++n)
+        {
+            u = u | S | nd::to_shared();
+        }
+        sink = u.data()[7];
+    }));
+    auto A = v | nd::pad(1, 1, 1);
+    auto B = v | nd::pad(1, 1, 1);
+
+    report_flops("8 sweeps of padded arrays, in place", flops, time_best_of(3, [&]
+    {
+        for (int n = 0; n < 8; ++n)
+        {
+            A.get_provider().fill_halo(nd::boundary_t::periodic);
+            B.get_provider().assign_interior(A | nd::stencil(weights));
+            std::swap(A, B);
+        }
+        sink = A.data()[7];
+    }));
+    report_flops("repeat_stencil(8)", flops, time_best_of(3, [&] { sink = (v | nd::repeat_stencil(S, 8)).data()[7]; }));
+}
+
+
+
+
+//=============================================================================
+int main()
+{
+    benchmark_copy();
+    benchmark_reductions();
+    benchmark_transpose();
+    benchmark_arithmetic();
+    benchmark_stencil();
+    benchmark_repeat_stencil();
+    return 0;
+}
@@ -28,13 +28,43 @@
 
 #pragma once
 #include <algorithm>         // std::all_of
+#include <atomic>            // std::atomic
+#include <cctype>            // std::isdigit
+#include <cerrno>            // errno
+#include <chrono>            // std::chrono::steady_clock
+#include <condition_variable> // std::condition_variable
+#include <cstdio>            // std::fopen
+#include <cstdlib>           // std::labs
+#include <climits>           // INT_MAX
+#include <cstdint>           // std::uint64_t
+#include <cstring>           // std::memcpy
+#include <deque>             // std::deque
+#include <exception>         // std::exception_ptr
 #include <functional>        // std::ref
+#include <future>            // std::future
 #include <initializer_list>  // std::initializer_list
 #include <iterator>          // std::distance
+#include <list>              // std::list
+#include <map>               // std::map
 #include <memory>            // std::shared_ptr
+#include <mutex>             // std::mutex
 #include <numeric>           // std::accumulate
+#include <stdexcept>         // std::runtime_error
 #include <string>            // std::to_string
+#include <thread>            // std::thread
+#include <unordered_map>     // std::unordered_map
 #include <utility>           // std::index_sequence
+#include <vector>            // std::vector
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>           // open
+#include <sys/mman.h>        // mmap, madvise, shm_open
+#include <sys/stat.h>        // fstat
+#include <unistd.h>          // close
+#endif
+#if defined(__linux__)
+#include <linux/futex.h>     // FUTEX_WAIT
+#include <sys/syscall.h>     // SYS_futex
+#endif
 
 
 
@@ -53,8 +83,35 @@ namespace nd
     template<std::size_t Rank>                                           class memory_strides_t;
     template<std::size_t Rank>                                           class access_pattern_t;
     template<typename ValueType, std::size_t Rank>                       class basic_sequence_t;
-    template<typename ValueType>                                         class buffer_t;
+    /**/                                                                 class buffer_pool_t;
+    template<typename ValueType, std::size_t Alignment=64>               class aligned_allocator_t;
+    template<typename ValueType, typename Allocator=aligned_allocator_t<ValueType>> class buffer_t;
     template<typename Provider>                                          class array_t;
+    /**/                                                                 class mapped_file_t;
+    /**/                                                                 class shm_segment_t;
+    template<typename ValueType, std::size_t Rank>                       class shm_domain_t;
+    /**/                                                                 class thread_pool_t;
+    /**/                                                                 class tile_scheduler_t;
+    /**/                                                                 class io_worker_t;
+    /**/                                                                 class file_sink_t;
+    template<typename ValueType>                                         class tile_cache_t;
+
+
+    // options for memory-mapped files
+    //=========================================================================
+    enum class map_mode_t { read_only, copy_on_write };
+    enum class access_advice_t { normal, sequential, random, will_need };
+    enum class chunk_codec_t { none, lz };
+
+
+    // how stencils and halo fills treat the edges of an array
+    //=========================================================================
+    enum class boundary_t { periodic, clamp, reflect, ghost };
+
+
+    // instruction sets for the pack kernels of elementwise expressions
+    //=========================================================================
+    enum class simd_level_t { scalar, sse2, avx2, avx512 };
 
 
     // array and access pattern factory functions
@@ -69,6 +126,24 @@ namespace nd
     template<std::size_t Rank>                            auto make_access_pattern(shape_t<Rank> shape);
     template<typename... Args>                            auto make_access_pattern(Args... args);
     template<std::size_t NumPartitions, std::size_t Rank> auto partition_shape(shape_t<Rank> shape);
+    template<std::size_t Rank>                            auto partition_shape(shape_t<Rank> shape, std::size_t num_partitions);
+    template<std::size_t Rank>                            auto partition_tiles(shape_t<Rank> shape, shape_t<Rank> tile_shape);
+    template<typename ValueType, std::size_t Rank>        auto make_tile_shape(shape_t<Rank> shape, std::size_t min_num_tiles=1, std::size_t tile_bytes=1 << 15);
+
+
+    // index space iteration
+    //=========================================================================
+    template<std::size_t Rank, typename Function> bool for_each_row(const access_pattern_t<Rank>& pattern, Function&& fn);
+    template<std::size_t Rank, typename Function> bool for_each_index(const access_pattern_t<Rank>& pattern, Function&& fn);
+
+
+    // parallel execution
+    //=========================================================================
+    inline thread_pool_t& default_thread_pool();
+    inline io_worker_t& default_io_worker();
+    inline std::size_t& huge_page_threshold();
+    inline simd_level_t& simd_level();
+    inline buffer_pool_t*& current_buffer_pool();
 
 
     // provider types
@@ -76,6 +151,16 @@ namespace nd
     template<typename Function,  std::size_t Rank> class basic_provider_t;
     template<typename ValueType, std::size_t Rank> class shared_provider_t;
     template<typename ValueType, std::size_t Rank> class unique_provider_t;
+    template<typename ValueType, std::size_t Rank> class strided_shared_provider_t;
+    template<typename ValueType, std::size_t Rank> class mmap_provider_t;
+    template<typename ValueType, std::size_t Rank> class chunked_provider_t;
+    template<typename Provider>                    class cached_provider_t;
+    template<typename ValueType, std::size_t Rank, typename Kernel> class stencil_provider_t;
+    template<typename ValueType, std::size_t Rank> class padded_provider_t;
+    template<typename ValueType, std::size_t Rank> class uniform_provider_t;
+    template<typename Function, typename... Providers> class elementwise_provider_t;
+    template<typename Provider>                    class strided_provider_t;
+    template<typename Provider>                    struct provider_traits;
 
 
     // provider factory functions
@@ -84,8 +169,16 @@ namespace nd
     template<typename ValueType, typename... Args>     auto make_shared_provider(Args... args);
     template<typename ValueType, std::size_t Rank>     auto make_unique_provider(shape_t<Rank> shape);
     template<typename ValueType, typename... Args>     auto make_unique_provider(Args... args);
+    template<typename ValueType, std::size_t Rank>     auto make_uninitialized_unique_provider(shape_t<Rank> shape);
+    template<typename Provider>                        auto leaf_providers(const Provider& provider);
     template<typename Provider>                        auto evaluate_as_shared(Provider&&);
     template<typename Provider>                        auto evaluate_as_unique(Provider&&);
+    template<typename Provider>                        auto evaluate_as_shared_parallel(Provider&&, thread_pool_t& pool, std::size_t num_tasks);
+    template<typename Provider>                        auto evaluate_as_unique_parallel(Provider&&, thread_pool_t& pool, std::size_t num_tasks);
+    template<typename Provider>                        auto evaluate_as_shared_parallel(Provider&&, std::size_t num_threads=0);
+    template<typename Provider>                        auto evaluate_as_unique_parallel(Provider&&, std::size_t num_threads=0);
+    template<typename Provider>                        auto evaluate_as_shared_parallel(Provider&&, tile_scheduler_t& scheduler);
+    template<typename Provider>                        auto evaluate_as_unique_parallel(Provider&&, tile_scheduler_t& scheduler);
 
 
     // array factory functions
@@ -97,6 +190,7 @@ namespace nd
     template<typename Provider>                        auto make_array(Provider&&);
     template<typename Mapping, std::size_t Rank>       auto make_array(Mapping mapping, shape_t<Rank> shape);
     template<typename ContainerType>                   auto make_array_from(const ContainerType& container);
+    template<typename ValueType, std::size_t Rank>     auto map_file(const std::string& filename, shape_t<Rank> shape, std::size_t offset=0, map_mode_t mode=map_mode_t::read_only);
     template<typename ValueType, std::size_t Rank>     auto make_shared_array(shape_t<Rank> shape);
     template<typename ValueType, typename... Args>     auto make_shared_array(Args... args);
     template<typename ValueType, std::size_t Rank>     auto make_unique_array(shape_t<Rank> shape);
@@ -113,22 +207,48 @@ namespace nd
     template<typename ValueType, std::size_t Rank>     auto promote(ValueType, shape_t<Rank>);
 
 
+    // file input and output
+    //=========================================================================
+    template<typename ArrayType>                   void save_npy(const ArrayType& array, const std::string& filename);
+    template<typename ValueType, std::size_t Rank> auto load_npy(const std::string& filename);
+    template<typename ValueType, std::size_t Rank> auto map_npy(const std::string& filename, map_mode_t mode=map_mode_t::read_only);
+    template<typename ArrayType, std::size_t Rank> void save_chunked(const ArrayType& array, const std::string& filename, shape_t<Rank> chunk_shape, chunk_codec_t codec=chunk_codec_t::lz, bool shuffle=true, std::size_t num_threads=0);
+    template<typename ValueType, std::size_t Rank> auto load_chunked(const std::string& filename, std::size_t cache_chunks=64);
+    template<typename ArrayType, typename Sink>    auto async_write(ArrayType array, Sink sink, std::size_t chunk_bytes=1 << 22);
+
+
     // basic array operators
     //=========================================================================
-    inline                       auto to_shared();
-    inline                       auto to_unique();
-    inline                       auto bounds_check();
-    inline                       auto sum();
-    inline                       auto all();
-    inline                       auto any();
-    inline                       auto min();
-    inline                       auto max();
-    template<typename ArrayType> auto min(ArrayType&& array);
-    template<typename ArrayType> auto max(ArrayType&& array);
-    template<typename Function>  auto map(Function function);
-    template<typename Function>  auto apply(Function function);
-    template<typename ArrayType> auto where(ArrayType array);
-    template<typename Function>  auto binary_op(Function function);
+    inline                           auto to_shared();
+    inline                           auto to_unique();
+    inline                           auto to_shared_parallel(std::size_t num_threads=0);
+    inline                           auto to_shared_parallel(thread_pool_t& pool);
+    inline                           auto to_shared_parallel(tile_scheduler_t& scheduler);
+    template<std::size_t NumThreads> auto evaluate_on();
+    inline                           auto bounds_check();
+    inline                           auto sum();
+    inline                           auto all();
+    inline                           auto any();
+    inline                           auto min();
+    inline                           auto max();
+    template<typename ArrayType>     auto min(ArrayType&& array);
+    template<typename ArrayType>     auto max(ArrayType&& array);
+    template<typename Function>      auto map(Function function);
+    template<typename Function>      auto apply(Function function);
+    template<typename ArrayType>     auto where(ArrayType array);
+    template<typename ArrayType>     auto where_parallel(ArrayType array, std::size_t num_threads=0);
+    template<typename ArrayType>     auto where_offsets(ArrayType array);
+    template<typename ArrayType>     auto where_offsets_parallel(ArrayType array, std::size_t num_threads=0);
+    template<typename Function>      auto binary_op(Function function);
+    template<typename Sink, std::size_t Rank> auto stream_to(Sink sink, shape_t<Rank> block_shape);
+    inline                           auto cache(std::size_t budget_bytes=std::size_t(1) << 28);
+    template<typename ArrayType>     auto stencil(ArrayType weights, boundary_t boundary=boundary_t::ghost);
+    template<typename Function>      auto stencil(Function kernel, std::size_t radius, boundary_t boundary=boundary_t::ghost);
+    template<typename StencilOperator> auto repeat_stencil(StencilOperator stencil, std::size_t num_steps);
+    template<typename StencilOperator> auto repeat_stencil(StencilOperator stencil, std::size_t num_steps, tile_scheduler_t& scheduler);
+    template<std::size_t Rank>       auto pad(shape_t<Rank> ghost_width);
+    template<typename... Args>       auto pad(Args... args);
+    inline                           auto interior();
 
 
     // extended operator support structs
@@ -140,6 +260,7 @@ namespace nd
     template<typename ArrayType>                   class concatenator_t;
     template<std::size_t Rank, typename ArrayType> class replacer_t;
     template<std::size_t Rank>                     class selector_t;
+    template<template<typename> class Accumulator> class reduction_t;
 
 
     // extended operators
@@ -160,6 +281,8 @@ namespace nd
     template<std::size_t Rank>                     auto read_index(index_t<Rank>);
     template<typename... Args>                     auto read_index(Args... args);
     template<typename ArrayType>                   auto read_indexes(ArrayType array_of_indexes);
+    template<std::size_t Rank>                     auto permute_axes(index_t<Rank> axis_order);
+    template<typename... Args>                     auto permute_axes(Args... args);
 
 
     // to_string overloads
@@ -173,6 +296,10 @@ namespace nd
     //=========================================================================
     template<typename ValueType, std::size_t Rank> using shared_array = array_t<shared_provider_t<ValueType, Rank>>;
     template<typename ValueType, std::size_t Rank> using unique_array = array_t<unique_provider_t<ValueType, Rank>>;
+    template<typename ValueType, std::size_t Rank> using strided_array = array_t<strided_shared_provider_t<ValueType, Rank>>;
+    template<typename ValueType, std::size_t Rank> using uniform_array = array_t<uniform_provider_t<ValueType, Rank>>;
+    template<typename ValueType, std::size_t Rank> using mapped_array = array_t<mmap_provider_t<ValueType, Rank>>;
+    template<typename ValueType, std::size_t Rank> using padded_array = array_t<padded_provider_t<ValueType, Rank>>;
     template<typename ArrayType> using value_type_of = typename std::remove_reference_t<ArrayType>::value_type;
 
 
@@ -204,6 +331,121 @@ namespace nd
         template<typename ResultSequence, typename SourceSequence, typename IndexContainer>
         auto remove_elements(const SourceSequence& source, IndexContainer indexes);
 
+        template<typename Function, typename... Args>
+        bool invoke_and_continue(Function&& fn, Args&&... args);
+
+        template<typename SourceProvider, typename TargetProvider, std::size_t Rank>
+        void evaluate_region(const SourceProvider& source, TargetProvider& target, const access_pattern_t<Rank>& region);
+
+        template<typename SourceProvider, typename TargetProvider, std::size_t Rank>
+        bool evaluate_region_blocked(const SourceProvider& source, TargetProvider& target, const access_pattern_t<Rank>& region);
+
+        template<typename ArrayType, typename Accumulator, std::size_t Rank>
+        void reduce_region(const ArrayType& array, const access_pattern_t<Rank>& region, Accumulator& accumulator, std::atomic<bool>& stop);
+
+        template<typename ValueType, std::size_t Rank, typename Accumulator>
+        void reduce_region_along(const strided_shared_provider_t<ValueType, Rank>& source, const access_pattern_t<Rank>& region, Accumulator* target, const jumps_t<Rank>& target_jumps);
+
+        template<typename Accumulator>
+        Accumulator combine_tree(std::vector<Accumulator>& partials);
+
+        template<typename Provider, typename ValueType>
+        void evaluate_flat(const Provider& source, ValueType* target, std::size_t start, std::size_t count);
+
+#if defined(__GNUC__) && defined(__x86_64__)
+        template<typename Function, typename Pack, typename Result>
+        void combine_packs(const Pack& a, const Pack& b, Result& result);
+
+        template<typename Provider>
+        struct pack_reader_t;
+
+        template<std::size_t PackBytes, typename Provider, typename ValueType>
+        void evaluate_packed(const Provider& source, ValueType* target, std::size_t start, std::size_t count);
+#endif
+
+        template<typename Provider>
+        bool is_flat(const Provider& provider);
+
+        template<typename Provider, typename ValueType, std::size_t Rank>
+        void evaluate_block(const Provider& source, const access_pattern_t<Rank>& region, ValueType* target);
+
+        template<std::size_t Rank>
+        bool is_row_major_block(const shape_t<Rank>& shape, const shape_t<Rank>& block_shape);
+
+        template<typename Provider, typename ValueType>
+        void evaluate_flat_range(const Provider& source, ValueType* target, std::size_t start, std::size_t count);
+
+        template<typename Provider, typename Sink>
+        void write_double_buffered(const Provider& source, Sink& sink, std::size_t chunk_bytes);
+
+        inline io_worker_t& sink_writer();
+
+        inline void advise_mapping(const mapped_file_t& file, const void* begin, std::size_t count, access_advice_t advice);
+
+        template<typename Provider>
+        void advise_leaves(const Provider& provider, access_advice_t advice);
+
+        template<typename Provider, std::size_t Rank>
+        void advise_leaves(const Provider& provider, const access_pattern_t<Rank>& region, access_advice_t advice);
+
+        template<typename ValueType, std::size_t Rank, typename Kernel>
+        auto evaluate_stencil_steps(const stencil_provider_t<ValueType, Rank, Kernel>& stencil, std::size_t num_steps, tile_scheduler_t* scheduler);
+
+        template<std::size_t Rank, std::size_t... Ranks>
+        auto broadcast_shapes(const shape_t<Ranks>&... shapes);
+
+        template<std::size_t Rank, std::size_t SourceRank>
+        auto broadcast_index(const index_t<Rank>& index, const shape_t<SourceRank>& source_shape);
+
+        template<typename Provider, typename Accumulator>
+        void reduce_flat(const Provider& source, std::size_t start, std::size_t count, Accumulator& accumulator, std::atomic<bool>& stop);
+
+        template<typename ResultType, typename ArrayType, typename Encoder>
+        auto compact_where(const ArrayType& array, tile_scheduler_t* scheduler, Encoder encode);
+
+        struct npy_header_t
+        {
+            std::string descr;
+            bool fortran_order = false;
+            std::vector<std::size_t> shape;
+            std::size_t data_offset = 0;
+        };
+
+        template<typename ValueType>
+        std::string npy_descr();
+
+        template<std::size_t Rank>
+        std::string make_npy_header(const std::string& descr, bool fortran_order, const shape_t<Rank>& shape);
+
+        inline npy_header_t read_npy_header(std::FILE* file, const std::string& filename);
+
+        template<typename ValueType, std::size_t Rank>
+        shape_t<Rank> check_npy_header(const npy_header_t& header, const std::string& filename);
+
+        inline std::string header_value(const std::string& dict, const std::string& key, const std::string& filename);
+        inline std::vector<std::size_t> parse_header_tuple(const std::string& text);
+        inline void byte_shuffle(const unsigned char* source, unsigned char* target, std::size_t num_bytes, std::size_t element_size);
+        inline void byte_unshuffle(const unsigned char* source, unsigned char* target, std::size_t num_bytes, std::size_t element_size);
+        inline std::vector<unsigned char> lz_compress(const unsigned char* source, std::size_t num_bytes);
+        inline void lz_decompress(const unsigned char* source, std::size_t num_source_bytes, unsigned char* target, std::size_t num_bytes);
+        inline std::vector<unsigned char> encode_chunk(const unsigned char* source, std::size_t num_bytes, std::size_t element_size, chunk_codec_t codec, bool shuffle);
+        inline void decode_chunk(const std::vector<unsigned char>& stored, unsigned char* target, std::size_t num_bytes, std::size_t element_size, chunk_codec_t codec, bool shuffle);
+
+        template<typename ValueType> struct sum_accumulator_t;
+        template<typename ValueType> struct min_accumulator_t;
+        template<typename ValueType> struct max_accumulator_t;
+        template<typename ValueType> struct all_accumulator_t;
+        template<typename ValueType> struct any_accumulator_t;
+
+        inline std::size_t boundary_index(long index, std::size_t size, boundary_t boundary);
+
+        template<typename ValueType, std::size_t Rank> struct stencil_reader_t;
+        template<typename ValueType, std::size_t Rank> struct boundary_reader_t;
+        template<typename ValueType, std::size_t Rank> struct stencil_weights_t;
+
+        struct process_barrier_t;
+        template<std::size_t Rank> struct shm_header_t;
+
         template <typename... Ts> using void_t = void;
 
         template <typename T, typename = void>
@@ -211,6 +453,158 @@ namespace nd
 
         template <typename T>
         struct has_typedef_is_ndarray<T, void_t<typename T::is_ndarray>> : std::true_type {};
+
+        template <typename T>
+        struct is_contiguous_provider : std::false_type {};
+
+        template <typename ValueType, std::size_t Rank>
+        struct is_contiguous_provider<shared_provider_t<ValueType, Rank>> : std::true_type {};
+
+        template <typename ValueType, std::size_t Rank>
+        struct is_contiguous_provider<unique_provider_t<ValueType, Rank>> : std::true_type {};
+
+        template <typename ValueType, std::size_t Rank>
+        struct is_contiguous_provider<mmap_provider_t<ValueType, Rank>> : std::true_type {};
+
+        template <typename ValueType, std::size_t Rank>
+        struct is_contiguous_provider<padded_provider_t<ValueType, Rank>> : std::true_type {};
+
+        template <typename T>
+        struct is_mapped_provider : std::false_type {};
+
+        template <typename ValueType, std::size_t Rank>
+        struct is_mapped_provider<mmap_provider_t<ValueType, Rank>> : std::true_type {};
+
+        template <typename T>
+        struct is_strided_provider : std::false_type {};
+
+        template <typename ValueType, std::size_t Rank>
+        struct is_strided_provider<strided_shared_provider_t<ValueType, Rank>> : std::true_type {};
+
+        template <typename T>
+        struct is_strided_viewable : is_strided_provider<T> {};
+
+        template <typename ValueType, std::size_t Rank>
+        struct is_strided_viewable<shared_provider_t<ValueType, Rank>> : std::true_type {};
+
+        template <typename ValueType, std::size_t Rank>
+        struct is_strided_viewable<mmap_provider_t<ValueType, Rank>> : std::true_type {};
+
+        template <typename ValueType, std::size_t Rank>
+        struct is_strided_viewable<padded_provider_t<ValueType, Rank>> : std::true_type {};
+
+        template <typename ArrayType>
+        using is_strided_viewable_array = is_strided_viewable<typename std::decay_t<ArrayType>::provider_type>;
+
+        template <typename T>
+        struct is_uniform_provider : std::false_type {};
+
+        template <typename ValueType, std::size_t Rank>
+        struct is_uniform_provider<uniform_provider_t<ValueType, Rank>> : std::true_type {};
+
+        template <typename ArrayType>
+        using is_uniform_array = is_uniform_provider<typename std::decay_t<ArrayType>::provider_type>;
+
+        template <typename T>
+        struct is_elementwise_provider : std::false_type {};
+
+        template <typename Function, typename... Providers>
+        struct is_elementwise_provider<elementwise_provider_t<Function, Providers...>> : std::true_type {};
+
+        template <typename T>
+        struct is_flat_readable : is_contiguous_provider<T> {};
+
+        template <typename ValueType, std::size_t Rank>
+        struct is_flat_readable<uniform_provider_t<ValueType, Rank>> : std::true_type {};
+
+        template <typename Function, typename... Providers>
+        struct is_flat_readable<elementwise_provider_t<Function, Providers...>> : std::bool_constant<
+            ((Providers::provider_rank == elementwise_provider_t<Function, Providers...>::provider_rank) && ...) &&
+            (is_flat_readable<Providers>::value && ...)> {};
+
+        template <typename T>
+        struct is_pack_element : std::bool_constant<
+            std::is_same<T, float>::value ||
+            std::is_same<T, double>::value ||
+            std::is_same<T, std::int32_t>::value ||
+            std::is_same<T, std::int64_t>::value> {};
+
+        template <typename T>
+        struct is_pack_arithmetic : std::false_type {};
+
+        template <> struct is_pack_arithmetic<std::plus<>> : std::true_type {};
+        template <> struct is_pack_arithmetic<std::minus<>> : std::true_type {};
+        template <> struct is_pack_arithmetic<std::multiplies<>> : std::true_type {};
+        template <> struct is_pack_arithmetic<std::divides<>> : std::true_type {};
+
+        template <typename T>
+        struct is_pack_comparison : std::false_type {};
+
+        template <> struct is_pack_comparison<std::less<>> : std::true_type {};
+        template <> struct is_pack_comparison<std::less_equal<>> : std::true_type {};
+        template <> struct is_pack_comparison<std::greater<>> : std::true_type {};
+        template <> struct is_pack_comparison<std::greater_equal<>> : std::true_type {};
+        template <> struct is_pack_comparison<std::equal_to<>> : std::true_type {};
+        template <> struct is_pack_comparison<std::not_equal_to<>> : std::true_type {};
+
+        template <typename T, typename ElementType>
+        struct is_pack_operand : std::bool_constant<is_contiguous_provider<T>::value && std::is_same<typename T::value_type, ElementType>::value> {};
+
+        template <typename ValueType, std::size_t Rank, typename ElementType>
+        struct is_pack_operand<uniform_provider_t<ValueType, Rank>, ElementType> : std::is_same<ValueType, ElementType> {};
+
+        template <typename Function, typename A, typename B, typename ElementType>
+        struct is_pack_operand<elementwise_provider_t<Function, A, B>, ElementType> : std::bool_constant<
+            is_pack_arithmetic<Function>::value &&
+            std::is_same<typename elementwise_provider_t<Function, A, B>::value_type, ElementType>::value &&
+            is_pack_operand<A, ElementType>::value &&
+            is_pack_operand<B, ElementType>::value> {};
+
+        template <typename T>
+        struct is_packable : std::false_type {};
+
+        template <typename Function, typename A, typename B>
+        struct is_packable<elementwise_provider_t<Function, A, B>> : std::bool_constant<
+            is_pack_element<typename A::value_type>::value &&
+            (is_pack_arithmetic<Function>::value || is_pack_comparison<Function>::value) &&
+            is_pack_operand<A, typename A::value_type>::value &&
+            is_pack_operand<B, typename A::value_type>::value> {};
+
+        template <typename T, typename = void>
+        struct is_byte_sink : std::false_type {};
+
+        template <typename T>
+        struct is_byte_sink<T, void_t<decltype(std::declval<T&>().write(std::declval<const void*>(), std::size_t()))>> : std::true_type {};
+
+        template <typename T, typename = void>
+        struct has_close : std::false_type {};
+
+        template <typename T>
+        struct has_close<T, void_t<decltype(std::declval<T&>().close())>> : std::true_type {};
+
+        template <typename T>
+        struct sink_target { using type = T; };
+
+        template <typename T>
+        struct sink_target<std::reference_wrapper<T>> { using type = T; };
+
+        template <typename T>
+        struct is_stencil_provider : std::false_type {};
+
+        template <typename ValueType, std::size_t Rank, typename Kernel>
+        struct is_stencil_provider<stencil_provider_t<ValueType, Rank, Kernel>> : std::true_type {};
+
+        template <typename T>
+        struct is_stencil_weights : std::false_type {};
+
+        template <typename ValueType, std::size_t Rank>
+        struct is_stencil_weights<stencil_weights_t<ValueType, Rank>> : std::true_type {};
+
+        template <typename T>
+        struct is_reduction : std::false_type {};
+
+        template <template<typename> class Accumulator>
+        struct is_reduction<reduction_t<Accumulator>> : std::true_type {};
     }
 }
 
@@ -814,1864 +1208,8377 @@ auto nd::partition_shape(shape_t<Rank> shape)
 
 
 
-//=============================================================================
-class nd::axis_selector_t
+/**
+ * @brief      Return a sequence of access patterns that cover a shape by
+ *             partitioning it on its first axis, where the number of
+ *             partitions is only known at runtime.
+ *
+ * @param[in]  shape           The shape to partition
+ * @param[in]  num_partitions  The number of partitions
+ *
+ * @tparam     Rank            The shape rank
+ *
+ * @return     A std::vector of access patterns
+ *
+ * @note       If the first axis is shorter than the number of partitions,
+ *             some of the partitions will be empty.
+ */
+template<std::size_t Rank>
+auto nd::partition_shape(shape_t<Rank> shape, std::size_t num_partitions)
 {
-public:
-
-    //=========================================================================
-    axis_selector_t(std::size_t axis_to_select, std::size_t start, std::size_t final, std::size_t jumps, bool is_final_from_the_end)
-    : axis_to_select(axis_to_select)
-    , start(start)
-    , final(final)
-    , jumps(jumps)
-    , is_final_from_the_end(is_final_from_the_end) {}
+    constexpr std::size_t distributed_axis = 0;
+    auto result = std::vector<access_pattern_t<Rank>>(num_partitions);
 
-    template<typename ArrayType>
-    auto operator()(ArrayType&& array) const
+    for (std::size_t n = 0; n < num_partitions; ++n)
     {
-        if (axis_to_select >= array.rank())
-        {
-            throw std::logic_error("cannot select axis greater than or equal to array rank");
-        }
+        auto p = make_access_pattern(shape);
+        p.start[distributed_axis] = (n + 0) * shape[distributed_axis] / num_partitions;
+        p.final[distributed_axis] = (n + 1) * shape[distributed_axis] / num_partitions;
+        result[n] = p;
+    }
+    return result;
+}
 
-        auto accessor = make_access_pattern(array.shape());
-        accessor.start[axis_to_select] = start;
-        accessor.final[axis_to_select] = is_final_from_the_end ? array.shape(axis_to_select) - final : final;
-        accessor.jumps[axis_to_select] = jumps;
 
-        auto mapping = [accessor, array] (auto index)
-        {
-            return array(accessor.map_index(index));
-        };
-        return make_array(mapping, accessor.shape());
-    }
 
-    auto from(std::size_t new_start) const
+
+/**
+ * @brief      Return a sequence of access patterns that cover a shape by
+ *             cutting it into N-dimensional tiles. The tiles are ordered
+ *             row-major, and tiles on the upper edge of an axis are truncated
+ *             to fit inside the shape.
+ *
+ * @param[in]  shape       The shape to partition
+ * @param[in]  tile_shape  The shape of each tile
+ *
+ * @tparam     Rank        The shape rank
+ *
+ * @return     A std::vector of non-empty access patterns
+ */
+template<std::size_t Rank>
+auto nd::partition_tiles(shape_t<Rank> shape, shape_t<Rank> tile_shape)
+{
+    auto result = std::vector<access_pattern_t<Rank>>();
+    auto tile_counts = shape_t<Rank>();
+
+    for (std::size_t n = 0; n < Rank; ++n)
     {
-        return axis_selector_t(axis_to_select, new_start, final, jumps, is_final_from_the_end);
+        if (tile_shape[n] == 0)
+        {
+            throw std::logic_error("tile shape must be non-zero on every axis");
+        }
+        tile_counts[n] = (shape[n] + tile_shape[n] - 1) / tile_shape[n];
     }
-    auto to(std::size_t new_final) const
+    if (tile_counts.volume() == 0)
     {
-        return axis_selector_t(axis_to_select, start, new_final, jumps, is_final_from_the_end);
+        return result;
     }
-    auto jumping(std::size_t new_jumps) const
+    result.reserve(tile_counts.volume());
+
+    for (auto tile_index : make_access_pattern(tile_counts))
     {
-        return axis_selector_t(axis_to_select, start, final, new_jumps, is_final_from_the_end);
+        auto p = make_access_pattern(shape);
+
+        for (std::size_t n = 0; n < Rank; ++n)
+        {
+            p.start[n] = tile_index[n] * tile_shape[n];
+            p.final[n] = std::min(p.start[n] + tile_shape[n], shape[n]);
+        }
+        result.push_back(p);
     }
-    auto from_the_end() const
+    return result;
+}
+
+
+
+
+/**
+ * @brief      Choose a tile shape for evaluating an array of the given shape
+ *             and value type. Tiles are grown from the last axis toward the
+ *             first, so each tile spans whole rows where possible, until they
+ *             hold about tile_bytes of data.
+ *
+ * @param[in]  shape          The shape to be tiled
+ * @param[in]  min_num_tiles  Shrink the tiles if needed so there are at least
+ *                            this many (useful to keep all workers busy)
+ * @param[in]  tile_bytes     The target tile size in bytes
+ *
+ * @tparam     ValueType      The value type of the array to be tiled
+ * @tparam     Rank           The shape rank
+ *
+ * @return     The tile shape
+ */
+template<typename ValueType, std::size_t Rank>
+auto nd::make_tile_shape(shape_t<Rank> shape, std::size_t min_num_tiles, std::size_t tile_bytes)
+{
+    auto target = std::max(tile_bytes / sizeof(ValueType), std::size_t(1));
+    auto volume = std::size_t(1);
+    auto result = shape_t<Rank>();
+
+    target = std::min(target, std::max(shape.volume() / std::max(min_num_tiles, std::size_t(1)), std::size_t(1)));
+
+    for (int n = Rank - 1; n >= 0; --n)
     {
-        return axis_selector_t(axis_to_select, start, final, jumps, true);
+        result[n] = std::max(std::min(target / volume, shape[n]), std::size_t(1));
+        volume *= result[n];
     }
+    return result;
+}
 
-private:
-    //=========================================================================
-    std::size_t axis_to_select;
-    std::size_t start;
-    std::size_t final;
-    std::size_t jumps;
-    bool is_final_from_the_end;
-};
 
 
 
 
 //=============================================================================
-class nd::axis_shifter_t
-{
-public:
+// Index space iteration
+//=============================================================================
 
-    //=========================================================================
-    axis_shifter_t(std::size_t axis_to_shift, int delta) : axis_to_shift(axis_to_shift), delta(delta) {}
 
-    template<typename ArrayType>
-    auto operator()(ArrayType&& array) const
-    {
-        if (axis_to_shift >= array.rank())
-        {
-            throw std::logic_error("cannot shift axis greater than or equal to array rank");
-        }
-        if (std::size_t(std::abs(delta)) >= array.shape(axis_to_shift))
-        {
-            throw std::logic_error("cannot shift an array by more than its length on that axis");
-        }
-        auto mapping = [axis_to_shift=axis_to_shift, delta=delta, array] (auto index)
-        {
-            index[axis_to_shift] -= delta;
-            return array(index);
-        };
-        auto shape = array.shape();
-        shape[axis_to_shift] -= std::abs(delta);
 
-        return make_array(mapping, shape);
-    }
 
-    auto along_axis(std::size_t new_axis_to_shift) const
+/**
+ * @brief      Call a function once for each row (run of indexes along the last
+ *             axis) generated by an access pattern. The N-dimensional carry is
+ *             done once per row rather than once per element, so the caller can
+ *             run a tight loop over the last axis.
+ *
+ * @param[in]  pattern   The access pattern to iterate over
+ * @param      fn        A function fn(index, count), where index is the first
+ *                       index of the row, and count is the number of elements
+ *                       in the row. The i-th element of the row is at
+ *                       index[Rank - 1] + i * pattern.jumps[Rank - 1]. If fn
+ *                       returns bool, then returning false stops the iteration.
+ *
+ * @tparam     Rank      The rank of the access pattern
+ * @tparam     Function  The type of the function object
+ *
+ * @return     False if the iteration was stopped early, true otherwise
+ */
+template<std::size_t Rank, typename Function>
+bool nd::for_each_row(const access_pattern_t<Rank>& pattern, Function&& fn)
+{
+    if (pattern.empty())
     {
-        return axis_shifter_t(new_axis_to_shift, delta);
+        return true;
     }
+    auto count = pattern.shape()[Rank - 1];
+    auto rows = pattern;
+    rows.final[Rank - 1] = rows.start[Rank - 1] + 1;
+    rows.jumps[Rank - 1] = 1;
 
-private:
-    //=========================================================================
-    std::size_t axis_to_shift;
-    int delta;
-};
+    auto index = rows.start;
 
+    do {
+        if (! detail::invoke_and_continue(fn, index, count))
+        {
+            return false;
+        }
+    } while (rows.advance(index));
 
+    return true;
+}
 
 
-//=============================================================================
-template<std::size_t RankDifference>
-class nd::axis_freezer_t
-{
-public:
 
-    //=========================================================================
-    axis_freezer_t(
-        index_t<RankDifference> axes_to_freeze,
-        index_t<RankDifference> index_to_freeze_at=make_uniform_index<RankDifference>(0))
-    : axes_to_freeze(axes_to_freeze)
-    , index_to_freeze_at(index_to_freeze_at) {}
 
-    template<typename PatchArrayType>
-    auto operator()(PatchArrayType array) const
+/**
+ * @brief      Call a function once for each index generated by an access
+ *             pattern, in the same order as iterating over the pattern. This
+ *             is built on for_each_row, and is much cheaper than the access
+ *             pattern's iterator for higher rank patterns.
+ *
+ * @param[in]  pattern   The access pattern to iterate over
+ * @param      fn        A function fn(index). If fn returns bool, then
+ *                       returning false stops the iteration.
+ *
+ * @tparam     Rank      The rank of the access pattern
+ * @tparam     Function  The type of the function object
+ *
+ * @return     False if the iteration was stopped early, true otherwise
+ */
+template<std::size_t Rank, typename Function>
+bool nd::for_each_index(const access_pattern_t<Rank>& pattern, Function&& fn)
+{
+    auto jump = pattern.jumps[Rank - 1];
+
+    return for_each_row(pattern, [&fn, jump] (index_t<Rank> index, std::size_t count)
     {
-        for (auto a : axes_to_freeze)
-            if (a >= array.rank())
-                throw std::logic_error("cannot freeze axis greater than or equal to array rank");
+        auto start = index[Rank - 1];
 
-        auto mapping = [axes_to_freeze=axes_to_freeze, index_to_freeze_at=index_to_freeze_at, array] (auto&& index)
+        for (std::size_t i = 0; i < count; ++i)
         {
-            return array(index.insert_elements(axes_to_freeze, index_to_freeze_at));
-        };
-        auto shape = array.shape().remove_elements(axes_to_freeze);
+            index[Rank - 1] = start + i * jump;
 
-        return make_array(mapping, shape);
-    }
+            if (! detail::invoke_and_continue(fn, static_cast<const index_t<Rank>&>(index)))
+            {
+                return false;
+            }
+        }
+        return true;
+    });
+}
 
-    auto at_index(index_t<RankDifference> new_index_to_freeze_at) const
-    {
-        return axis_freezer_t(axes_to_freeze, new_index_to_freeze_at);
-    }
 
-    template<typename... Args>
-    auto at_index(Args... new_index_to_freeze_at) const
-    {
-        static_assert(sizeof...(Args) == RankDifference);
-        return at_index(make_index(new_index_to_freeze_at...));
-    }
 
-private:
-    //=========================================================================
-    index_t<RankDifference> axes_to_freeze;
-    index_t<RankDifference> index_to_freeze_at;
-};
 
+//=============================================================================
+// Parallel execution
+//=============================================================================
 
 
 
-//=============================================================================
-template<typename OperatorType>
-class nd::axis_reducer_t
+
+/**
+ * @brief      A pool of persistent worker threads, used to evaluate arrays in
+ *             parallel. Work is submitted in batches of tasks with the run
+ *             method, which blocks until every task in the batch has finished.
+ *             The calling thread executes queued tasks while it waits, so it's
+ *             safe to call run from inside a task.
+ */
+class nd::thread_pool_t
 {
 public:
 
     //=========================================================================
-    axis_reducer_t(std::size_t axis_to_reduce, OperatorType the_operator)
-    : axis_to_reduce(axis_to_reduce)
-    , the_operator(the_operator) {}
+    explicit thread_pool_t(std::size_t num_threads=std::thread::hardware_concurrency())
+    {
+        reserve(num_threads);
+    }
 
-    template<typename ArrayType>
-    auto operator()(ArrayType array) const
+    ~thread_pool_t()
     {
-        if (axis_to_reduce >= array.rank())
         {
-            throw std::logic_error("cannot reduce axis greater than or equal to array rank");
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
         }
-        constexpr std::size_t R = ArrayType::array_rank;
+        condition.notify_all();
 
-        auto mapping = [the_operator=the_operator, axis_to_reduce=axis_to_reduce, array] (auto&& index)
+        for (auto& worker : workers)
         {
-            auto axes_to_freeze = index_t<R>::range().remove_elements(make_index(axis_to_reduce));
-            auto freezer = axis_freezer_t<R - 1>(axes_to_freeze).at_index(index);
-            return the_operator(freezer(array));
-        };
-        auto shape = array.shape().remove_elements(make_index(axis_to_reduce));
-
-        return make_array(mapping, shape);
+            worker.join();
+        }
     }
 
-    auto along_axis(std::size_t new_axis_to_reduce) const
-    {
-        return axis_reducer_t(new_axis_to_reduce, the_operator);
-    }
+    thread_pool_t(const thread_pool_t& other) = delete;
+    thread_pool_t& operator=(const thread_pool_t& other) = delete;
 
-private:
-    //=========================================================================
-    std::size_t axis_to_reduce;
-    OperatorType the_operator;
-};
 
 
 
+    /**
+     * @brief      Return the number of worker threads.
+     *
+     * @return     The number of threads
+     */
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return workers.size();
+    }
 
-//=============================================================================
-template<typename ArrayType>
-class nd::concatenator_t
-{
-public:
 
-    //=========================================================================
-    concatenator_t(std::size_t axis_to_extend, ArrayType array_to_concat)
-    : axis_to_extend(axis_to_extend)
-    , array_to_concat(array_to_concat) {}
 
-    template<typename SourceArrayType>
-    auto operator()(SourceArrayType array) const
+
+    /**
+     * @brief      Grow the pool so it has at least the given number of worker
+     *             threads. The pool never shrinks.
+     *
+     * @param[in]  num_threads  The minimum number of threads
+     */
+    void reserve(std::size_t num_threads)
     {
-        if (axis_to_extend >= array.rank())
-        {
-            throw std::logic_error("cannot concatenate on axis greater than or equal to array rank");
-        }
-        if (array_to_concat.shape().remove_elements(make_index(axis_to_extend))
-            !=        array.shape().remove_elements(make_index(axis_to_extend)))
+        std::lock_guard<std::mutex> lock(mutex);
+
+        while (workers.size() < num_threads)
         {
-            throw std::logic_error("the shape of the concatenated arrays can only differ on the concatenating axis");
+            workers.emplace_back([this] { work(); });
         }
+    }
 
-        auto mapping = [axis_to_extend=axis_to_extend, array_to_concat=array_to_concat, array] (auto index)
+
+
+
+    /**
+     * @brief      Call fn(n) for each n in [0, num_tasks) on the pool, and
+     *             return when all of the calls have finished.
+     *
+     * @param[in]  num_tasks  The number of tasks
+     * @param      fn         The function to call, taking the task number
+     *
+     * @tparam     Function   The type of the function object
+     *
+     * @note       If any of the tasks throws, the first exception is re-thrown
+     *             here once the remaining tasks have completed.
+     */
+    template<typename Function>
+    void run(std::size_t num_tasks, Function&& fn)
+    {
+        auto remaining = num_tasks;
+        auto error = std::exception_ptr();
+        auto finished = std::condition_variable();
+
+        auto execute = [&] (std::size_t n)
         {
-            if (index[axis_to_extend] >= array.shape(axis_to_extend))
+            auto task_error = std::exception_ptr();
+
+            try {
+                fn(n);
+            }
+            catch (...)
             {
-                index[axis_to_extend] -= array.shape(axis_to_extend);
-                return array_to_concat(index);
+                task_error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if (task_error && ! error)
+            {
+                error = task_error;
+            }
+            if (--remaining == 0)
+            {
+                finished.notify_all();
             }
-            return array(index);
         };
 
-        auto shape = array.shape();
-        shape[axis_to_extend] += array_to_concat.shape(axis_to_extend);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
 
-        return make_array(mapping, shape);
-    }
+            for (std::size_t n = 0; n < num_tasks; ++n)
+            {
+                tasks.emplace_back([&execute, n] { execute(n); });
+            }
+        }
+        condition.notify_all();
 
-    auto on_axis(std::size_t new_axis_to_concat) const
-    {
-        return concatenator_t(new_axis_to_concat, array_to_concat);
+        auto lock = std::unique_lock<std::mutex>(mutex);
+
+        while (remaining != 0)
+        {
+            if (! tasks.empty())
+            {
+                auto task = std::move(tasks.front());
+                tasks.pop_front();
+                lock.unlock();
+                task();
+                lock.lock();
+            }
+            else
+            {
+                finished.wait(lock);
+            }
+        }
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
     }
 
 private:
     //=========================================================================
-    std::size_t axis_to_extend;
-    ArrayType array_to_concat;
+    void work()
+    {
+        while (true)
+        {
+            auto task = std::function<void()>();
+            {
+                auto lock = std::unique_lock<std::mutex>(mutex);
+                condition.wait(lock, [this] { return stopping || ! tasks.empty(); });
+
+                if (tasks.empty())
+                {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    mutable std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<std::function<void()>> tasks;
+    std::vector<std::thread> workers;
+    bool stopping = false;
 };
 
 
 
 
-//=============================================================================
-template<std::size_t Rank, typename ArrayType>
-class nd::replacer_t
+/**
+ * @brief      Return a process-wide thread pool, created on first use with one
+ *             worker per hardware thread.
+ *
+ * @return     A reference to the pool
+ */
+nd::thread_pool_t& nd::default_thread_pool()
+{
+    static thread_pool_t pool;
+    return pool;
+}
+
+
+
+
+
+/**
+ * @brief      Runs a batch of tiles on a thread pool with work stealing. Each
+ *             worker starts with a contiguous block of tiles in its own deque,
+ *             takes tiles from the front of it, and when it runs dry steals
+ *             from the back of the other workers' deques. Per-worker statistics
+ *             from the most recent run are kept so that load imbalance can be
+ *             measured.
+ */
+class nd::tile_scheduler_t
 {
 public:
 
     //=========================================================================
-    replacer_t(access_pattern_t<Rank> region=access_pattern_t<Rank>()) : region(region) {}
-    replacer_t(access_pattern_t<Rank> region, ArrayType replacement_array)
-    : region(region)
-    , replacement_array(replacement_array) {}
+    struct worker_stats_t
+    {
+        std::size_t tiles_executed = 0;
+        std::size_t tiles_stolen = 0;
+        double busy_seconds = 0.0;
+    };
 
-    template<typename PatchArrayType>
-    auto operator()(PatchArrayType&& array_to_patch) const
+    //=========================================================================
+    tile_scheduler_t(std::size_t num_workers=0) : tile_scheduler_t(default_thread_pool(), num_workers) {}
+
+    tile_scheduler_t(thread_pool_t& pool, std::size_t num_workers=0)
+    : pool(pool)
+    , workers(num_workers ? num_workers : std::max(pool.size(), std::size_t(1))) {}
+
+    std::size_t num_workers() const { return workers; }
+    const std::vector<worker_stats_t>& stats() const { return last_stats; }
+    double wall_seconds() const { return last_wall_seconds; }
+
+
+
+
+    /**
+     * @brief      Return, for each worker, the fraction of the last run's wall
+     *             time it spent executing tiles.
+     *
+     * @return     A std::vector of numbers between 0 and 1
+     */
+    std::vector<double> utilization() const
     {
-        if (region.shape() != replacement_array.shape())
+        auto result = std::vector<double>();
+
+        for (const auto& s : last_stats)
         {
-            throw std::logic_error("region to replace has a different shape than the replacement array");
+            result.push_back(last_wall_seconds > 0.0 ? s.busy_seconds / last_wall_seconds : 0.0);
         }
+        return result;
+    }
 
-        auto mapping = [region=region, replacement_array=replacement_array, array_to_patch] (auto&& index)
+
+
+
+    /**
+     * @brief      Call fn(n) for each tile number n in [0, num_tiles), and
+     *             return when all the tiles are finished.
+     *
+     * @param[in]  num_tiles  The number of tiles
+     * @param      fn         The function to call, taking the tile number,
+     *                        and optionally the number of the worker
+     *                        executing it
+     *
+     * @tparam     Function   The type of the function object
+     */
+    template<typename Function>
+    void run(std::size_t num_tiles, Function&& fn)
+    {
+        auto queues = std::vector<queue_t>(workers);
+        auto start_time = std::chrono::steady_clock::now();
+
+        for (std::size_t w = 0; w < workers; ++w)
         {
-            if (region.generates(index))
+            for (std::size_t n = w * num_tiles / workers; n < (w + 1) * num_tiles / workers; ++n)
             {
-                return replacement_array(region.inverse_map_index(index));
+                queues[w].tiles.push_back(n);
             }
-            return array_to_patch(index);
-        };
-        return make_array(mapping, array_to_patch.shape());
-    }
+        }
+        last_stats.assign(workers, worker_stats_t());
 
-    template<typename... Args> auto from   (Args... args) const { return from   (make_index(args...)); }
-    template<typename... Args> auto to     (Args... args) const { return to     (make_index(args...)); }
-    template<typename... Args> auto jumping(Args... args) const { return jumping(make_jumps(args...)); }
-    auto from   (index_t<Rank> arg) const { return replacer_t(region.with_start(arg), replacement_array); }
-    auto to     (index_t<Rank> arg) const { return replacer_t(region.with_final(arg), replacement_array); }
-    auto jumping(jumps_t<Rank> arg) const { return replacer_t(region.with_jumps(arg), replacement_array); }
+        pool.run(workers, [&] (std::size_t worker)
+        {
+            auto& stats = last_stats[worker];
+            auto tile = std::size_t(0);
 
-    template<typename OtherArrayType>
-    auto with(OtherArrayType&& new_replacement_array) const
-    {
-        return replacer_t<Rank, OtherArrayType>(region, std::forward<OtherArrayType>(new_replacement_array));
+            while (true)
+            {
+                auto stolen = false;
+
+                if (! queues[worker].pop_front(tile))
+                {
+                    if (! steal(queues, worker, tile))
+                    {
+                        break;
+                    }
+                    stolen = true;
+                }
+                auto t0 = std::chrono::steady_clock::now();
+
+                if constexpr (std::is_invocable<Function, std::size_t, std::size_t>::value)
+                {
+                    fn(tile, worker);
+                }
+                else
+                {
+                    fn(tile);
+                }
+                auto t1 = std::chrono::steady_clock::now();
+
+                stats.busy_seconds += std::chrono::duration<double>(t1 - t0).count();
+                stats.tiles_executed += 1;
+                stats.tiles_stolen += stolen;
+            }
+        });
+        last_wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
     }
 
 private:
     //=========================================================================
-    access_pattern_t<Rank> region;
-    ArrayType replacement_array;
-};
+    struct queue_t
+    {
+        bool pop_front(std::size_t& tile)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
 
+            if (tiles.empty())
+                return false;
 
+            tile = tiles.front();
+            tiles.pop_front();
+            return true;
+        }
 
+        bool pop_back(std::size_t& tile)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
 
-//=============================================================================
-template<std::size_t Rank>
-class nd::selector_t
-{
-public:
+            if (tiles.empty())
+                return false;
 
-    //=========================================================================
-    selector_t(access_pattern_t<Rank> region=access_pattern_t<Rank>()) : region(region) {}
+            tile = tiles.back();
+            tiles.pop_back();
+            return true;
+        }
 
-    template<typename ArrayType>
-    auto operator()(ArrayType&& array) const
+        std::mutex mutex;
+        std::deque<std::size_t> tiles;
+    };
+
+    bool steal(std::vector<queue_t>& queues, std::size_t thief, std::size_t& tile) const
     {
-        if (! region.within(array.shape()))
+        for (std::size_t k = 1; k < workers; ++k)
         {
-            throw std::logic_error("out-of-bounds selection");
+            if (queues[(thief + k) % workers].pop_back(tile))
+            {
+                return true;
+            }
         }
-        auto mapping = [region=region, array] (auto&& index) { return array(region.map_index(index)); };
-        return make_array(basic_provider_t<decltype(mapping), Rank>(mapping, region.shape()));
+        return false;
     }
 
-    template<typename... Args> auto from   (Args... args) const { return from   (make_index(args...)); }
-    template<typename... Args> auto to     (Args... args) const { return to     (make_index(args...)); }
-    template<typename... Args> auto jumping(Args... args) const { return jumping(make_jumps(args...)); }
-    auto from   (index_t<Rank> arg) const { return selector_t(region.with_start(arg)); }
-    auto to     (index_t<Rank> arg) const { return selector_t(region.with_final(arg)); }
-    auto jumping(jumps_t<Rank> arg) const { return selector_t(region.with_jumps(arg)); }
-
-private:
-    //=========================================================================
-    access_pattern_t<Rank> region;
+    thread_pool_t& pool;
+    std::size_t workers;
+    std::vector<worker_stats_t> last_stats;
+    double last_wall_seconds = 0.0;
 };
 
 
 
 
-//=============================================================================
-template<typename Function, std::size_t Rank>
-class nd::basic_provider_t
+/**
+ * @brief      A single persistent background thread which runs jobs one at a
+ *             time, in the order they were submitted. Checkpoint writes are
+ *             run on one of these, so they leave the compute threads (and the
+ *             default thread pool) alone, and are written in sequence. The
+ *             destructor finishes any queued jobs before it returns.
+ */
+class nd::io_worker_t
 {
 public:
 
-    using value_type = std::invoke_result_t<Function, index_t<Rank>>;
-    static constexpr std::size_t provider_rank = Rank;
-
     //=========================================================================
-    basic_provider_t(Function mapping, shape_t<Rank> the_shape) : mapping(mapping), the_shape(the_shape) {}
-    decltype(auto) operator()(const index_t<Rank>& index) const { return mapping(index); }
-    auto shape() const { return the_shape; }
-    auto size() const { return the_shape.volume(); }
+    io_worker_t() : thread([this] { work(); }) {}
+
+    ~io_worker_t()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        thread.join();
+    }
+
+    io_worker_t(const io_worker_t& other) = delete;
+    io_worker_t& operator=(const io_worker_t& other) = delete;
+
+    void submit(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        condition.notify_one();
+    }
 
 private:
     //=========================================================================
-    Function mapping;
-    shape_t<Rank> the_shape;
+    void work()
+    {
+        while (true)
+        {
+            auto job = std::function<void()>();
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this] { return stopping || ! jobs.empty(); });
+
+                if (jobs.empty())
+                {
+                    return;
+                }
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<std::function<void()>> jobs;
+    bool stopping = false;
+    std::thread thread;
 };
 
 
 
 
+/**
+ * @brief      Return the process-wide I/O worker, which async_write uses.
+ *
+ * @return     A reference to the worker
+ */
+nd::io_worker_t& nd::default_io_worker()
+{
+    static io_worker_t worker;
+    return worker;
+}
+
+
+
+
+/**
+ * @brief      Return the I/O worker which writes the finished buffers of
+ *             write_double_buffered to their sink, while the next buffer is
+ *             evaluated on the default I/O worker.
+ *
+ * @return     A reference to the worker
+ */
+nd::io_worker_t& nd::detail::sink_writer()
+{
+    static io_worker_t worker;
+    return worker;
+}
+
+
+
+
 //=============================================================================
-template<typename ValueType, std::size_t Rank>
-class nd::shared_provider_t
+class nd::axis_selector_t
 {
 public:
 
-    using value_type = ValueType;
-    static constexpr std::size_t provider_rank = Rank;
-
     //=========================================================================
-    shared_provider_t() {}
-    shared_provider_t(nd::shape_t<Rank> the_shape, std::shared_ptr<nd::buffer_t<ValueType>> buffer)
-    : the_shape(the_shape)
-    , strides(make_strides_row_major(the_shape))
-    , buffer(buffer)
+    axis_selector_t(std::size_t axis_to_select, std::size_t start, std::size_t final, std::size_t jumps, bool is_final_from_the_end)
+    : axis_to_select(axis_to_select)
+    , start(start)
+    , final(final)
+    , jumps(jumps)
+    , is_final_from_the_end(is_final_from_the_end) {}
+
+    template<typename ArrayType>
+    auto operator()(ArrayType&& array) const
     {
-        if (the_shape.volume() != buffer->size())
+        if (axis_to_select >= array.rank())
         {
-            throw std::logic_error("shape and buffer sizes do not match");
+            throw std::logic_error("cannot select axis greater than or equal to array rank");
+        }
+
+        auto accessor = make_access_pattern(array.shape());
+        accessor.start[axis_to_select] = start;
+        accessor.final[axis_to_select] = is_final_from_the_end ? array.shape(axis_to_select) - final : final;
+        accessor.jumps[axis_to_select] = jumps;
+
+        if constexpr (detail::is_uniform_array<ArrayType>::value)
+        {
+            return make_array(array.get_provider().reshape(accessor.shape()));
+        }
+        else if constexpr (detail::is_strided_viewable_array<ArrayType>::value)
+        {
+            return make_array(array.get_provider().strided().select(accessor));
+        }
+        else
+        {
+            auto mapping = [accessor, array] (auto index)
+            {
+                return array(accessor.map_index(index));
+            };
+            return make_array(mapping, accessor.shape());
         }
     }
 
-    const ValueType& operator()(const index_t<Rank>& index) const
+    auto from(std::size_t new_start) const
     {
-        return buffer->operator[](strides.compute_offset(index));
+        return axis_selector_t(axis_to_select, new_start, final, jumps, is_final_from_the_end);
+    }
+    auto to(std::size_t new_final) const
+    {
+        return axis_selector_t(axis_to_select, start, new_final, jumps, is_final_from_the_end);
+    }
+    auto jumping(std::size_t new_jumps) const
+    {
+        return axis_selector_t(axis_to_select, start, final, new_jumps, is_final_from_the_end);
+    }
+    auto from_the_end() const
+    {
+        return axis_selector_t(axis_to_select, start, final, jumps, true);
     }
-
-    auto shape() const { return the_shape; }
-    auto size() const { return the_shape.volume(); }
-    const ValueType* data() const { return buffer->data(); }
-    template<std::size_t R> auto reshape(shape_t<R> new_shape) const { return shared_provider_t<ValueType, R>(new_shape, buffer); }
 
 private:
     //=========================================================================
-    shape_t<Rank> the_shape;
-    memory_strides_t<Rank> strides;
-    std::shared_ptr<buffer_t<ValueType>> buffer;
+    std::size_t axis_to_select;
+    std::size_t start;
+    std::size_t final;
+    std::size_t jumps;
+    bool is_final_from_the_end;
 };
 
 
 
 
 //=============================================================================
-template<typename ValueType, std::size_t Rank>
-class nd::unique_provider_t
+class nd::axis_shifter_t
 {
 public:
 
-    using value_type = ValueType;
-    static constexpr std::size_t provider_rank = Rank;
-
     //=========================================================================
-    unique_provider_t(nd::shape_t<Rank> the_shape, nd::buffer_t<ValueType>&& buffer)
-    : the_shape(the_shape)
-    , strides(make_strides_row_major(the_shape))
-    , buffer(std::move(buffer))
+    axis_shifter_t(std::size_t axis_to_shift, int delta) : axis_to_shift(axis_to_shift), delta(delta) {}
+
+    template<typename ArrayType>
+    auto operator()(ArrayType&& array) const
     {
-        if (the_shape.volume() != unique_provider_t::buffer.size())
+        if (axis_to_shift >= array.rank())
         {
-            throw std::logic_error("shape and buffer sizes do not match");
+            throw std::logic_error("cannot shift axis greater than or equal to array rank");
         }
-    }
-
-    const ValueType& operator()(const index_t<Rank>& index) const { return buffer.operator[](strides.compute_offset(index)); }
-    /* */ ValueType& operator()(const index_t<Rank>& index)       { return buffer.operator[](strides.compute_offset(index)); }
-    template<typename... Args> const ValueType& operator()(Args... args) const { return operator()(make_index(args...)); }
-    template<typename... Args> /* */ ValueType& operator()(Args... args)       { return operator()(make_index(args...)); }
-
-    auto shape() const { return the_shape; }
-    auto size() const { return the_shape.volume(); }
-    const ValueType* data() const { return buffer.data(); }
-    ValueType* data() { return buffer.data(); }
+        if (std::size_t(std::abs(delta)) >= array.shape(axis_to_shift))
+        {
+            throw std::logic_error("cannot shift an array by more than its length on that axis");
+        }
+        auto shape = array.shape();
+        shape[axis_to_shift] -= std::abs(delta);
 
-    auto shared() const & { return shared_provider_t(the_shape, std::make_shared<buffer_t<ValueType>>(buffer.begin(), buffer.end())); }
-    auto shared()      && { return shared_provider_t(the_shape, std::make_shared<buffer_t<ValueType>>(std::move(buffer))); }
+        if constexpr (detail::is_uniform_array<ArrayType>::value)
+        {
+            return make_array(array.get_provider().reshape(shape));
+        }
+        else if constexpr (detail::is_strided_viewable_array<ArrayType>::value)
+        {
+            return make_array(array.get_provider().strided().shift(axis_to_shift, delta));
+        }
+        else
+        {
+            auto mapping = [axis_to_shift=axis_to_shift, delta=delta, array] (auto index)
+            {
+                index[axis_to_shift] -= delta;
+                return array(index);
+            };
+            return make_array(mapping, shape);
+        }
+    }
 
-    template<std::size_t R> auto reshape(shape_t<R> new_shape) const & { return unique_provider_t<ValueType, R>(new_shape, buffer_t<ValueType>(buffer.begin(), buffer.end())); }
-    template<std::size_t R> auto reshape(shape_t<R> new_shape)      && { return unique_provider_t<ValueType, R>(new_shape, std::move(buffer)); }
+    auto along_axis(std::size_t new_axis_to_shift) const
+    {
+        return axis_shifter_t(new_axis_to_shift, delta);
+    }
 
 private:
     //=========================================================================
-    shape_t<Rank> the_shape;
-    memory_strides_t<Rank> strides;
-    buffer_t<ValueType> buffer;
+    std::size_t axis_to_shift;
+    int delta;
 };
 
 
 
 
 //=============================================================================
-template<typename ValueType>
-class nd::buffer_t
+template<std::size_t RankDifference>
+class nd::axis_freezer_t
 {
 public:
 
-    using value_type = ValueType;
-
     //=========================================================================
-    ~buffer_t() { delete [] memory; }
-    buffer_t() {}
-    buffer_t(const buffer_t& other) = delete;
-    buffer_t& operator=(const buffer_t& other) = delete;
+    axis_freezer_t(
+        index_t<RankDifference> axes_to_freeze,
+        index_t<RankDifference> index_to_freeze_at=make_uniform_index<RankDifference>(0))
+    : axes_to_freeze(axes_to_freeze)
+    , index_to_freeze_at(index_to_freeze_at) {}
 
-    buffer_t(buffer_t&& other)
+    template<typename PatchArrayType>
+    auto operator()(PatchArrayType array) const
     {
-        memory = other.memory;
-        count = other.count;
-        other.memory = nullptr;
-        other.count = 0;
-    }
+        for (auto a : axes_to_freeze)
+            if (a >= array.rank())
+                throw std::logic_error("cannot freeze axis greater than or equal to array rank");
 
-    buffer_t(std::size_t count, ValueType value=ValueType())
-    : count(count)
-    , memory(new ValueType[count])
-    {
-        for (std::size_t n = 0; n < count; ++n)
+        if constexpr (detail::is_uniform_array<PatchArrayType>::value)
         {
-            memory[n] = value;
+            return make_array(array.get_provider().reshape(array.shape().remove_elements(axes_to_freeze)));
         }
-    }
-
-    template<class IteratorType>
-    buffer_t(IteratorType first, IteratorType last)
-    : count(std::distance(first, last)), memory(new ValueType[count])
-    {
-        for (std::size_t n = 0; n < count; ++n)
+        else if constexpr (detail::is_strided_viewable_array<PatchArrayType>::value)
         {
-            memory[n] = *first++;
+            return make_array(array.get_provider().strided().freeze_axes(axes_to_freeze, index_to_freeze_at));
         }
-    }
-
-    buffer_t& operator=(buffer_t&& other)
-    {
-        delete [] memory;
-        memory = other.memory;
-        count = other.count;
+        else
+        {
+            auto mapping = [axes_to_freeze=axes_to_freeze, index_to_freeze_at=index_to_freeze_at, array] (auto&& index)
+            {
+                return array(index.insert_elements(axes_to_freeze, index_to_freeze_at));
+            };
+            auto shape = array.shape().remove_elements(axes_to_freeze);
 
-        other.memory = nullptr;
-        other.count = 0;
-        return *this;
+            return make_array(mapping, shape);
+        }
     }
 
-    bool empty() const { return count == 0; }
-    std::size_t size() const { return count; }
-
-    const ValueType* data() const { return memory; }
-    const ValueType* begin() const { return memory; }
-    const ValueType* end() const { return memory + count; }
-    const ValueType& operator[](std::size_t offset) const { return memory[offset]; }
-    const ValueType& at(std::size_t offset) const
+    auto at_index(index_t<RankDifference> new_index_to_freeze_at) const
     {
-        if (offset >= count)
-        {
-            throw std::out_of_range("buffer_t index out of range");
-        }
-        return memory[offset];
+        return axis_freezer_t(axes_to_freeze, new_index_to_freeze_at);
     }
 
-    ValueType* data() { return memory; }
-    ValueType* begin() { return memory; }
-    ValueType* end() { return memory + count; }
-    ValueType& operator[](std::size_t offset) { return memory[offset]; }
-    ValueType& at(std::size_t offset)
+    template<typename... Args>
+    auto at_index(Args... new_index_to_freeze_at) const
     {
-        if (offset >= count)
-        {
-            throw std::out_of_range("buffer_t index out of range");
-        }
-        return memory[offset];
+        static_assert(sizeof...(Args) == RankDifference);
+        return at_index(make_index(new_index_to_freeze_at...));
     }
 
 private:
     //=========================================================================
-    std::size_t count = 0;
-    ValueType* memory = nullptr;
+    index_t<RankDifference> axes_to_freeze;
+    index_t<RankDifference> index_to_freeze_at;
+};
+
+
+
+
+//=============================================================================
+/**
+ * @brief      An operator that applies a reduction along one axis of an array,
+ *             yielding an array of rank one less. In general the result is
+ *             lazy, and each of its elements reduces a lazy slice of the
+ *             source. For the built-in reductions (sum, min, max, all, any)
+ *             on memory-backed arrays, the reduction is instead done eagerly
+ *             by reduction_t::reduce_axis, which reads the source in storage
+ *             order rather than gathering strided slices.
+ *
+ * @tparam     OperatorType  The type of the reduction
+ */
+template<typename OperatorType>
+class nd::axis_reducer_t
+{
+public:
+
+    //=========================================================================
+    axis_reducer_t(std::size_t axis_to_reduce, OperatorType the_operator)
+    : axis_to_reduce(axis_to_reduce)
+    , the_operator(the_operator) {}
+
+    template<typename ArrayType>
+    auto operator()(ArrayType array) const
+    {
+        if (axis_to_reduce >= array.rank())
+        {
+            throw std::logic_error("cannot reduce axis greater than or equal to array rank");
+        }
+        constexpr std::size_t R = ArrayType::array_rank;
+
+        if constexpr (R > 1 && detail::is_reduction<OperatorType>::value && detail::is_uniform_array<ArrayType>::value)
+        {
+            auto value = the_operator(make_array(array.get_provider().reshape(make_shape(array.shape(axis_to_reduce)))));
+            auto shape = array.shape().remove_elements(make_index(axis_to_reduce));
+            return make_array(uniform_provider_t<decltype(value), R - 1>(value, shape));
+        }
+        else if constexpr (R > 1 && detail::is_reduction<OperatorType>::value && detail::is_strided_viewable_array<ArrayType>::value)
+        {
+            return the_operator.reduce_axis(array, axis_to_reduce);
+        }
+        else
+        {
+            return reduce_lazily(array);
+        }
+    }
+
+    auto along_axis(std::size_t new_axis_to_reduce) const
+    {
+        return axis_reducer_t(new_axis_to_reduce, the_operator);
+    }
+
+private:
+    //=========================================================================
+    template<typename ArrayType>
+    auto reduce_lazily(ArrayType array) const
+    {
+        constexpr std::size_t R = ArrayType::array_rank;
+
+        auto mapping = [the_operator=the_operator, axis_to_reduce=axis_to_reduce, array] (auto&& index)
+        {
+            auto axes_to_freeze = index_t<R>::range().remove_elements(make_index(axis_to_reduce));
+            auto freezer = axis_freezer_t<R - 1>(axes_to_freeze).at_index(index);
+            return the_operator(freezer(array));
+        };
+        auto shape = array.shape().remove_elements(make_index(axis_to_reduce));
+
+        return make_array(mapping, shape);
+    }
+
+    std::size_t axis_to_reduce;
+    OperatorType the_operator;
+};
+
+
+
+
+//=============================================================================
+template<typename ArrayType>
+class nd::concatenator_t
+{
+public:
+
+    //=========================================================================
+    concatenator_t(std::size_t axis_to_extend, ArrayType array_to_concat)
+    : axis_to_extend(axis_to_extend)
+    , array_to_concat(array_to_concat) {}
+
+    template<typename SourceArrayType>
+    auto operator()(SourceArrayType array) const
+    {
+        if (axis_to_extend >= array.rank())
+        {
+            throw std::logic_error("cannot concatenate on axis greater than or equal to array rank");
+        }
+        if (array_to_concat.shape().remove_elements(make_index(axis_to_extend))
+            !=        array.shape().remove_elements(make_index(axis_to_extend)))
+        {
+            throw std::logic_error("the shape of the concatenated arrays can only differ on the concatenating axis");
+        }
+
+        auto mapping = [axis_to_extend=axis_to_extend, array_to_concat=array_to_concat, array] (auto index)
+        {
+            if (index[axis_to_extend] >= array.shape(axis_to_extend))
+            {
+                index[axis_to_extend] -= array.shape(axis_to_extend);
+                return array_to_concat(index);
+            }
+            return array(index);
+        };
+
+        auto shape = array.shape();
+        shape[axis_to_extend] += array_to_concat.shape(axis_to_extend);
+
+        return make_array(mapping, shape);
+    }
+
+    auto on_axis(std::size_t new_axis_to_concat) const
+    {
+        return concatenator_t(new_axis_to_concat, array_to_concat);
+    }
+
+private:
+    //=========================================================================
+    std::size_t axis_to_extend;
+    ArrayType array_to_concat;
+};
+
+
+
+
+//=============================================================================
+template<std::size_t Rank, typename ArrayType>
+class nd::replacer_t
+{
+public:
+
+    //=========================================================================
+    replacer_t(access_pattern_t<Rank> region=access_pattern_t<Rank>()) : region(region) {}
+    replacer_t(access_pattern_t<Rank> region, ArrayType replacement_array)
+    : region(region)
+    , replacement_array(replacement_array) {}
+
+    template<typename PatchArrayType>
+    auto operator()(PatchArrayType&& array_to_patch) const
+    {
+        if (region.shape() != replacement_array.shape())
+        {
+            throw std::logic_error("region to replace has a different shape than the replacement array");
+        }
+
+        auto mapping = [region=region, replacement_array=replacement_array, array_to_patch] (auto&& index)
+        {
+            if (region.generates(index))
+            {
+                return replacement_array(region.inverse_map_index(index));
+            }
+            return array_to_patch(index);
+        };
+        return make_array(mapping, array_to_patch.shape());
+    }
+
+    template<typename... Args> auto from   (Args... args) const { return from   (make_index(args...)); }
+    template<typename... Args> auto to     (Args... args) const { return to     (make_index(args...)); }
+    template<typename... Args> auto jumping(Args... args) const { return jumping(make_jumps(args...)); }
+    auto from   (index_t<Rank> arg) const { return replacer_t(region.with_start(arg), replacement_array); }
+    auto to     (index_t<Rank> arg) const { return replacer_t(region.with_final(arg), replacement_array); }
+    auto jumping(jumps_t<Rank> arg) const { return replacer_t(region.with_jumps(arg), replacement_array); }
+
+    template<typename OtherArrayType>
+    auto with(OtherArrayType&& new_replacement_array) const
+    {
+        return replacer_t<Rank, OtherArrayType>(region, std::forward<OtherArrayType>(new_replacement_array));
+    }
+
+private:
+    //=========================================================================
+    access_pattern_t<Rank> region;
+    ArrayType replacement_array;
+};
+
+
+
+
+//=============================================================================
+template<std::size_t Rank>
+class nd::selector_t
+{
+public:
+
+    //=========================================================================
+    selector_t(access_pattern_t<Rank> region=access_pattern_t<Rank>()) : region(region) {}
+
+    template<typename ArrayType>
+    auto operator()(ArrayType&& array) const
+    {
+        if (! region.within(array.shape()))
+        {
+            throw std::logic_error("out-of-bounds selection");
+        }
+        if constexpr (detail::is_uniform_array<ArrayType>::value)
+        {
+            return make_array(array.get_provider().reshape(region.shape()));
+        }
+        else if constexpr (detail::is_strided_viewable_array<ArrayType>::value)
+        {
+            return make_array(array.get_provider().strided().select(region));
+        }
+        else
+        {
+            using provider_type = typename std::decay_t<ArrayType>::provider_type;
+            return make_array(strided_provider_t<provider_type>(array.get_provider(), region));
+        }
+    }
+
+    template<typename... Args> auto from   (Args... args) const { return from   (make_index(args...)); }
+    template<typename... Args> auto to     (Args... args) const { return to     (make_index(args...)); }
+    template<typename... Args> auto jumping(Args... args) const { return jumping(make_jumps(args...)); }
+    auto from   (index_t<Rank> arg) const { return selector_t(region.with_start(arg)); }
+    auto to     (index_t<Rank> arg) const { return selector_t(region.with_final(arg)); }
+    auto jumping(jumps_t<Rank> arg) const { return selector_t(region.with_jumps(arg)); }
+
+private:
+    //=========================================================================
+    access_pattern_t<Rank> region;
 };
 
 
 
 
-//=============================================================================
-// Provider factories
-//=============================================================================
+
+/**
+ * @brief      A reduction operator (sum, min, max, all, any), which runs
+ *             serially by default, or in parallel if configured with
+ *             in_parallel or on. In parallel, each worker reduces the tiles it
+ *             executes into its own partial result, and the partials are
+ *             combined pairwise as a tree. The all and any reductions stop
+ *             early on every thread once the result is known.
+ *
+ * @tparam     Accumulator  A template accumulator type, taking the array value
+ *                          type
+ */
+template<template<typename> class Accumulator>
+class nd::reduction_t
+{
+public:
+
+    //=========================================================================
+    reduction_t(thread_pool_t* pool=nullptr, std::size_t num_threads=0, bool is_deterministic=false)
+    : pool(pool)
+    , num_threads(num_threads)
+    , is_deterministic(is_deterministic) {}
+
+    template<typename ArrayType>
+    auto operator()(ArrayType&& array) const
+    {
+        if constexpr (detail::is_uniform_array<ArrayType>::value)
+        {
+            auto accumulator = Accumulator<value_type_of<ArrayType>>();
+            accumulator.add_repeated(array.get_provider().value(), array.size());
+            return accumulator.result();
+        }
+        else
+        {
+            detail::advise_leaves(array.get_provider(), access_advice_t::sequential);
+
+            if constexpr (provider_traits<typename std::decay_t<ArrayType>::provider_type>::is_flat_readable)
+            {
+                if (detail::is_flat(array.get_provider()))
+                {
+                    return reduce_flat(array.get_provider());
+                }
+            }
+            return reduce_indexes(array);
+        }
+    }
+
+
+
+
+    /**
+     * @brief      Return a copy of this reduction which runs on the default
+     *             thread pool.
+     *
+     * @param[in]  new_num_threads  The number of threads; zero means use the
+     *                              whole default pool
+     *
+     * @return     The reduction operator
+     */
+    auto in_parallel(std::size_t new_num_threads=0) const
+    {
+        return reduction_t(&default_thread_pool(), new_num_threads, is_deterministic);
+    }
+
+    auto on(thread_pool_t& new_pool) const
+    {
+        return reduction_t(&new_pool, 0, is_deterministic);
+    }
+
+
+
+
+    /**
+     * @brief      Return a copy of this reduction whose result does not depend
+     *             on the number of threads or on scheduling: the index space is
+     *             cut into fixed tiles, each reduced to a partial result, and
+     *             the partials are combined as a tree in a fixed order. This
+     *             gives bitwise reproducible floating point sums.
+     *
+     * @return     The reduction operator
+     */
+    auto deterministic() const
+    {
+        return reduction_t(pool, num_threads, true);
+    }
+
+
+
+
+    /**
+     * @brief      Reduce a memory-backed array along one axis, returning a
+     *             shared array of the results. The source is visited in
+     *             storage order (its axes are traversed from the largest stride
+     *             to the smallest), and each element is folded into an output
+     *             accumulator, so the memory traffic is a single streaming pass
+     *             whichever axis is reduced. In parallel, the work is cut into
+     *             slabs along an axis which is not reduced, so workers never
+     *             share an output element. The values folded into each output
+     *             are always visited in the same order, so the result does not
+     *             depend on the number of threads.
+     *
+     * @param[in]  array  The array to reduce; it must have a strided view
+     * @param[in]  axis   The axis to reduce
+     *
+     * @tparam     ArrayType  The type of the array
+     *
+     * @return     A shared array, with the reduced axis removed
+     */
+    template<typename ArrayType>
+    auto reduce_axis(const ArrayType& array, std::size_t axis) const
+    {
+        constexpr std::size_t R = ArrayType::array_rank;
+        using accumulator_type = Accumulator<value_type_of<ArrayType>>;
+        using result_type = decltype(accumulator_type().result());
+
+        auto source = array.get_provider().strided();
+        auto target_shape = source.shape().remove_elements(make_index(axis));
+        auto target_strides = make_strides_row_major(target_shape);
+        auto accumulators = std::vector<accumulator_type>(target_shape.volume());
+
+        auto axis_order = index_t<R>::range();
+        std::stable_sort(axis_order.begin(), axis_order.end(), [&] (std::size_t a, std::size_t b)
+        {
+            return std::labs(source.strides()[a]) > std::labs(source.strides()[b]);
+        });
+
+        auto view = source.permute(axis_order);
+        auto target_jumps = jumps_t<R>();
+        auto split_axis = R;
+
+        for (std::size_t n = 0; n < R; ++n)
+        {
+            auto a = axis_order[n];
+
+            if (a == axis)
+            {
+                target_jumps[n] = 0;
+            }
+            else
+            {
+                target_jumps[n] = target_strides[a < axis ? a : a - 1];
+
+                if (split_axis == R && view.shape()[n] > 1)
+                {
+                    split_axis = n;
+                }
+            }
+        }
+
+        if (pool && split_axis != R)
+        {
+            auto scheduler = tile_scheduler_t(*pool, num_threads);
+            auto extent = view.shape()[split_axis];
+            auto num_slabs = std::min(extent, 4 * scheduler.num_workers());
+
+            scheduler.run(num_slabs, [&] (std::size_t n)
+            {
+                auto region = make_access_pattern(view.shape());
+                region.start[split_axis] = extent * n / num_slabs;
+                region.final[split_axis] = extent * (n + 1) / num_slabs;
+                detail::reduce_region_along(view, region, accumulators.data(), target_jumps);
+            });
+        }
+        else
+        {
+            detail::reduce_region_along(view, make_access_pattern(view.shape()), accumulators.data(), target_jumps);
+        }
+
+        auto target = make_uninitialized_unique_provider<result_type>(target_shape);
+
+        for (std::size_t n = 0; n < accumulators.size(); ++n)
+        {
+            target.data()[n] = accumulators[n].result();
+        }
+        return make_array(std::move(target).shared());
+    }
+
+private:
+    //=========================================================================
+    template<typename ArrayType>
+    auto reduce_indexes(const ArrayType& array) const
+    {
+        using accumulator_type = Accumulator<value_type_of<ArrayType>>;
+        auto stop = std::atomic<bool>(false);
+
+        if (is_deterministic)
+        {
+            auto tiles = partition_tiles(array.shape(), make_tile_shape<value_type_of<ArrayType>>(array.shape()));
+            auto partials = std::vector<accumulator_type>(tiles.size());
+            auto reduce_tile = [&] (std::size_t n) { detail::reduce_region(array, tiles[n], partials[n], stop); };
+
+            if (pool)
+            {
+                auto scheduler = tile_scheduler_t(*pool, num_threads);
+                scheduler.run(tiles.size(), reduce_tile);
+            }
+            else
+            {
+                for (std::size_t n = 0; n < tiles.size(); ++n)
+                {
+                    reduce_tile(n);
+                }
+            }
+            return detail::combine_tree(partials).result();
+        }
+        if (pool)
+        {
+            auto scheduler = tile_scheduler_t(*pool, num_threads);
+            auto tiles = partition_tiles(array.shape(), make_tile_shape<value_type_of<ArrayType>>(array.shape(), 4 * scheduler.num_workers()));
+            auto partials = std::vector<accumulator_type>(scheduler.num_workers());
+
+            scheduler.run(tiles.size(), [&] (std::size_t n, std::size_t worker)
+            {
+                detail::reduce_region(array, tiles[n], partials[worker], stop);
+            });
+            return detail::combine_tree(partials).result();
+        }
+        auto accumulator = accumulator_type();
+        detail::reduce_region(array, array.indexes(), accumulator, stop);
+        return accumulator.result();
+    }
+
+    template<typename Provider>
+    auto reduce_flat(const Provider& provider) const
+    {
+        using accumulator_type = Accumulator<typename Provider::value_type>;
+        auto stop = std::atomic<bool>(false);
+        auto size = provider.size();
+
+        if (is_deterministic)
+        {
+            auto chunk = make_tile_shape<typename Provider::value_type>(make_shape(size)).volume();
+            auto num_chunks = (size + chunk - 1) / chunk;
+            auto partials = std::vector<accumulator_type>(num_chunks);
+            auto reduce_chunk = [&] (std::size_t n)
+            {
+                detail::reduce_flat(provider, n * chunk, std::min(chunk, size - n * chunk), partials[n], stop);
+            };
+
+            if (pool)
+            {
+                auto scheduler = tile_scheduler_t(*pool, num_threads);
+                scheduler.run(num_chunks, reduce_chunk);
+            }
+            else
+            {
+                for (std::size_t n = 0; n < num_chunks; ++n)
+                {
+                    reduce_chunk(n);
+                }
+            }
+            return detail::combine_tree(partials).result();
+        }
+        if (pool)
+        {
+            auto scheduler = tile_scheduler_t(*pool, num_threads);
+            auto num_chunks = std::min(4 * scheduler.num_workers(), size);
+            auto partials = std::vector<accumulator_type>(scheduler.num_workers());
+
+            scheduler.run(num_chunks, [&] (std::size_t n, std::size_t worker)
+            {
+                auto i0 = (n + 0) * size / num_chunks;
+                auto i1 = (n + 1) * size / num_chunks;
+                detail::reduce_flat(provider, i0, i1 - i0, partials[worker], stop);
+            });
+            return detail::combine_tree(partials).result();
+        }
+        auto accumulator = accumulator_type();
+        detail::reduce_flat(provider, 0, size, accumulator, stop);
+        return accumulator.result();
+    }
+
+    thread_pool_t* pool;
+    std::size_t num_threads;
+    bool is_deterministic;
+};
+
+
+
+
+//=============================================================================
+template<typename Function, std::size_t Rank>
+class nd::basic_provider_t
+{
+public:
+
+    using value_type = std::invoke_result_t<Function, index_t<Rank>>;
+    static constexpr std::size_t provider_rank = Rank;
+
+    //=========================================================================
+    basic_provider_t(Function mapping, shape_t<Rank> the_shape) : mapping(mapping), the_shape(the_shape) {}
+    decltype(auto) operator()(const index_t<Rank>& index) const { return mapping(index); }
+    auto shape() const { return the_shape; }
+    auto size() const { return the_shape.volume(); }
+
+private:
+    //=========================================================================
+    Function mapping;
+    shape_t<Rank> the_shape;
+};
+
+
+
+
+//=============================================================================
+/**
+ * @brief      A provider whose elements all have the same value, requiring
+ *             storage for only that one value. Arrays of zeros and ones, and
+ *             scalars promoted to arrays, are represented this way. Since the
+ *             contents do not depend on the index, a uniform array can be
+ *             reshaped to any shape, and selecting, shifting, freezing, or
+ *             permuting its axes gives another uniform array in O(1). The
+ *             built-in reductions of a uniform array are also O(1), and
+ *             elementwise operations on uniform arrays are computed once, when
+ *             the expression is built.
+ *
+ * @tparam     ValueType  The value type
+ * @tparam     Rank       The rank
+ */
+template<typename ValueType, std::size_t Rank>
+class nd::uniform_provider_t
+{
+public:
+
+    using value_type = ValueType;
+    static constexpr std::size_t provider_rank = Rank;
+
+    //=========================================================================
+    uniform_provider_t(ValueType the_value, shape_t<Rank> the_shape) : the_value(the_value), the_shape(the_shape) {}
+    ValueType operator()(const index_t<Rank>&) const { return the_value; }
+    ValueType at_offset(std::size_t) const { return the_value; }
+    const ValueType& value() const { return the_value; }
+    auto shape() const { return the_shape; }
+    auto size() const { return the_shape.volume(); }
+    template<std::size_t R> auto reshape(shape_t<R> new_shape) const { return uniform_provider_t<ValueType, R>(the_value, new_shape); }
+
+private:
+    //=========================================================================
+    ValueType the_value;
+    shape_t<Rank> the_shape;
+};
+
+
+
+
+/**
+ * @brief      Return a reference to the instruction set which the pack kernels
+ *             of elementwise expressions use. It is detected from the CPU on
+ *             the first call: AVX-512, AVX2, or otherwise SSE2 on x86-64, and
+ *             scalar loops elsewhere. It may be lowered, for example to
+ *             compare the kernels, but must not be raised above what the CPU
+ *             supports.
+ *
+ * @return     A reference to the level
+ */
+nd::simd_level_t& nd::simd_level()
+{
+#if defined(__GNUC__) && defined(__x86_64__)
+    static simd_level_t level =
+    __builtin_cpu_supports("avx512f") ? simd_level_t::avx512 :
+    __builtin_cpu_supports("avx2") ? simd_level_t::avx2 : simd_level_t::sse2;
+#else
+    static simd_level_t level = simd_level_t::scalar;
+#endif
+    return level;
+}
+
+
+
+
+//=============================================================================
+/**
+ * @brief      A provider which applies a function to the elements of one or
+ *             more providers; this is what map and binary_op produce. The
+ *             operand shapes are broadcast against each other as in NumPy:
+ *             they are aligned on their last axes, and an axis which is
+ *             missing or has size 1 is repeated along the result (as if it
+ *             had stride 0), without copying anything. When every leaf of the
+ *             expression is memory-backed or uniform and no broadcasting is
+ *             needed, the elements can also be addressed by flat offset.
+ *             Evaluators then compute the whole fused expression in one loop
+ *             over a contiguous range, with no index arithmetic. Trees of the
+ *             built-in arithmetic operators (+ - * /) over float, double,
+ *             int32 or int64 leaves, optionally topped by a comparison, are
+ *             evaluated in packs with explicit vector kernels, chosen at run
+ *             time by simd_level (see detail::is_packable).
+ *
+ * @tparam     Function   The type of the function object
+ * @tparam     Providers  The types of the operand providers
+ */
+template<typename Function, typename... Providers>
+class nd::elementwise_provider_t
+{
+public:
+
+    static constexpr std::size_t provider_rank = std::max({Providers::provider_rank...});
+    using value_type = std::decay_t<std::invoke_result_t<const Function&, decltype(std::declval<const Providers&>()(std::declval<index_t<Providers::provider_rank>>()))...>>;
+
+    //=========================================================================
+    elementwise_provider_t(Function function, Providers... providers)
+    : function(function)
+    , providers(providers...)
+    , the_shape(detail::broadcast_shapes<provider_rank>(providers.shape()...))
+    , is_broadcast((! is_result_shape(providers.shape()) || ...)) {}
+
+    value_type operator()(const index_t<provider_rank>& index) const
+    {
+        if constexpr (((Providers::provider_rank == provider_rank) && ...))
+        {
+            if (! is_broadcast)
+            {
+                return std::apply([this, &index] (const auto&... provider) { return function(provider(index)...); }, providers);
+            }
+        }
+        return std::apply([this, &index] (const auto&... provider)
+        {
+            return function(provider(detail::broadcast_index(index, provider.shape()))...);
+        }, providers);
+    }
+
+    auto shape() const { return the_shape; }
+    auto size() const { return the_shape.volume(); }
+
+
+
+
+    /**
+     * @brief      Return true if this expression can be read by flat offset:
+     *             no operand here, or in any nested expression, is broadcast.
+     *
+     * @return     A boolean
+     */
+    bool is_flat() const
+    {
+        return ! is_broadcast && std::apply([] (const auto&... provider) { return (detail::is_flat(provider) && ...); }, providers);
+    }
+
+
+
+
+    /**
+     * @brief      Return the element at the given flat (row-major) offset. This
+     *             is only available if every leaf of the expression can be
+     *             addressed by flat offset (see detail::is_flat_readable), and
+     *             is only valid if is_flat() returns true.
+     *
+     * @param[in]  offset  The offset
+     *
+     * @return     The value
+     */
+    value_type at_offset(std::size_t offset) const
+    {
+        return std::apply([offset, this] (const auto&... provider) { return function(provider.at_offset(offset)...); }, providers);
+    }
+
+    const Function& get_function() const { return function; }
+    const std::tuple<Providers...>& operands() const { return providers; }
+
+private:
+    //=========================================================================
+    template<std::size_t R>
+    bool is_result_shape(const shape_t<R>& shape) const
+    {
+        if constexpr (R == provider_rank)
+        {
+            return shape == the_shape;
+        }
+        return false;
+    }
+
+    Function function;
+    std::tuple<Providers...> providers;
+    shape_t<provider_rank> the_shape;
+    bool is_broadcast;
+};
+
+
+
+
+/**
+ * @brief      A provider which views another provider through an access
+ *             pattern; this is what selecting a region of a lazy array
+ *             produces. Memory-backed arrays are viewed with a
+ *             strided_shared_provider_t instead.
+ *
+ * @tparam     Provider  The type of the viewed provider
+ */
+template<typename Provider>
+class nd::strided_provider_t
+{
+public:
+
+    using value_type = typename Provider::value_type;
+    static constexpr std::size_t provider_rank = Provider::provider_rank;
+
+    //=========================================================================
+    strided_provider_t(Provider provider, access_pattern_t<provider_rank> region) : provider(provider), region(region) {}
+    decltype(auto) operator()(const index_t<provider_rank>& index) const { return provider(region.map_index(index)); }
+    auto shape() const { return region.shape(); }
+    auto size() const { return region.size(); }
+    const Provider& source() const { return provider; }
+    const access_pattern_t<provider_rank>& source_region() const { return region; }
+
+private:
+    //=========================================================================
+    Provider provider;
+    access_pattern_t<provider_rank> region;
+};
+
+
+
+
+/**
+ * @brief      Compile-time facts about a provider type, which evaluators use to
+ *             pick a strategy: contiguous providers are copied as flat ranges,
+ *             strided ones with blocked copies, and flat-readable expressions
+ *             (elementwise operations whose leaves are all contiguous or
+ *             uniform) with a single loop over flat offsets.
+ *
+ * @tparam     Provider  The provider type
+ */
+template<typename Provider>
+struct nd::provider_traits
+{
+    static constexpr bool is_contiguous    = detail::is_contiguous_provider<Provider>::value;
+    static constexpr bool is_strided       = detail::is_strided_viewable<Provider>::value;
+    static constexpr bool is_uniform       = detail::is_uniform_provider<Provider>::value;
+    static constexpr bool is_elementwise   = detail::is_elementwise_provider<Provider>::value;
+    static constexpr bool is_flat_readable = detail::is_flat_readable<Provider>::value;
+};
+
+
+
+
+//=============================================================================
+template<typename ValueType, std::size_t Rank>
+class nd::shared_provider_t
+{
+public:
+
+    using value_type = ValueType;
+    static constexpr std::size_t provider_rank = Rank;
+
+    //=========================================================================
+    shared_provider_t() {}
+    shared_provider_t(nd::shape_t<Rank> the_shape, std::shared_ptr<nd::buffer_t<ValueType>> buffer)
+    : the_shape(the_shape)
+    , strides(make_strides_row_major(the_shape))
+    , buffer(buffer)
+    {
+        if (the_shape.volume() != buffer->size())
+        {
+            throw std::logic_error("shape and buffer sizes do not match");
+        }
+    }
+
+    const ValueType& operator()(const index_t<Rank>& index) const
+    {
+        return buffer->operator[](strides.compute_offset(index));
+    }
+
+    auto shape() const { return the_shape; }
+    auto size() const { return the_shape.volume(); }
+    const ValueType* data() const { return buffer->data(); }
+    const ValueType& at_offset(std::size_t offset) const { return buffer->data()[offset]; }
+    template<std::size_t R> auto reshape(shape_t<R> new_shape) const { return shared_provider_t<ValueType, R>(new_shape, buffer); }
+
+    auto strided() const
+    {
+        auto memory = std::shared_ptr<const ValueType>(buffer, buffer->data());
+        auto jumps = jumps_t<Rank>();
+
+        for (std::size_t n = 0; n < Rank; ++n)
+        {
+            jumps[n] = strides[n];
+        }
+        return strided_shared_provider_t<ValueType, Rank>(the_shape, jumps, memory);
+    }
+
+private:
+    //=========================================================================
+    shape_t<Rank> the_shape;
+    memory_strides_t<Rank> strides;
+    std::shared_ptr<buffer_t<ValueType>> buffer;
+};
+
+
+
+
+/**
+ * @brief      An immutable, memory-backed provider that views a shared block of
+ *             memory through an offset and per-axis strides (in elements, and
+ *             possibly negative or zero). Selecting, shifting, or freezing axes
+ *             of a memory-backed array yields one of these, so those operations
+ *             are zero-copy and the result still has a data pointer. Views of a
+ *             memory-mapped file remember the mapping, so that access advice
+ *             can be given for the pages they span.
+ */
+template<typename ValueType, std::size_t Rank>
+class nd::strided_shared_provider_t
+{
+public:
+
+    using value_type = ValueType;
+    static constexpr std::size_t provider_rank = Rank;
+
+    //=========================================================================
+    strided_shared_provider_t() {}
+    strided_shared_provider_t(
+        shape_t<Rank> the_shape,
+        jumps_t<Rank> the_strides,
+        std::shared_ptr<const ValueType> memory,
+        std::ptrdiff_t start=0,
+        const mapped_file_t* mapping=nullptr)
+    : the_shape(the_shape)
+    , the_strides(the_strides)
+    , memory(memory)
+    , start(start)
+    , mapping(mapping) {}
+
+    const ValueType& operator()(const index_t<Rank>& index) const
+    {
+        return memory.get()[start + offset(index)];
+    }
+
+    auto shape() const { return the_shape; }
+    auto size() const { return the_shape.volume(); }
+    auto strides() const { return the_strides; }
+    const ValueType* data() const { return memory.get() + start; }
+
+
+
+
+    /**
+     * @brief      Return the offset, in elements, of the given index from the
+     *             data pointer.
+     *
+     * @param[in]  index  The index
+     *
+     * @return     The offset
+     */
+    std::ptrdiff_t offset(const index_t<Rank>& index) const
+    {
+        auto result = std::ptrdiff_t(0);
+
+        for (std::size_t n = 0; n < Rank; ++n)
+        {
+            result += std::ptrdiff_t(index[n]) * the_strides[n];
+        }
+        return result;
+    }
+
+
+
+
+    /**
+     * @brief      Return true if this view addresses its elements in row-major
+     *             order with no gaps, so it can be read as a flat range starting
+     *             at data().
+     *
+     * @return     A boolean
+     */
+    bool is_contiguous() const
+    {
+        auto expected = long(1);
+
+        for (int n = Rank - 1; n >= 0; --n)
+        {
+            if (the_shape[n] != 1 && the_strides[n] != expected)
+            {
+                return false;
+            }
+            expected *= the_shape[n];
+        }
+        return true;
+    }
+
+    template<std::size_t R>
+    auto reshape(shape_t<R> new_shape) const
+    {
+        if (! is_contiguous())
+        {
+            throw std::logic_error("cannot reshape a non-contiguous strided view");
+        }
+        if (new_shape.volume() != size())
+        {
+            throw std::logic_error("shape and buffer sizes do not match");
+        }
+        auto new_strides = jumps_t<R>();
+        auto row_major = make_strides_row_major(new_shape);
+
+        for (std::size_t n = 0; n < R; ++n)
+        {
+            new_strides[n] = row_major[n];
+        }
+        return strided_shared_provider_t<ValueType, R>(new_shape, new_strides, memory, start, mapping);
+    }
+
+    auto strided() const
+    {
+        return *this;
+    }
+
+
+
+
+    /**
+     * @brief      Return a view of the region of this one generated by an access
+     *             pattern.
+     *
+     * @param[in]  region  The region to select
+     *
+     * @return     A strided provider with the shape of the region
+     */
+    auto select(const access_pattern_t<Rank>& region) const
+    {
+        auto new_strides = jumps_t<Rank>();
+
+        for (std::size_t n = 0; n < Rank; ++n)
+        {
+            new_strides[n] = the_strides[n] * region.jumps[n];
+        }
+        return strided_shared_provider_t(region.shape(), new_strides, memory, start + offset(region.start), mapping);
+    }
+
+
+
+
+    /**
+     * @brief      Return a view of this one shifted along an axis, with the
+     *             semantics of axis_shifter_t: B(i) == A(i - delta), where the
+     *             shifted axis is shortened by |delta|.
+     *
+     * @param[in]  axis   The axis to shift
+     * @param[in]  delta  The amount to shift by
+     *
+     * @return     A strided provider
+     */
+    auto shift(std::size_t axis, int delta) const
+    {
+        auto new_shape = the_shape;
+        new_shape[axis] -= std::abs(delta);
+        return strided_shared_provider_t(new_shape, the_strides, memory, start - delta * the_strides[axis], mapping);
+    }
+
+
+
+
+    /**
+     * @brief      Return a lower-rank view of this one, with the given axes held
+     *             at fixed positions.
+     *
+     * @param[in]  axes   The axes to freeze
+     * @param[in]  at     The index on those axes to freeze at
+     *
+     * @tparam     RankDifference  The number of axes to freeze
+     *
+     * @return     A strided provider of rank Rank - RankDifference
+     */
+    template<std::size_t RankDifference>
+    auto freeze_axes(const index_t<RankDifference>& axes, const index_t<RankDifference>& at) const
+    {
+        constexpr std::size_t R = Rank - RankDifference;
+        auto new_start = start;
+
+        for (std::size_t n = 0; n < RankDifference; ++n)
+        {
+            new_start += std::ptrdiff_t(at[n]) * the_strides[axes[n]];
+        }
+        auto new_shape = the_shape.remove_elements(axes);
+        auto new_strides = detail::remove_elements<jumps_t<R>>(the_strides, axes);
+
+        return strided_shared_provider_t<ValueType, R>(new_shape, new_strides, memory, new_start, mapping);
+    }
+
+
+
+
+    /**
+     * @brief      Return a view of this one with its axes reordered, so that
+     *             axis n of the result is axis axis_order[n] of this one.
+     *
+     * @param[in]  axis_order  A permutation of [0, Rank)
+     *
+     * @return     A strided provider
+     */
+    auto permute(const index_t<Rank>& axis_order) const
+    {
+        auto new_shape = shape_t<Rank>();
+        auto new_strides = jumps_t<Rank>();
+
+        for (std::size_t n = 0; n < Rank; ++n)
+        {
+            new_shape[n] = the_shape[axis_order[n]];
+            new_strides[n] = the_strides[axis_order[n]];
+        }
+        return strided_shared_provider_t(new_shape, new_strides, memory, start, mapping);
+    }
+
+
+
+
+    /**
+     * @brief      If this is a view of a memory-mapped file, tell the kernel how
+     *             the elements of a region of it are about to be accessed. Only
+     *             the pages between the first and last elements of the region
+     *             are advised.
+     *
+     * @param[in]  region  The region about to be accessed
+     * @param[in]  advice  The access advice
+     */
+    void advise(const access_pattern_t<Rank>& region, access_advice_t advice) const
+    {
+        if (mapping == nullptr || region.empty())
+        {
+            return;
+        }
+        auto lower = start + offset(region.start);
+        auto upper = lower;
+        auto region_shape = region.shape();
+
+        for (std::size_t n = 0; n < Rank; ++n)
+        {
+            auto extent = std::ptrdiff_t(region_shape[n] - 1) * region.jumps[n] * the_strides[n];
+
+            if (extent < 0)
+            {
+                lower += extent;
+            }
+            else
+            {
+                upper += extent;
+            }
+        }
+        detail::advise_mapping(*mapping, memory.get() + lower, (upper - lower + 1) * sizeof(ValueType), advice);
+    }
+
+    void advise(access_advice_t advice) const
+    {
+        advise(make_access_pattern(the_shape), advice);
+    }
+
+private:
+    //=========================================================================
+    shape_t<Rank> the_shape;
+    jumps_t<Rank> the_strides;
+    std::shared_ptr<const ValueType> memory;
+    std::ptrdiff_t start = 0;
+    const mapped_file_t* mapping = nullptr;
+};
+
+
+
+
+//=============================================================================
+/**
+ * @brief      Owns the mapping of a whole file into memory, which is unmapped
+ *             when the last reference is dropped. A read-only mapping shares
+ *             its pages with the kernel's page cache; a copy-on-write mapping
+ *             may be written to, but the writes never reach the file.
+ */
+class nd::mapped_file_t
+{
+public:
+
+    //=========================================================================
+    mapped_file_t(const std::string& filename, map_mode_t the_mode=map_mode_t::read_only) : the_mode(the_mode)
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        auto fd = ::open(filename.data(), O_RDONLY);
+
+        if (fd == -1)
+        {
+            throw std::runtime_error("cannot open file " + filename);
+        }
+        struct stat info;
+
+        if (::fstat(fd, &info) == -1)
+        {
+            ::close(fd);
+            throw std::runtime_error("cannot stat file " + filename);
+        }
+        bytes = std::size_t(info.st_size);
+
+        if (bytes > 0)
+        {
+            auto prot = the_mode == map_mode_t::read_only ? PROT_READ : PROT_READ | PROT_WRITE;
+            auto flags = the_mode == map_mode_t::read_only ? MAP_SHARED : MAP_PRIVATE;
+            memory = ::mmap(nullptr, bytes, prot, flags, fd, 0);
+        }
+        ::close(fd);
+
+        if (memory == MAP_FAILED)
+        {
+            memory = nullptr;
+            throw std::runtime_error("cannot map file " + filename);
+        }
+#else
+        throw std::runtime_error("memory-mapped files are not supported on this platform");
+#endif
+    }
+
+    ~mapped_file_t()
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        if (memory)
+        {
+            ::munmap(memory, bytes);
+        }
+#endif
+    }
+
+    mapped_file_t(const mapped_file_t&) = delete;
+    mapped_file_t& operator=(const mapped_file_t&) = delete;
+
+    char* data() const { return static_cast<char*>(memory); }
+    std::size_t size() const { return bytes; }
+    map_mode_t mode() const { return the_mode; }
+
+
+
+
+    /**
+     * @brief      Pass access advice to the kernel for a range of bytes within
+     *             the mapping. The range is widened to page boundaries.
+     *
+     * @param[in]  begin   The first byte of the range
+     * @param[in]  count   The number of bytes in the range
+     * @param[in]  advice  The access advice
+     */
+    void advise(const void* begin, std::size_t count, access_advice_t advice) const
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        if (count == 0)
+        {
+            return;
+        }
+        auto page = std::uintptr_t(::sysconf(_SC_PAGESIZE));
+        auto first = reinterpret_cast<std::uintptr_t>(begin) / page * page;
+        auto final = reinterpret_cast<std::uintptr_t>(begin) + count;
+
+        switch (advice)
+        {
+            case access_advice_t::normal:     ::madvise(reinterpret_cast<void*>(first), final - first, MADV_NORMAL); break;
+            case access_advice_t::sequential: ::madvise(reinterpret_cast<void*>(first), final - first, MADV_SEQUENTIAL); break;
+            case access_advice_t::random:     ::madvise(reinterpret_cast<void*>(first), final - first, MADV_RANDOM); break;
+            case access_advice_t::will_need:  ::madvise(reinterpret_cast<void*>(first), final - first, MADV_WILLNEED); break;
+        }
+#endif
+    }
+
+private:
+    //=========================================================================
+    void* memory = nullptr;
+    std::size_t bytes = 0;
+    map_mode_t the_mode;
+};
+
+
+
+
+/**
+ * @brief      Owns the mapping of a POSIX shared-memory segment, which other
+ *             processes on the same machine can map by name. The segment's
+ *             pages are not touched when it's created, so each page is placed
+ *             on the NUMA node of the process which first writes it. The
+ *             process which created the segment removes its name when the last
+ *             reference to it is dropped; processes which have it mapped keep
+ *             their mappings.
+ */
+class nd::shm_segment_t
+{
+public:
+
+    //=========================================================================
+    /**
+     * @brief      Create a new segment of a given size, which is zero-filled.
+     *             The name must start with a slash, and not already exist.
+     */
+    shm_segment_t(const std::string& the_name, std::size_t bytes) : the_name(the_name), bytes(bytes)
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        check_name();
+        auto fd = ::shm_open(the_name.data(), O_CREAT | O_EXCL | O_RDWR, 0600);
+
+        if (fd == -1)
+        {
+            throw std::runtime_error("cannot create shared memory segment " + the_name);
+        }
+        owner = long(::getpid());
+
+        if (::ftruncate(fd, off_t(bytes)) == -1)
+        {
+            ::close(fd);
+            ::shm_unlink(the_name.data());
+            throw std::runtime_error("cannot resize shared memory segment " + the_name);
+        }
+        map(fd);
+#else
+        throw std::runtime_error("shared memory segments are not supported on this platform");
+#endif
+    }
+
+    /**
+     * @brief      Map an existing segment, created by this or another process.
+     */
+    shm_segment_t(const std::string& the_name) : the_name(the_name)
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        check_name();
+        auto fd = ::shm_open(the_name.data(), O_RDWR, 0600);
+
+        if (fd == -1)
+        {
+            throw std::runtime_error("cannot open shared memory segment " + the_name);
+        }
+        struct stat info;
+
+        if (::fstat(fd, &info) == -1)
+        {
+            ::close(fd);
+            throw std::runtime_error("cannot stat shared memory segment " + the_name);
+        }
+        bytes = std::size_t(info.st_size);
+        map(fd);
+#else
+        throw std::runtime_error("shared memory segments are not supported on this platform");
+#endif
+    }
+
+    ~shm_segment_t()
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        if (memory)
+        {
+            ::munmap(memory, bytes);
+        }
+        if (owner == long(::getpid()))
+        {
+            ::shm_unlink(the_name.data());
+        }
+#endif
+    }
+
+    shm_segment_t(const shm_segment_t&) = delete;
+    shm_segment_t& operator=(const shm_segment_t&) = delete;
+
+    char* data() const { return static_cast<char*>(memory); }
+    std::size_t size() const { return bytes; }
+    const std::string& name() const { return the_name; }
+
+private:
+    //=========================================================================
+    void check_name() const
+    {
+        if (the_name.size() < 2 || the_name[0] != '/' || the_name.find('/', 1) != std::string::npos)
+        {
+            throw std::logic_error("shared memory segment name " + the_name + " must be a slash followed by a file name");
+        }
+    }
+
+    void map(int fd)
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        if (bytes > 0)
+        {
+            memory = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+
+        if (memory == MAP_FAILED)
+        {
+            memory = nullptr;
+
+            if (owner == long(::getpid()))
+            {
+                ::shm_unlink(the_name.data());
+            }
+            throw std::runtime_error("cannot map shared memory segment " + the_name);
+        }
+#endif
+    }
+
+    std::string the_name;
+    void* memory = nullptr;
+    std::size_t bytes = 0;
+    long owner = -1;
+};
+
+
+
+
+/**
+ * @brief      An immutable provider whose elements are read, in row-major
+ *             order, from a memory-mapped file, starting some number of bytes
+ *             into it (to skip a header). Pages are loaded by the kernel as
+ *             they are touched, so the file may be larger than RAM. It behaves
+ *             like a shared provider: it has a data pointer, can be reshaped,
+ *             and selecting, shifting, freezing, or permuting its axes gives a
+ *             zero-copy strided view which keeps the mapping alive.
+ *
+ * @note       Evaluating an expression with mapped leaves (to_shared,
+ *             reductions, stream_to) first advises the kernel that the pages
+ *             spanned by the evaluated region will be read sequentially, and
+ *             read_indexes advises random access. Strided views of a mapped
+ *             provider are advised the same way.
+ */
+template<typename ValueType, std::size_t Rank>
+class nd::mmap_provider_t
+{
+public:
+
+    using value_type = ValueType;
+    static constexpr std::size_t provider_rank = Rank;
+
+    //=========================================================================
+    mmap_provider_t() {}
+    mmap_provider_t(shape_t<Rank> the_shape, std::shared_ptr<mapped_file_t> file, std::size_t offset=0)
+    : the_shape(the_shape)
+    , strides(make_strides_row_major(the_shape))
+    , file(file)
+    , offset(offset)
+    {
+        if (offset % alignof(ValueType) != 0)
+        {
+            throw std::logic_error("file offset is not aligned to the value type");
+        }
+        if (offset + the_shape.volume() * sizeof(ValueType) > file->size())
+        {
+            throw std::logic_error("file is too small for the requested shape");
+        }
+    }
+
+    const ValueType& operator()(const index_t<Rank>& index) const
+    {
+        return data()[strides.compute_offset(index)];
+    }
+
+    auto shape() const { return the_shape; }
+    auto size() const { return the_shape.volume(); }
+    const ValueType* data() const { return reinterpret_cast<const ValueType*>(file->data() + offset); }
+    const ValueType& at_offset(std::size_t n) const { return data()[n]; }
+    template<std::size_t R> auto reshape(shape_t<R> new_shape) const { return mmap_provider_t<ValueType, R>(new_shape, file, offset); }
+
+    auto strided() const
+    {
+        auto memory = std::shared_ptr<const ValueType>(file, data());
+        auto jumps = jumps_t<Rank>();
+
+        for (std::size_t n = 0; n < Rank; ++n)
+        {
+            jumps[n] = strides[n];
+        }
+        return strided_shared_provider_t<ValueType, Rank>(the_shape, jumps, memory, 0, file.get());
+    }
+
+
+
+
+    /**
+     * @brief      Return a writable pointer to the data of a copy-on-write
+     *             mapping. Writes are private to this process, and are seen by
+     *             every array sharing the mapping, but never reach the file.
+     *
+     * @return     The pointer
+     */
+    ValueType* writable_data() const
+    {
+        if (file->mode() != map_mode_t::copy_on_write)
+        {
+            throw std::logic_error("cannot write to a read-only file mapping");
+        }
+        return reinterpret_cast<ValueType*>(file->data() + offset);
+    }
+
+
+
+
+    /**
+     * @brief      Tell the kernel how the elements of a region of this provider
+     *             are about to be accessed, so it can tune read-ahead.
+     *
+     * @param[in]  region  The region about to be accessed
+     * @param[in]  advice  The access advice
+     */
+    void advise(const access_pattern_t<Rank>& region, access_advice_t advice) const
+    {
+        strided().advise(region, advice);
+    }
+
+    void advise(access_advice_t advice) const
+    {
+        file->advise(data(), size() * sizeof(ValueType), advice);
+    }
+
+private:
+    //=========================================================================
+    shape_t<Rank> the_shape;
+    memory_strides_t<Rank> strides;
+    std::shared_ptr<mapped_file_t> file;
+    std::size_t offset = 0;
+};
+
+
+
+
+/**
+ * @brief      A thread-safe store of tiles (buffers of values), keyed by tile
+ *             number, holding at most a fixed number of tiles and evicting the
+ *             least recently used one when it is full. A tile which is not in
+ *             the store is loaded by exactly one thread; other threads asking
+ *             for it meanwhile wait for that load to finish, rather than
+ *             repeating it.
+ *
+ * @tparam     ValueType  The value type of the tiles
+ */
+template<typename ValueType>
+class nd::tile_cache_t
+{
+public:
+
+    using tile_type = std::shared_ptr<const buffer_t<ValueType>>;
+
+    //=========================================================================
+    tile_cache_t(std::size_t capacity) : capacity(std::max(capacity, std::size_t(1)))
+    {
+        static std::atomic<std::size_t> num_caches = {0};
+        the_id = ++num_caches;
+    }
+
+    tile_cache_t(const tile_cache_t& other) = delete;
+    tile_cache_t& operator=(const tile_cache_t& other) = delete;
+
+
+
+
+    /**
+     * @brief      Return a tile, loading it if it's not in the store.
+     *
+     * @param[in]  n     The tile number
+     * @param      load  A function returning the tile's contents as a buffer_t
+     *
+     * @tparam     Loader  The type of the load function
+     *
+     * @return     A shared pointer to the tile, which stays valid after the
+     *             tile is evicted
+     */
+    template<typename Loader>
+    tile_type get(std::size_t n, Loader&& load)
+    {
+        auto promise = std::promise<tile_type>();
+        auto future = std::shared_future<tile_type>();
+        auto is_loader = false;
+        {
+            auto lock = std::lock_guard<std::mutex>(mutex);
+            auto entry = entries.find(n);
+
+            if (entry != entries.end())
+            {
+                order.splice(order.begin(), order, entry->second.second);
+                future = entry->second.first;
+            }
+            else
+            {
+                future = promise.get_future().share();
+                order.push_front(n);
+                entries.emplace(n, std::make_pair(future, order.begin()));
+                is_loader = true;
+
+                while (entries.size() > capacity)
+                {
+                    entries.erase(order.back());
+                    order.pop_back();
+                }
+            }
+        }
+        if (is_loader)
+        {
+            try {
+                promise.set_value(std::make_shared<const buffer_t<ValueType>>(load()));
+                ++loads;
+            }
+            catch (...)
+            {
+                {
+                    auto lock = std::lock_guard<std::mutex>(mutex);
+                    auto entry = entries.find(n);
+
+                    if (entry != entries.end())
+                    {
+                        order.erase(entry->second.second);
+                        entries.erase(entry);
+                    }
+                }
+                promise.set_exception(std::current_exception());
+            }
+        }
+        return future.get();
+    }
+
+    std::size_t id() const { return the_id; }
+    std::size_t num_loads() const { return loads.load(); }
+
+private:
+    //=========================================================================
+    std::size_t capacity;
+    std::size_t the_id;
+    std::mutex mutex;
+    std::list<std::size_t> order;
+    std::unordered_map<std::size_t, std::pair<std::shared_future<tile_type>, std::list<std::size_t>::iterator>> entries;
+    std::atomic<std::size_t> loads = {0};
+};
+
+
+
+
+/**
+ * @brief      A read-only provider over an array stored in the chunked file
+ *             format written by save_chunked. Chunks are read and decoded only
+ *             when an element in them is first accessed, and are then kept in
+ *             a tile_cache_t holding a fixed number of chunks, so
+ *             a selection of the array only reads the chunks it covers. Copies
+ *             of the provider share the file and the cache, which are safe to
+ *             use from several threads.
+ */
+template<typename ValueType, std::size_t Rank>
+class nd::chunked_provider_t
+{
+public:
+
+    using value_type = ValueType;
+    static constexpr std::size_t provider_rank = Rank;
+
+    //=========================================================================
+    chunked_provider_t(const std::string& filename, std::size_t cache_chunks=64) : state(std::make_shared<state_t>(cache_chunks))
+    {
+        auto file = std::fopen(filename.data(), "rb");
+
+        if (! file)
+        {
+            throw std::runtime_error("cannot open file " + filename);
+        }
+        state->file = file;
+
+        unsigned char preamble[12];
+
+        if (std::fread(preamble, 1, 12, file) != 12 || std::memcmp(preamble, "\x93NDCHUNK", 8) != 0)
+        {
+            throw std::runtime_error("file " + filename + " is not in chunked format");
+        }
+        auto dict = std::string(read_le(preamble + 8, 4), ' ');
+
+        if (std::fread(&dict[0], 1, dict.size(), file) != dict.size())
+        {
+            throw std::runtime_error("file " + filename + " is not in chunked format");
+        }
+        auto descr = detail::header_value(dict, "descr", filename);
+        auto shape = detail::parse_header_tuple(detail::header_value(dict, "shape", filename));
+        auto chunks = detail::parse_header_tuple(detail::header_value(dict, "chunks", filename));
+
+        if (descr.substr(1, descr.find(descr[0], 1) - 1) != detail::npy_descr<ValueType>())
+        {
+            throw std::logic_error("file " + filename + " has dtype " + descr + ", expected " + detail::npy_descr<ValueType>());
+        }
+        if (shape.size() != Rank || chunks.size() != Rank)
+        {
+            throw std::logic_error("file " + filename + " has " + std::to_string(shape.size()) + " axes, expected " + std::to_string(Rank));
+        }
+        the_shape = shape_t<Rank>::from_range(shape);
+        the_chunk_shape = shape_t<Rank>::from_range(chunks);
+        auto codec = detail::header_value(dict, "codec", filename);
+
+        if (codec.compare(0, 4, "'lz'") == 0)
+        {
+            state->codec = chunk_codec_t::lz;
+        }
+        else if (codec.compare(0, 6, "'none'") != 0)
+        {
+            throw std::runtime_error("file " + filename + " has an unknown codec " + codec.substr(0, codec.find(',')));
+        }
+        state->shuffle = detail::header_value(dict, "shuffle", filename).compare(0, 4, "True") == 0;
+        state->regions = partition_tiles(the_shape, the_chunk_shape);
+
+        auto index = std::vector<unsigned char>(16 * state->regions.size());
+
+        if (std::fread(index.data(), 1, index.size(), file) != index.size())
+        {
+            throw std::runtime_error("file " + filename + " is truncated");
+        }
+        for (std::size_t n = 0; n < state->regions.size(); ++n)
+        {
+            state->extents.push_back({read_le(&index[16 * n], 8), read_le(&index[16 * n + 8], 8)});
+        }
+        for (std::size_t n = 0; n < Rank; ++n)
+        {
+            chunk_counts[n] = (the_shape[n] + the_chunk_shape[n] - 1) / the_chunk_shape[n];
+        }
+        chunk_strides = make_strides_row_major(chunk_counts);
+    }
+
+    ValueType operator()(const index_t<Rank>& index) const
+    {
+        auto chunk_index = index_t<Rank>();
+        auto local_index = index_t<Rank>();
+
+        for (std::size_t n = 0; n < Rank; ++n)
+        {
+            chunk_index[n] = index[n] / the_chunk_shape[n];
+            local_index[n] = index[n] % the_chunk_shape[n];
+        }
+        auto n = chunk_strides.compute_offset(chunk_index);
+
+        // Consecutive accesses on a thread usually fall in the same chunk, so
+        // each thread remembers the last chunk it used, and only goes to the
+        // shared cache when it moves to another one. The chunk is remembered
+        // by a weak pointer, so it does not outlive its eviction from the
+        // cache.
+        static thread_local struct { std::size_t cache_id = 0; std::size_t n = 0; std::weak_ptr<const buffer_t<ValueType>> chunk; memory_strides_t<Rank> strides; } last;
+
+        auto current = last.cache_id == state->cache.id() && last.n == n ? last.chunk.lock() : nullptr;
+
+        if (! current)
+        {
+            current = chunk(n);
+            last.chunk = current;
+            last.cache_id = state->cache.id();
+            last.n = n;
+            last.strides = make_strides_row_major(state->regions[n].shape());
+        }
+        return current->data()[last.strides.compute_offset(local_index)];
+    }
+
+    auto shape() const { return the_shape; }
+    auto size() const { return the_shape.volume(); }
+    auto chunk_shape() const { return the_chunk_shape; }
+    auto num_chunks() const { return state->regions.size(); }
+    auto num_chunk_reads() const { return state->cache.num_loads(); }
+
+
+
+
+    /**
+     * @brief      Return the decoded contents of a chunk, reading it from the
+     *             file if it is not in the cache.
+     *
+     * @param[in]  n     The chunk number, in row-major order
+     *
+     * @return     A shared pointer to a buffer of the chunk's values, in
+     *             row-major order over the chunk's region
+     */
+    std::shared_ptr<const buffer_t<ValueType>> chunk(std::size_t n) const
+    {
+        return state->cache.get(n, [this, n] ()
+        {
+            auto [offset, num_stored] = state->extents[n];
+            auto stored = std::vector<unsigned char>(num_stored);
+            auto decoded = buffer_t<ValueType>::uninitialized(state->regions[n].size());
+            {
+                auto lock = std::lock_guard<std::mutex>(state->file_mutex);
+
+                if (std::fseek(state->file, long(offset), SEEK_SET) != 0 || std::fread(stored.data(), 1, num_stored, state->file) != num_stored)
+                {
+                    throw std::runtime_error("failed to read chunk " + std::to_string(n));
+                }
+            }
+            auto target = reinterpret_cast<unsigned char*>(decoded.data());
+            detail::decode_chunk(stored, target, decoded.size() * sizeof(ValueType), sizeof(ValueType), state->codec, state->shuffle);
+            return decoded;
+        });
+    }
+
+private:
+    //=========================================================================
+    struct state_t
+    {
+        state_t(std::size_t cache_chunks) : cache(cache_chunks) {}
+        ~state_t() { if (file) std::fclose(file); }
+        std::FILE* file = nullptr;
+        chunk_codec_t codec = chunk_codec_t::none;
+        bool shuffle = false;
+        std::vector<access_pattern_t<Rank>> regions;
+        std::vector<std::pair<std::size_t, std::size_t>> extents;
+        std::mutex file_mutex;
+        tile_cache_t<ValueType> cache;
+    };
+
+    static std::size_t read_le(const unsigned char* bytes, std::size_t count)
+    {
+        auto result = std::size_t(0);
+
+        for (std::size_t n = count; n > 0; --n)
+        {
+            result = (result << 8) | bytes[n - 1];
+        }
+        return result;
+    }
+
+    std::shared_ptr<state_t> state;
+    shape_t<Rank> the_shape;
+    shape_t<Rank> the_chunk_shape;
+    shape_t<Rank> chunk_counts;
+    memory_strides_t<Rank> chunk_strides;
+};
+
+
+
+
+/**
+ * @brief      A provider which memoizes another one, tile by tile: the first
+ *             access to an element evaluates the whole tile containing it into
+ *             a tile_cache_t, and later accesses read the stored tile. Copies
+ *             of the provider share the store, so a sub-expression referenced
+ *             several times in an expression is only computed once, and it is
+ *             safe to read from parallel evaluators. The store holds a bounded
+ *             number of tiles, so the whole intermediate array need not fit in
+ *             memory; evicted tiles are recomputed if they are touched again.
+ *
+ * @tparam     Provider  The type of the provider being memoized
+ */
+template<typename Provider>
+class nd::cached_provider_t
+{
+public:
+
+    using value_type = typename Provider::value_type;
+    static constexpr std::size_t provider_rank = Provider::provider_rank;
+
+    //=========================================================================
+    cached_provider_t(Provider provider, shape_t<provider_rank> tile_shape, std::size_t budget_bytes)
+    : provider(provider)
+    , the_tile_shape(tile_shape)
+    , cache(std::make_shared<tile_cache_t<value_type>>(budget_bytes / (tile_shape.volume() * sizeof(value_type))))
+    {
+        for (std::size_t n = 0; n < provider_rank; ++n)
+        {
+            tile_counts[n] = (provider.shape()[n] + tile_shape[n] - 1) / tile_shape[n];
+        }
+        tile_strides = make_strides_row_major(tile_counts);
+    }
+
+    value_type operator()(const index_t<provider_rank>& index) const
+    {
+        auto tile_index = index_t<provider_rank>();
+        auto local_index = index_t<provider_rank>();
+
+        for (std::size_t n = 0; n < provider_rank; ++n)
+        {
+            tile_index[n] = index[n] / the_tile_shape[n];
+            local_index[n] = index[n] % the_tile_shape[n];
+        }
+        auto n = tile_strides.compute_offset(tile_index);
+
+        // As in chunked_provider_t, each thread remembers (by a weak pointer,
+        // so the budget holds) the last tile it used, and only goes to the
+        // shared store when it moves to another.
+        static thread_local struct { std::size_t cache_id = 0; std::size_t n = 0; std::weak_ptr<const buffer_t<value_type>> tile; memory_strides_t<provider_rank> strides; } last;
+
+        auto current = last.cache_id == cache->id() && last.n == n ? last.tile.lock() : nullptr;
+
+        if (! current)
+        {
+            auto region = tile_region(tile_index);
+
+            current = cache->get(n, [this, region] ()
+            {
+                auto tile = buffer_t<value_type>::uninitialized(region.size());
+                detail::evaluate_block(provider, region, tile.data());
+                return tile;
+            });
+            last.tile = current;
+            last.cache_id = cache->id();
+            last.n = n;
+            last.strides = make_strides_row_major(region.shape());
+        }
+        return current->data()[last.strides.compute_offset(local_index)];
+    }
+
+    auto shape() const { return provider.shape(); }
+    auto size() const { return provider.size(); }
+    auto tile_shape() const { return the_tile_shape; }
+    auto num_tile_evaluations() const { return cache->num_loads(); }
+
+private:
+    //=========================================================================
+    access_pattern_t<provider_rank> tile_region(const index_t<provider_rank>& tile_index) const
+    {
+        auto region = make_access_pattern(provider.shape());
+
+        for (std::size_t n = 0; n < provider_rank; ++n)
+        {
+            region.start[n] = tile_index[n] * the_tile_shape[n];
+            region.final[n] = std::min(region.start[n] + the_tile_shape[n], region.final[n]);
+        }
+        return region;
+    }
+
+    Provider provider;
+    shape_t<provider_rank> the_tile_shape;
+    shape_t<provider_rank> tile_counts;
+    memory_strides_t<provider_rank> tile_strides;
+    std::shared_ptr<tile_cache_t<value_type>> cache;
+};
+
+
+
+
+/**
+ * @brief      A provider which applies a stencil to a memory-backed array: each
+ *             element is a kernel of the source values within a given radius of
+ *             it. Elements within the radius of the edges are handled according
+ *             to a boundary mode: periodic wraps around the array, clamp repeats
+ *             the edge values, reflect mirrors the array at its edges, and
+ *             ghost treats the outer layers of the source as ghost zones, so
+ *             that the result is smaller than the source by the radius on each
+ *             side.
+ *
+ *             Elements away from the edges read their neighbors at fixed
+ *             pointer offsets. Evaluating a region goes a row at a time; for
+ *             a kernel given by weights, each weight is applied across the
+ *             whole row in a loop the compiler can vectorize. The region is
+ *             evaluated in blocks which stream along the first axis, and are
+ *             narrow enough on the middle axes that the planes a stencil
+ *             reads stay in cache between one step and the next.
+ *
+ * @tparam     ValueType  The value type of the source array
+ * @tparam     Rank       The rank of the source array
+ * @tparam     Kernel     A function object taking a reader, where reader(di,
+ *                        dj, ...) is the source value at that offset
+ */
+template<typename ValueType, std::size_t Rank, typename Kernel>
+class nd::stencil_provider_t
+{
+public:
+
+    using value_type = std::decay_t<std::invoke_result_t<const Kernel&, const detail::stencil_reader_t<ValueType, Rank>&>>;
+    static constexpr std::size_t provider_rank = Rank;
+
+    //=========================================================================
+    stencil_provider_t(strided_shared_provider_t<ValueType, Rank> source, Kernel kernel, index_t<Rank> radius, boundary_t boundary)
+    : the_source(source)
+    , the_kernel(kernel)
+    , the_radius(radius)
+    , the_boundary(boundary)
+    , the_shape(the_source.shape())
+    {
+        if (boundary == boundary_t::ghost)
+        {
+            for (std::size_t n = 0; n < Rank; ++n)
+            {
+                if (the_shape[n] < 2 * radius[n])
+                {
+                    throw std::logic_error("array is too small for the ghost zones of the stencil");
+                }
+                the_shape[n] -= 2 * radius[n];
+            }
+        }
+        if constexpr (detail::is_stencil_weights<Kernel>::value)
+        {
+            for (const auto& delta : the_kernel.deltas)
+            {
+                auto offset = std::ptrdiff_t(0);
+
+                for (std::size_t n = 0; n < Rank; ++n)
+                {
+                    offset += delta[n] * the_source.strides()[n];
+                }
+                offsets.push_back(offset);
+            }
+        }
+    }
+
+    value_type operator()(const index_t<Rank>& index) const
+    {
+        if (is_interior(index))
+        {
+            return the_kernel(detail::stencil_reader_t<ValueType, Rank>{center(index), the_source.strides()});
+        }
+        return the_kernel(detail::boundary_reader_t<ValueType, Rank>{&the_source, index, the_boundary});
+    }
+
+    auto shape() const { return the_shape; }
+    auto size() const { return the_shape.volume(); }
+    auto radius() const { return the_radius; }
+    auto boundary() const { return the_boundary; }
+    const auto& source() const { return the_source; }
+    const auto& kernel() const { return the_kernel; }
+
+
+
+
+    /**
+     * @brief      Evaluate a run of elements along the last axis.
+     *
+     * @param[in]  index  The index of the first element
+     * @param[in]  count  The number of elements
+     * @param      row    The memory to write them to
+     */
+    void evaluate_row(index_t<Rank> index, std::size_t count, value_type* row) const
+    {
+        constexpr std::size_t L = Rank - 1;
+        auto first = index[L];
+        auto i0 = std::size_t(0);
+        auto i1 = count;
+
+        if (the_boundary != boundary_t::ghost)
+        {
+            auto lo = the_radius[L];
+            auto hi = the_shape[L] > the_radius[L] ? the_shape[L] - the_radius[L] : 0;
+            i0 = std::min(count, lo > first ? lo - first : 0);
+            i1 = std::max(i0, std::min(count, hi > first ? hi - first : 0));
+        }
+
+        if (i1 > i0)
+        {
+            index[L] = first + i0;
+
+            if (the_boundary == boundary_t::ghost || is_interior_row(index))
+            {
+                evaluate_interior(center(index), i1 - i0, row + i0);
+            }
+            else
+            {
+                evaluate_edge_row(index, i1 - i0, row + i0);
+            }
+        }
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            if (i == i0)
+            {
+                i = i1;
+
+                if (i == count)
+                {
+                    break;
+                }
+            }
+            index[L] = first + i;
+            evaluate_edge_row(index, 1, row + i);
+        }
+    }
+
+
+
+
+    /**
+     * @brief      Divide a region into blocks to be evaluated one after another.
+     *             The blocks span the region on the first and last axes, and
+     *             are narrowed on the middle axes until the source planes a
+     *             block reads fit in about 256 kB.
+     *
+     * @param[in]  region  The region
+     *
+     * @return     A vector of access patterns
+     */
+    std::vector<access_pattern_t<Rank>> cache_blocks(const access_pattern_t<Rank>& region) const
+    {
+        auto extent = region.shape();
+        auto block = extent;
+        auto budget = (std::size_t(1) << 18) / ((2 * the_radius[0] + 1) * sizeof(ValueType));
+        auto cross_section = extent[Rank - 1];
+
+        for (int n = int(Rank) - 2; n >= 1; --n)
+        {
+            block[n] = std::max(std::min(budget / std::max(cross_section, std::size_t(1)), extent[n]), std::size_t(1));
+            cross_section *= block[n];
+        }
+        auto blocks = partition_tiles(extent, block);
+
+        for (auto& b : blocks)
+        {
+            for (std::size_t n = 0; n < Rank; ++n)
+            {
+                b.start[n] += region.start[n];
+                b.final[n] += region.start[n];
+            }
+        }
+        return blocks;
+    }
+
+private:
+    //=========================================================================
+    template<typename PointFunction>
+    void accumulate_weights(PointFunction point, std::size_t count, value_type* row) const
+    {
+        auto jump = the_source.strides()[Rank - 1];
+        std::fill(row, row + count, value_type());
+
+        for (std::size_t k = 0; k < offsets.size(); ++k)
+        {
+            auto w = the_kernel.weights[k];
+            auto p = point(k);
+
+            if (jump == 1)
+            {
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    row[i] += w * p[i];
+                }
+            }
+            else
+            {
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    row[i] += w * p[std::ptrdiff_t(i) * jump];
+                }
+            }
+        }
+    }
+
+    void evaluate_interior(const ValueType* center, std::size_t count, value_type* row) const
+    {
+        if constexpr (detail::is_stencil_weights<Kernel>::value)
+        {
+            accumulate_weights([this, center] (std::size_t k) { return center + offsets[k]; }, count, row);
+        }
+        else
+        {
+            auto jump = the_source.strides()[Rank - 1];
+
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                row[i] = the_kernel(detail::stencil_reader_t<ValueType, Rank>{center + std::ptrdiff_t(i) * jump, the_source.strides()});
+            }
+        }
+    }
+
+    void evaluate_edge_row(index_t<Rank> index, std::size_t count, value_type* row) const
+    {
+        // A run of elements near the edges, which is either one element, or
+        // else is away from the edges on the last axis. A weighted kernel can
+        // run across it from neighboring runs, wrapped or clamped once each.
+        constexpr std::size_t L = Rank - 1;
+
+        if constexpr (detail::is_stencil_weights<Kernel>::value)
+        {
+            accumulate_weights([this, index] (std::size_t k)
+            {
+                auto neighbor = index;
+
+                for (std::size_t n = 0; n < Rank; ++n)
+                {
+                    neighbor[n] = detail::boundary_index(long(index[n]) + the_kernel.deltas[k][n], the_source.shape()[n], the_boundary);
+                }
+                return the_source.data() + the_source.offset(neighbor);
+            }, count, row);
+        }
+        else
+        {
+            auto first = index[L];
+
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                index[L] = first + i;
+                row[i] = the_kernel(detail::boundary_reader_t<ValueType, Rank>{&the_source, index, the_boundary});
+            }
+        }
+    }
+
+    const ValueType* center(const index_t<Rank>& index) const
+    {
+        auto source_index = index;
+
+        if (the_boundary == boundary_t::ghost)
+        {
+            for (std::size_t n = 0; n < Rank; ++n)
+            {
+                source_index[n] += the_radius[n];
+            }
+        }
+        return the_source.data() + the_source.offset(source_index);
+    }
+
+    bool is_interior_row(const index_t<Rank>& index) const
+    {
+        for (std::size_t n = 0; n < Rank - 1; ++n)
+        {
+            if (index[n] < the_radius[n] || index[n] + the_radius[n] >= the_shape[n])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool is_interior(const index_t<Rank>& index) const
+    {
+        constexpr std::size_t L = Rank - 1;
+        return the_boundary == boundary_t::ghost || (is_interior_row(index) && index[L] >= the_radius[L] && index[L] + the_radius[L] < the_shape[L]);
+    }
+
+    strided_shared_provider_t<ValueType, Rank> the_source;
+    Kernel the_kernel;
+    index_t<Rank> the_radius;
+    boundary_t the_boundary;
+    shape_t<Rank> the_shape;
+    std::vector<std::ptrdiff_t> offsets;
+};
+
+
+
+
+/**
+ * @brief      A memory-backed provider for arrays padded with layers of ghost
+ *             zones (a halo) around an interior, as used by stencil solvers
+ *             over decomposed domains. Its shape is the padded one; the
+ *             interior is the region interior(), starting at the ghost width
+ *             on each axis. The ghost zones are filled in place, from the
+ *             interior or by a user function, and the interior is assigned in
+ *             place from another array, so a time step allocates nothing.
+ *
+ * @note       Copies of the provider share the memory, and views of it (such
+ *             as the interior view, or a stencil over it) see later writes. Do
+ *             not assign the interior from an expression which reads the same
+ *             padded array.
+ *
+ * @tparam     ValueType  The value type
+ * @tparam     Rank       The rank
+ */
+template<typename ValueType, std::size_t Rank>
+class nd::padded_provider_t
+{
+public:
+
+    using value_type = ValueType;
+    static constexpr std::size_t provider_rank = Rank;
+
+    //=========================================================================
+    padded_provider_t(shape_t<Rank> interior_shape, shape_t<Rank> ghost_width)
+    : padded_provider_t(interior_shape, ghost_width, nullptr)
+    {
+        auto buffer = std::make_shared<buffer_t<ValueType>>(the_shape.volume());
+        memory = std::shared_ptr<ValueType>(buffer, buffer->data());
+    }
+
+    /**
+     * @brief      Construct a padded provider over memory owned by someone else
+     *             (such as a shared-memory segment), which must hold the padded
+     *             shape's volume of values, in row-major order. The memory is
+     *             used as it is, not initialized.
+     */
+    padded_provider_t(shape_t<Rank> interior_shape, shape_t<Rank> ghost_width, std::shared_ptr<ValueType> memory)
+    : the_interior_shape(interior_shape)
+    , the_ghost_width(ghost_width)
+    , memory(memory)
+    {
+        for (std::size_t n = 0; n < Rank; ++n)
+        {
+            the_shape[n] = interior_shape[n] + 2 * ghost_width[n];
+        }
+        strides = make_strides_row_major(the_shape);
+    }
+
+    const ValueType& operator()(const index_t<Rank>& index) const
+    {
+        return memory.get()[strides.compute_offset(index)];
+    }
+
+    auto shape() const { return the_shape; }
+    auto size() const { return the_shape.volume(); }
+    auto interior_shape() const { return the_interior_shape; }
+    auto ghost_width() const { return the_ghost_width; }
+    const ValueType* data() const { return memory.get(); }
+    ValueType* writable_data() const { return memory.get(); }
+    const ValueType& at_offset(std::size_t offset) const { return memory.get()[offset]; }
+
+    auto strided() const
+    {
+        auto jumps = jumps_t<Rank>();
+
+        for (std::size_t n = 0; n < Rank; ++n)
+        {
+            jumps[n] = strides[n];
+        }
+        return strided_shared_provider_t<ValueType, Rank>(the_shape, jumps, std::shared_ptr<const ValueType>(memory));
+    }
+
+    auto interior() const
+    {
+        auto region = make_access_pattern(the_shape);
+
+        for (std::size_t n = 0; n < Rank; ++n)
+        {
+            region.start[n] = the_ghost_width[n];
+            region.final[n] = the_ghost_width[n] + the_interior_shape[n];
+        }
+        return region;
+    }
+
+    auto interior_view() const
+    {
+        return strided().select(interior());
+    }
+
+
+
+
+    /**
+     * @brief      Return the ghost zones as a list of disjoint regions, which
+     *             together with the interior cover the padded array. Region
+     *             2n + 0 and 2n + 1 are the low and high ghost zones on axis n;
+     *             they span the interior on the axes before n, and the whole
+     *             padded array on the axes after it.
+     *
+     * @return     A vector of access patterns (empty ones are included)
+     */
+    std::vector<access_pattern_t<Rank>> ghost_regions() const
+    {
+        auto regions = std::vector<access_pattern_t<Rank>>();
+        auto inner = interior();
+
+        for (std::size_t n = 0; n < Rank; ++n)
+        {
+            auto lower = make_access_pattern(the_shape);
+            auto upper = make_access_pattern(the_shape);
+
+            for (std::size_t m = 0; m < n; ++m)
+            {
+                lower.start[m] = upper.start[m] = inner.start[m];
+                lower.final[m] = upper.final[m] = inner.final[m];
+            }
+            lower.final[n] = inner.start[n];
+            upper.start[n] = inner.final[n];
+            regions.push_back(lower);
+            regions.push_back(upper);
+        }
+        return regions;
+    }
+
+
+
+
+    /**
+     * @brief      Fill the ghost zones in place from the interior, with the
+     *             interior repeated periodically, clamped, or reflected at its
+     *             edges. The interior is left as it was.
+     *
+     * @param[in]  boundary  The boundary mode (not boundary_t::ghost)
+     */
+    void fill_halo(boundary_t boundary) const
+    {
+        for (std::size_t n = 0; n < 2 * Rank; ++n)
+        {
+            fill_ghost_region(n, boundary);
+        }
+    }
+
+
+
+
+    /**
+     * @brief      Fill one of the ghost zones in place from the interior, as
+     *             fill_halo does. This is for subdomains whose other ghost
+     *             zones are filled from their neighbors.
+     *
+     * @param[in]  region    The ghost region, numbered as in ghost_regions()
+     * @param[in]  boundary  The boundary mode (not boundary_t::ghost)
+     */
+    void fill_ghost_region(std::size_t region, boundary_t boundary) const
+    {
+        if (boundary == boundary_t::ghost)
+        {
+            throw std::logic_error("ghost zones cannot be filled with the ghost boundary mode");
+        }
+        if (region >= 2 * Rank)
+        {
+            throw std::logic_error("ghost region " + std::to_string(region) + " does not exist");
+        }
+        for (std::size_t n = 0; n < Rank; ++n)
+        {
+            if (the_interior_shape[n] == 0 && the_ghost_width[n] > 0)
+            {
+                throw std::logic_error("cannot fill the ghost zones of an empty interior");
+            }
+        }
+        constexpr std::size_t L = Rank - 1;
+        auto target = writable_data();
+
+        for_each_row(ghost_regions()[region], [&] (const index_t<Rank>& index, std::size_t count)
+        {
+            auto source_index = index;
+
+            for (std::size_t n = 0; n < L; ++n)
+            {
+                source_index[n] = the_ghost_width[n] + detail::boundary_index(long(index[n]) - long(the_ghost_width[n]), the_interior_shape[n], boundary);
+            }
+            source_index[L] = 0;
+
+            auto row = target + strides.compute_offset(index);
+            auto source_row = target + strides.compute_offset(source_index);
+
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                auto j = long(index[L] + i) - long(the_ghost_width[L]);
+                row[i] = source_row[the_ghost_width[L] + detail::boundary_index(j, the_interior_shape[L], boundary)];
+            }
+        });
+    }
+
+
+
+
+    /**
+     * @brief      Fill the ghost zones in place by calling a function for each
+     *             of their elements, for example to copy in values from the
+     *             neighboring subdomains.
+     *
+     * @param[in]  fn        A function fn(index) -> value_type, where index is
+     *                       an index into the padded array
+     *
+     * @tparam     Function  The type of the function
+     */
+    template<typename Function>
+    void fill_halo(Function fn) const
+    {
+        auto target = writable_data();
+
+        for (const auto& region : ghost_regions())
+        {
+            for_each_index(region, [&] (const index_t<Rank>& index)
+            {
+                target[strides.compute_offset(index)] = fn(index);
+            });
+        }
+    }
+
+
+
+
+    /**
+     * @brief      Evaluate an array into the interior, in place. Stencils are
+     *             evaluated straight into the interior rows, block by block.
+     *
+     * @param[in]  array      The array, whose shape must be the interior shape
+     *
+     * @tparam     ArrayType  The type of the array
+     */
+    template<typename ArrayType>
+    void assign_interior(const ArrayType& array) const
+    {
+        check_interior_shape(array.shape());
+        assign_region(array.get_provider(), make_access_pattern(the_interior_shape));
+    }
+
+
+
+
+    /**
+     * @brief      Evaluate an array into the interior, in place, dividing the
+     *             work into slabs on the first axis, among the workers of a tile
+     *             scheduler.
+     *
+     * @param[in]  array      The array, whose shape must be the interior shape
+     * @param      scheduler  The scheduler to run on
+     *
+     * @tparam     ArrayType  The type of the array
+     */
+    template<typename ArrayType>
+    void assign_interior(const ArrayType& array, tile_scheduler_t& scheduler) const
+    {
+        check_interior_shape(array.shape());
+
+        if (the_interior_shape[0] == 0)
+        {
+            return;
+        }
+        auto slabs = partition_shape(the_interior_shape, std::min(4 * scheduler.num_workers(), the_interior_shape[0]));
+
+        scheduler.run(slabs.size(), [&] (std::size_t n)
+        {
+            assign_region(array.get_provider(), slabs[n]);
+        });
+    }
+
+private:
+    //=========================================================================
+    void check_interior_shape(const shape_t<Rank>& shape) const
+    {
+        if (shape != the_interior_shape)
+        {
+            throw std::logic_error("array of shape " + to_string(shape) + " cannot be assigned to an interior of shape " + to_string(the_interior_shape));
+        }
+    }
+
+    template<typename Provider>
+    void assign_region(const Provider& source, const access_pattern_t<Rank>& region) const
+    {
+        constexpr std::size_t L = Rank - 1;
+        auto target = writable_data();
+        auto row_at = [&] (index_t<Rank> index)
+        {
+            for (std::size_t n = 0; n < Rank; ++n)
+            {
+                index[n] += the_ghost_width[n];
+            }
+            return target + strides.compute_offset(index);
+        };
+
+        if constexpr (detail::is_stencil_provider<Provider>::value)
+        {
+            for (const auto& block : source.cache_blocks(region))
+            {
+                for_each_row(block, [&] (const index_t<Rank>& index, std::size_t count)
+                {
+                    source.evaluate_row(index, count, row_at(index));
+                });
+            }
+        }
+        else if constexpr (detail::is_strided_viewable<Provider>::value)
+        {
+            auto view = source.strided();
+            auto jump = view.strides()[L];
+
+            for_each_row(region, [&] (const index_t<Rank>& index, std::size_t count)
+            {
+                auto row = row_at(index);
+                auto source_row = view.data() + view.offset(index);
+
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    row[i] = source_row[std::ptrdiff_t(i) * jump];
+                }
+            });
+        }
+        else
+        {
+            for_each_row(region, [&] (index_t<Rank> index, std::size_t count)
+            {
+                auto row = row_at(index);
+                auto start = index[L];
+
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    index[L] = start + i;
+                    row[i] = source(index);
+                }
+            });
+        }
+    }
+
+    shape_t<Rank> the_shape;
+    shape_t<Rank> the_interior_shape;
+    shape_t<Rank> the_ghost_width;
+    memory_strides_t<Rank> strides;
+    std::shared_ptr<ValueType> memory;
+};
+
+
+
+
+/**
+ * @brief      A barrier for processes (or threads) which share the memory it
+ *             lives in. It is reusable: the last party to arrive starts a new
+ *             generation, and wakes the others. Waiting parties sleep on a
+ *             futex on Linux, and yield elsewhere.
+ */
+struct nd::detail::process_barrier_t
+{
+    static_assert(std::atomic<std::uint32_t>::is_always_lock_free, "process barriers need lock-free atomics");
+
+    void arrive_and_wait(std::uint32_t num_parties)
+    {
+        auto current = generation.load(std::memory_order_acquire);
+
+        if (count.fetch_add(1, std::memory_order_acq_rel) + 1 == num_parties)
+        {
+            count.store(0, std::memory_order_relaxed);
+            generation.fetch_add(1, std::memory_order_release);
+#if defined(__linux__)
+            ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&generation), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+        }
+        else
+        {
+            while (generation.load(std::memory_order_acquire) == current)
+            {
+#if defined(__linux__)
+                ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&generation), FUTEX_WAIT, current, nullptr, nullptr, 0);
+#else
+                std::this_thread::yield();
+#endif
+            }
+        }
+    }
+
+    std::atomic<std::uint32_t> count {0};
+    std::atomic<std::uint32_t> generation {0};
+};
+
+
+
+
+/**
+ * @brief      The layout of a shared-memory domain's control segment. The
+ *             magic number is written last by the creating process, so a
+ *             process attaching to the domain can tell it's ready.
+ */
+template<std::size_t Rank>
+struct nd::detail::shm_header_t
+{
+    static constexpr std::uint64_t expected_magic = 0x6e642d646f6d6169;
+
+    std::atomic<std::uint64_t> magic {0};
+    std::uint64_t value_size = 0;
+    std::uint64_t rank = 0;
+    std::uint64_t num_ranks = 0;
+    std::uint64_t global_shape[Rank] = {};
+    std::uint64_t ghost_width[Rank] = {};
+    process_barrier_t barrier;
+};
+
+
+
+
+/**
+ * @brief      A domain decomposed on its first axis (by partition_shape) among
+ *             a number of ranks, typically one process per NUMA socket, on a
+ *             single machine. Each rank's subdomain is a padded array living
+ *             in its own POSIX shared-memory segment, which every process maps.
+ *             Halos are exchanged by copying straight from the neighboring
+ *             segments, with a process-shared barrier before and after.
+ *
+ *             One process creates the domain by name (before forking, or
+ *             before launching the other processes), and the others attach
+ *             to it by name. Each process then claims its rank, which writes
+ *             its subdomain's pages for the first time, so they are placed on
+ *             that process's NUMA node.
+ *
+ * @note       exchange_halo and barrier are collective: every rank must call
+ *             them, in the same order. A rank which dies leaves the others
+ *             waiting.
+ *
+ * @example    auto domain = nd::shm_domain_t<double, 3>("/heat", nd::make_shape(512, 512, 512), 2, nd::make_shape(1, 1, 1));
+ *             // ... in the process for each rank:
+ *             auto u = domain.claim(rank);
+ *             u.get_provider().assign_interior(initial | nd::select(domain.partition(rank)));
+ *             domain.exchange_halo(rank, nd::boundary_t::periodic);
+ *
+ * @tparam     ValueType  The value type, which must be trivially copyable
+ * @tparam     Rank       The rank
+ */
+template<typename ValueType, std::size_t Rank>
+class nd::shm_domain_t
+{
+public:
+
+    static_assert(std::is_trivially_copyable<ValueType>::value, "shared-memory domains need a trivially copyable value type");
+    using value_type = ValueType;
+
+    //=========================================================================
+    /**
+     * @brief      Create a domain, with a control segment of the given name,
+     *             and one segment per rank, named by appending .0, .1, etc.
+     *             The segments are removed when this object and the arrays
+     *             made from it are gone.
+     *
+     * @param[in]  name          The segment name, starting with a slash
+     * @param[in]  global_shape  The shape of the whole domain
+     * @param[in]  num_ranks     The number of ranks
+     * @param[in]  ghost_width   The ghost width of each subdomain on each axis
+     */
+    shm_domain_t(const std::string& name, shape_t<Rank> global_shape, std::size_t num_ranks, shape_t<Rank> ghost_width)
+    {
+        if (num_ranks == 0)
+        {
+            throw std::logic_error("a shared-memory domain needs at least one rank");
+        }
+        if (global_shape[0] / num_ranks < std::max(ghost_width[0], std::size_t(1)))
+        {
+            throw std::logic_error("domain of shape " + to_string(global_shape) + " is too small for " + std::to_string(num_ranks) + " ranks with ghost width " + to_string(ghost_width));
+        }
+        control = std::make_shared<shm_segment_t>(name, sizeof(detail::shm_header_t<Rank>));
+        header = new (control->data()) detail::shm_header_t<Rank>();
+        header->value_size = sizeof(ValueType);
+        header->rank = Rank;
+        header->num_ranks = num_ranks;
+
+        for (std::size_t n = 0; n < Rank; ++n)
+        {
+            header->global_shape[n] = global_shape[n];
+            header->ghost_width[n] = ghost_width[n];
+        }
+        load_layout();
+
+        for (std::size_t r = 0; r < num_ranks; ++r)
+        {
+            segments.push_back(std::make_shared<shm_segment_t>(name + "." + std::to_string(r), padded_shape(r).volume() * sizeof(ValueType)));
+        }
+        header->magic.store(detail::shm_header_t<Rank>::expected_magic, std::memory_order_release);
+    }
+
+    /**
+     * @brief      Attach to a domain created by this or another process.
+     *
+     * @param[in]  name  The name the domain was created with
+     */
+    explicit shm_domain_t(const std::string& name)
+    {
+        control = std::make_shared<shm_segment_t>(name);
+
+        if (control->size() < sizeof(detail::shm_header_t<Rank>))
+        {
+            throw std::runtime_error("shared memory segment " + name + " is not a domain");
+        }
+        header = reinterpret_cast<detail::shm_header_t<Rank>*>(control->data());
+
+        if (header->magic.load(std::memory_order_acquire) != detail::shm_header_t<Rank>::expected_magic)
+        {
+            throw std::runtime_error("shared memory domain " + name + " is not initialized");
+        }
+        if (header->value_size != sizeof(ValueType) || header->rank != Rank)
+        {
+            throw std::logic_error("shared memory domain " + name + " has a different value type or rank");
+        }
+        load_layout();
+
+        for (std::size_t r = 0; r < num_ranks(); ++r)
+        {
+            segments.push_back(std::make_shared<shm_segment_t>(name + "." + std::to_string(r)));
+
+            if (segments.back()->size() != padded_shape(r).volume() * sizeof(ValueType))
+            {
+                throw std::runtime_error("shared memory segment " + segments.back()->name() + " has the wrong size");
+            }
+        }
+    }
+
+    auto shape() const { return the_shape; }
+    auto ghost_width() const { return the_ghost_width; }
+    auto num_ranks() const { return partitions.size(); }
+    auto partition(std::size_t rank) const { return partitions.at(rank); }
+
+
+
+
+    /**
+     * @brief      Return a rank's subdomain, as a padded array over its
+     *             segment. Its interior is the rank's partition of the domain.
+     *
+     * @param[in]  rank  The rank
+     *
+     * @return     A padded array, which keeps the segment mapped
+     */
+    auto subdomain(std::size_t rank) const
+    {
+        auto segment = segments.at(rank);
+        auto memory = std::shared_ptr<ValueType>(segment, reinterpret_cast<ValueType*>(segment->data()));
+        return make_array(padded_provider_t<ValueType, Rank>(partitions[rank].shape(), the_ghost_width, memory));
+    }
+
+
+
+
+    /**
+     * @brief      Claim a rank's subdomain for the calling process: write every
+     *             element (with a value-initialized one), so that its pages are
+     *             placed on the NUMA node this process runs on, and return it.
+     *             Call this once for each rank, before the first barrier or
+     *             halo exchange.
+     *
+     * @param[in]  rank  The rank
+     *
+     * @return     The rank's subdomain
+     */
+    auto claim(std::size_t rank) const
+    {
+        auto u = subdomain(rank);
+        std::fill_n(u.get_provider().writable_data(), u.size(), ValueType());
+        return u;
+    }
+
+
+
+
+    /**
+     * @brief      Wait until every rank has called this method.
+     */
+    void barrier() const
+    {
+        header->barrier.arrive_and_wait(std::uint32_t(num_ranks()));
+    }
+
+
+
+
+    /**
+     * @brief      Fill a rank's ghost zones. The ghost zones on the first axis
+     *             are copied from the neighboring ranks' interiors (including
+     *             their corners), and the others are filled locally. At the
+     *             edges of the domain, the ghost zones wrap around to the other
+     *             end (periodic), are filled locally (clamp or reflect), or are
+     *             left as they are (ghost). Every rank must call this, with the
+     *             same boundary mode, after writing its interior.
+     *
+     * @param[in]  rank      The calling rank
+     * @param[in]  boundary  The boundary mode at the edges of the domain
+     */
+    void exchange_halo(std::size_t rank, boundary_t boundary) const
+    {
+        auto u = subdomain(rank).get_provider();
+
+        if (boundary != boundary_t::ghost)
+        {
+            for (std::size_t region = 2; region < 2 * Rank; ++region)
+            {
+                u.fill_ghost_region(region, boundary);
+            }
+        }
+        barrier();
+
+        auto num = num_ranks();
+        auto g = the_ghost_width[0];
+        auto plane = u.size() / u.shape()[0];
+        auto target = u.writable_data();
+        auto neighbor = [&] (std::size_t r) { return reinterpret_cast<const ValueType*>(segments[r]->data()); };
+
+        if (rank > 0 || boundary == boundary_t::periodic)
+        {
+            auto lower = (rank + num - 1) % num;
+            auto source = neighbor(lower) + partitions[lower].shape()[0] * plane;
+            std::memcpy(target, source, g * plane * sizeof(ValueType));
+        }
+        else if (boundary != boundary_t::ghost)
+        {
+            u.fill_ghost_region(0, boundary);
+        }
+
+        if (rank + 1 < num || boundary == boundary_t::periodic)
+        {
+            auto upper = (rank + 1) % num;
+            auto source = neighbor(upper) + g * plane;
+            std::memcpy(target + (g + u.interior_shape()[0]) * plane, source, g * plane * sizeof(ValueType));
+        }
+        else if (boundary != boundary_t::ghost)
+        {
+            u.fill_ghost_region(1, boundary);
+        }
+        barrier();
+    }
+
+
+
+
+    /**
+     * @brief      Copy the interiors of all the subdomains into one array of the
+     *             domain's shape, for example to write it out.
+     *
+     * @return     A shared array
+     */
+    auto gather() const
+    {
+        auto result = make_unique_array<ValueType>(the_shape);
+        auto result_strides = make_strides_row_major(the_shape);
+
+        for (std::size_t r = 0; r < num_ranks(); ++r)
+        {
+            auto u = subdomain(r).get_provider();
+            auto u_strides = make_strides_row_major(u.shape());
+            auto inner = u.interior();
+
+            for_each_row(partitions[r], [&] (const index_t<Rank>& index, std::size_t count)
+            {
+                auto source_index = index;
+
+                for (std::size_t n = 0; n < Rank; ++n)
+                {
+                    source_index[n] += inner.start[n] - partitions[r].start[n];
+                }
+                std::memcpy(result.data() + result_strides.compute_offset(index), u.data() + u_strides.compute_offset(source_index), count * sizeof(ValueType));
+            });
+        }
+        return std::move(result).shared();
+    }
+
+private:
+    //=========================================================================
+    void load_layout()
+    {
+        for (std::size_t n = 0; n < Rank; ++n)
+        {
+            the_shape[n] = std::size_t(header->global_shape[n]);
+            the_ghost_width[n] = std::size_t(header->ghost_width[n]);
+        }
+        partitions = partition_shape(the_shape, std::size_t(header->num_ranks));
+    }
+
+    shape_t<Rank> padded_shape(std::size_t rank) const
+    {
+        auto shape = partitions[rank].shape();
+
+        for (std::size_t n = 0; n < Rank; ++n)
+        {
+            shape[n] += 2 * the_ghost_width[n];
+        }
+        return shape;
+    }
+
+    shape_t<Rank> the_shape;
+    shape_t<Rank> the_ghost_width;
+    std::vector<access_pattern_t<Rank>> partitions;
+    std::shared_ptr<shm_segment_t> control;
+    std::vector<std::shared_ptr<shm_segment_t>> segments;
+    detail::shm_header_t<Rank>* header = nullptr;
+};
+
+
+
+
+//=============================================================================
+template<typename ValueType, std::size_t Rank>
+class nd::unique_provider_t
+{
+public:
+
+    using value_type = ValueType;
+    static constexpr std::size_t provider_rank = Rank;
+
+    //=========================================================================
+    unique_provider_t(nd::shape_t<Rank> the_shape, nd::buffer_t<ValueType>&& buffer)
+    : the_shape(the_shape)
+    , strides(make_strides_row_major(the_shape))
+    , buffer(std::move(buffer))
+    {
+        if (the_shape.volume() != unique_provider_t::buffer.size())
+        {
+            throw std::logic_error("shape and buffer sizes do not match");
+        }
+    }
+
+    const ValueType& operator()(const index_t<Rank>& index) const { return buffer.operator[](strides.compute_offset(index)); }
+    /* */ ValueType& operator()(const index_t<Rank>& index)       { return buffer.operator[](strides.compute_offset(index)); }
+    template<typename... Args> const ValueType& operator()(Args... args) const { return operator()(make_index(args...)); }
+    template<typename... Args> /* */ ValueType& operator()(Args... args)       { return operator()(make_index(args...)); }
+
+    auto shape() const { return the_shape; }
+    auto size() const { return the_shape.volume(); }
+    const ValueType* data() const { return buffer.data(); }
+    ValueType* data() { return buffer.data(); }
+    const ValueType& at_offset(std::size_t offset) const { return buffer.data()[offset]; }
+
+    auto shared() const & { return shared_provider_t(the_shape, std::allocate_shared<buffer_t<ValueType>>(buffer.get_allocator(), buffer.begin(), buffer.end())); }
+    auto shared()      && { return shared_provider_t(the_shape, std::allocate_shared<buffer_t<ValueType>>(buffer.get_allocator(), std::move(buffer))); }
+
+    template<std::size_t R> auto reshape(shape_t<R> new_shape) const & { return unique_provider_t<ValueType, R>(new_shape, buffer_t<ValueType>(buffer.begin(), buffer.end())); }
+    template<std::size_t R> auto reshape(shape_t<R> new_shape)      && { return unique_provider_t<ValueType, R>(new_shape, std::move(buffer)); }
+
+private:
+    //=========================================================================
+    shape_t<Rank> the_shape;
+    memory_strides_t<Rank> strides;
+    buffer_t<ValueType> buffer;
+};
+
+
+
+
+/**
+ * @brief      Return a reference to the size, in bytes, above which buffers
+ *             are allocated on huge page boundaries, and the kernel is asked
+ *             to back them with transparent huge pages (on Linux). Changing
+ *             it only affects allocators constructed afterwards.
+ *
+ * @return     A reference to the threshold
+ */
+std::size_t& nd::huge_page_threshold()
+{
+    static std::size_t threshold = std::size_t(1) << 26;
+    return threshold;
+}
+
+
+
+
+/**
+ * @brief      Return a reference to the buffer pool which newly constructed
+ *             allocators on this thread draw from, or nullptr if they use the
+ *             heap directly. Set it with buffer_pool_t::use.
+ *
+ * @return     A reference to the pool pointer
+ */
+nd::buffer_pool_t*& nd::current_buffer_pool()
+{
+    static thread_local buffer_pool_t* pool = nullptr;
+    return pool;
+}
+
+
+
+
+//=============================================================================
+/**
+ * @brief      A pool of memory blocks, grouped by size class and alignment.
+ *             Size classes are powers of two of at least 64 bytes up to 2 MiB,
+ *             and multiples of 2 MiB above that, so a large block wastes less
+ *             than one huge page. Blocks returned to the pool are kept and
+ *             handed out again, so a loop which allocates arrays of the same
+ *             shapes on every iteration reaches a steady state with no heap
+ *             allocations. Blocks which would take the cached bytes past a
+ *             limit are returned to the heap instead. The pool must outlive
+ *             every buffer drawn from it. It is safe to use from several
+ *             threads.
+ */
+class nd::buffer_pool_t
+{
+public:
+
+    //=========================================================================
+    class scope_t
+    {
+    public:
+        scope_t(buffer_pool_t* pool) : previous(current_buffer_pool()) { current_buffer_pool() = pool; }
+        ~scope_t() { current_buffer_pool() = previous; }
+        scope_t(const scope_t& other) = delete;
+        scope_t& operator=(const scope_t& other) = delete;
+    private:
+        buffer_pool_t* previous;
+    };
+
+    //=========================================================================
+    static constexpr std::size_t large_class_size = std::size_t(1) << 21;
+
+    //=========================================================================
+    explicit buffer_pool_t(std::size_t max_cached_bytes=std::size_t(1) << 30) : max_bytes_cached(max_cached_bytes) {}
+    ~buffer_pool_t() { release(); }
+    buffer_pool_t(const buffer_pool_t& other) = delete;
+    buffer_pool_t& operator=(const buffer_pool_t& other) = delete;
+
+
+
+
+    /**
+     * @brief      Make this the current pool on the calling thread until the
+     *             returned object goes out of scope. Buffers, and the control
+     *             blocks of shared providers, which are created in that scope
+     *             are allocated from this pool, and return to it when they are
+     *             destroyed, wherever that happens.
+     *
+     * @return     A scope guard
+     */
+    scope_t use()
+    {
+        return scope_t(this);
+    }
+
+    void* allocate(std::size_t bytes, std::size_t alignment)
+    {
+        auto key = std::make_pair(size_class(bytes), alignment);
+        {
+            auto lock = std::lock_guard<std::mutex>(mutex);
+            auto& blocks = free_blocks[key];
+
+            if (! blocks.empty())
+            {
+                auto memory = blocks.back();
+                blocks.pop_back();
+                bytes_cached -= key.first;
+                ++num_hits;
+                return memory;
+            }
+            ++num_misses;
+        }
+        return ::operator new(key.first, std::align_val_t(alignment));
+    }
+
+    void deallocate(void* memory, std::size_t bytes, std::size_t alignment)
+    {
+        auto key = std::make_pair(size_class(bytes), alignment);
+        {
+            auto lock = std::lock_guard<std::mutex>(mutex);
+
+            if (bytes_cached + key.first <= max_bytes_cached)
+            {
+                free_blocks[key].push_back(memory);
+                bytes_cached += key.first;
+                return;
+            }
+        }
+        ::operator delete(memory, std::align_val_t(alignment));
+    }
+
+
+
+
+    /**
+     * @brief      Return every cached block to the heap. Blocks which are in
+     *             use are not affected, and return to the pool when freed.
+     */
+    void release()
+    {
+        auto lock = std::lock_guard<std::mutex>(mutex);
+
+        for (auto& [key, blocks] : free_blocks)
+        {
+            for (auto memory : blocks)
+            {
+                ::operator delete(memory, std::align_val_t(key.second));
+            }
+        }
+        free_blocks.clear();
+        bytes_cached = 0;
+    }
+
+    std::size_t hits() const { auto lock = std::lock_guard<std::mutex>(mutex); return num_hits; }
+    std::size_t misses() const { auto lock = std::lock_guard<std::mutex>(mutex); return num_misses; }
+    std::size_t cached_bytes() const { auto lock = std::lock_guard<std::mutex>(mutex); return bytes_cached; }
+    std::size_t max_cached_bytes() const { return max_bytes_cached; }
+
+    static std::size_t size_class(std::size_t bytes)
+    {
+        if (bytes > large_class_size)
+        {
+            return (bytes + large_class_size - 1) / large_class_size * large_class_size;
+        }
+        auto result = std::size_t(64);
+
+        while (result < bytes)
+        {
+            result *= 2;
+        }
+        return result;
+    }
+
+private:
+    //=========================================================================
+    mutable std::mutex mutex;
+    std::map<std::pair<std::size_t, std::size_t>, std::vector<void*>> free_blocks;
+    std::size_t num_hits = 0;
+    std::size_t num_misses = 0;
+    std::size_t bytes_cached = 0;
+    std::size_t max_bytes_cached;
+};
+
+
+
+
+//=============================================================================
+/**
+ * @brief      An allocator which aligns memory to a given boundary (by default
+ *             a cache line, which is also enough for any SIMD register), and
+ *             requests huge pages for large allocations.
+ *
+ * @tparam     ValueType  The value type
+ * @tparam     Alignment  The alignment in bytes
+ */
+template<typename ValueType, std::size_t Alignment>
+class nd::aligned_allocator_t
+{
+public:
+
+    using value_type = ValueType;
+    static constexpr std::size_t alignment = std::max(Alignment, alignof(ValueType));
+    static constexpr std::size_t huge_page_size = std::size_t(1) << 21;
+
+    template<typename OtherType>
+    struct rebind { using other = aligned_allocator_t<OtherType, Alignment>; };
+
+    //=========================================================================
+    explicit aligned_allocator_t(std::size_t huge_page_bytes=huge_page_threshold(), buffer_pool_t* pool=current_buffer_pool())
+    : huge_page_bytes(huge_page_bytes)
+    , pool(pool) {}
+
+    template<typename OtherType>
+    aligned_allocator_t(const aligned_allocator_t<OtherType, Alignment>& other)
+    : huge_page_bytes(other.huge_page_bytes)
+    , pool(other.pool) {}
+
+    ValueType* allocate(std::size_t count)
+    {
+        auto bytes = count * sizeof(ValueType);
+        auto is_huge = bytes >= huge_page_bytes;
+        auto align = is_huge ? huge_page_size : alignment;
+
+        if (is_huge)
+        {
+            bytes = (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+        }
+        auto memory = pool ? pool->allocate(bytes, align) : ::operator new(bytes, std::align_val_t(align));
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        if (is_huge)
+        {
+            madvise(memory, bytes, MADV_HUGEPAGE);
+        }
+#endif
+        return static_cast<ValueType*>(memory);
+    }
+
+    void deallocate(ValueType* memory, std::size_t count)
+    {
+        auto bytes = count * sizeof(ValueType);
+        auto align = bytes >= huge_page_bytes ? huge_page_size : alignment;
+
+        if (pool)
+        {
+            pool->deallocate(memory, bytes, align);
+        }
+        else
+        {
+            ::operator delete(memory, std::align_val_t(align));
+        }
+    }
+
+    bool operator==(const aligned_allocator_t& other) const { return huge_page_bytes == other.huge_page_bytes && pool == other.pool; }
+    bool operator!=(const aligned_allocator_t& other) const { return ! operator==(other); }
+
+    std::size_t huge_page_bytes;
+    buffer_pool_t* pool;
+};
+
+
+
+
+//=============================================================================
+template<typename ValueType, typename Allocator>
+class nd::buffer_t
+{
+public:
+
+    using value_type = ValueType;
+    using allocator_type = Allocator;
+
+    //=========================================================================
+    ~buffer_t() { release(); }
+    buffer_t() {}
+    buffer_t(const buffer_t& other) = delete;
+    buffer_t& operator=(const buffer_t& other) = delete;
+
+    buffer_t(buffer_t&& other)
+    : allocator(other.allocator)
+    {
+        memory = other.memory;
+        count = other.count;
+        other.memory = nullptr;
+        other.count = 0;
+    }
+
+    buffer_t(std::size_t count, ValueType value=ValueType(), const Allocator& allocator=Allocator())
+    : allocator(allocator)
+    {
+        allocate(count);
+
+        try {
+            std::uninitialized_fill_n(memory, count, value);
+        }
+        catch (...)
+        {
+            deallocate();
+            throw;
+        }
+    }
+
+    template<class IteratorType>
+    buffer_t(IteratorType first, IteratorType last, const Allocator& allocator=Allocator())
+    : allocator(allocator)
+    {
+        allocate(std::distance(first, last));
+
+        try {
+            std::uninitialized_copy_n(first, count, memory);
+        }
+        catch (...)
+        {
+            deallocate();
+            throw;
+        }
+    }
+
+
+
+
+    /**
+     * @brief      Return a buffer whose elements are left uninitialized if the
+     *             value type is trivial, or default-constructed otherwise. Use
+     *             this when every element is about to be overwritten, so the
+     *             memory is touched only once.
+     *
+     * @param[in]  count      The number of elements
+     * @param[in]  allocator  The allocator
+     *
+     * @return     The buffer
+     */
+    static buffer_t uninitialized(std::size_t count, const Allocator& allocator=Allocator())
+    {
+        auto result = buffer_t(allocator);
+        result.allocate(count);
+
+        if constexpr (! std::is_trivially_default_constructible<ValueType>::value)
+        {
+            try {
+                std::uninitialized_value_construct_n(result.memory, count);
+            }
+            catch (...)
+            {
+                result.deallocate();
+                throw;
+            }
+        }
+        return result;
+    }
+
+    buffer_t& operator=(buffer_t&& other)
+    {
+        release();
+        allocator = other.allocator;
+        memory = other.memory;
+        count = other.count;
+
+        other.memory = nullptr;
+        other.count = 0;
+        return *this;
+    }
+
+    bool empty() const { return count == 0; }
+    std::size_t size() const { return count; }
+    const Allocator& get_allocator() const { return allocator; }
+
+    const ValueType* data() const { return memory; }
+    const ValueType* begin() const { return memory; }
+    const ValueType* end() const { return memory + count; }
+    const ValueType& operator[](std::size_t offset) const { return memory[offset]; }
+    const ValueType& at(std::size_t offset) const
+    {
+        if (offset >= count)
+        {
+            throw std::out_of_range("buffer_t index out of range");
+        }
+        return memory[offset];
+    }
+
+    ValueType* data() { return memory; }
+    ValueType* begin() { return memory; }
+    ValueType* end() { return memory + count; }
+    ValueType& operator[](std::size_t offset) { return memory[offset]; }
+    ValueType& at(std::size_t offset)
+    {
+        if (offset >= count)
+        {
+            throw std::out_of_range("buffer_t index out of range");
+        }
+        return memory[offset];
+    }
+
+private:
+    //=========================================================================
+    explicit buffer_t(const Allocator& allocator) : allocator(allocator) {}
+
+    void allocate(std::size_t new_count)
+    {
+        memory = new_count ? std::allocator_traits<Allocator>::allocate(allocator, new_count) : nullptr;
+        count = new_count;
+    }
+
+    void deallocate()
+    {
+        if (memory)
+        {
+            std::allocator_traits<Allocator>::deallocate(allocator, memory, count);
+        }
+        memory = nullptr;
+        count = 0;
+    }
+
+    void release()
+    {
+        if (memory)
+        {
+            std::destroy_n(memory, count);
+            std::allocator_traits<Allocator>::deallocate(allocator, memory, count);
+        }
+        memory = nullptr;
+        count = 0;
+    }
+
+    Allocator allocator;
+    std::size_t count = 0;
+    ValueType* memory = nullptr;
+};
+
+
+
+
+//=============================================================================
+// Provider factories
+//=============================================================================
+
+
+
+
+template<typename ValueType, std::size_t Rank>
+auto nd::make_shared_provider(shape_t<Rank> shape)
+{
+    auto buffer = std::allocate_shared<buffer_t<ValueType>>(aligned_allocator_t<buffer_t<ValueType>>(), shape.volume());
+    return shared_provider_t<ValueType, Rank>(shape, buffer);
+}
+
+template<typename ValueType, typename... Args>
+auto nd::make_shared_provider(Args... args)
+{
+    return make_shared_provider<ValueType>(make_shape(args...));
+}
+
+template<typename ValueType, std::size_t Rank>
+auto nd::make_unique_provider(shape_t<Rank> shape)
+{
+    auto buffer = buffer_t<ValueType>(shape.volume());
+    return unique_provider_t<ValueType, Rank>(shape, std::move(buffer));
+}
+
+template<typename ValueType, typename... Args>
+auto nd::make_unique_provider(Args... args)
+{
+    return make_unique_provider<ValueType>(make_shape(args...));
+}
+
+
+
+
+/**
+ * @brief      Make a unique provider whose elements are not initialized (if
+ *             they are trivial). Every element must be written before it is
+ *             read.
+ *
+ * @param[in]  shape      The shape
+ *
+ * @tparam     ValueType  The value type
+ * @tparam     Rank       The rank
+ *
+ * @return     A unique provider
+ */
+template<typename ValueType, std::size_t Rank>
+auto nd::make_uninitialized_unique_provider(shape_t<Rank> shape)
+{
+    auto buffer = buffer_t<ValueType>::uninitialized(shape.volume());
+    return unique_provider_t<ValueType, Rank>(shape, std::move(buffer));
+}
+
+/**
+ * @brief      Evaluate a provider into a unique provider.
+ *
+ * @param      source_provider  The provider to evaluate
+ *
+ * @tparam     Provider         The type of the provider
+ *
+ * @return     A unique provider
+ *
+ * @note       Providers whose memory is laid out row-major (shared and unique
+ *             providers) are copied as one flat range, bypassing the
+ *             N-dimensional index arithmetic. Elementwise expressions over
+ *             such providers are evaluated as a flat range too, in vectorized
+ *             blocks.
+ */
+template<typename Provider>
+auto nd::evaluate_as_unique(Provider&& source_provider)
+{
+    using value_type = typename std::remove_reference_t<Provider>::value_type;
+    auto target_shape = source_provider.shape();
+    auto target_provider = make_uninitialized_unique_provider<value_type>(target_shape);
+    detail::advise_leaves(source_provider, access_advice_t::sequential);
+
+    if constexpr (detail::is_contiguous_provider<std::decay_t<Provider>>::value)
+    {
+        auto source = source_provider.data();
+        std::copy(source, source + source_provider.size(), target_provider.data());
+    }
+    else if constexpr (detail::is_strided_provider<std::decay_t<Provider>>::value)
+    {
+        if (source_provider.is_contiguous())
+        {
+            auto source = source_provider.data();
+            std::copy(source, source + source_provider.size(), target_provider.data());
+        }
+        else
+        {
+            detail::evaluate_region(source_provider, target_provider, make_access_pattern(target_shape));
+        }
+    }
+    else if constexpr (detail::is_flat_readable<std::decay_t<Provider>>::value)
+    {
+        if (detail::is_flat(source_provider))
+        {
+            detail::evaluate_flat(source_provider, target_provider.data(), 0, source_provider.size());
+        }
+        else
+        {
+            detail::evaluate_region(source_provider, target_provider, make_access_pattern(target_shape));
+        }
+    }
+    else
+    {
+        detail::evaluate_region(source_provider, target_provider, make_access_pattern(target_shape));
+    }
+    return target_provider;
+}
+
+/**
+ * @brief      Return a tuple of the leaves of an expression: the operands of
+ *             elementwise providers, found recursively, or else the provider
+ *             itself.
+ *
+ * @param[in]  provider  The provider
+ *
+ * @tparam     Provider  The provider type
+ *
+ * @return     A std::tuple of providers
+ */
+template<typename Provider>
+auto nd::leaf_providers(const Provider& provider)
+{
+    if constexpr (detail::is_elementwise_provider<Provider>::value)
+    {
+        return std::apply([] (const auto&... operand) { return std::tuple_cat(leaf_providers(operand)...); }, provider.operands());
+    }
+    else
+    {
+        return std::make_tuple(provider);
+    }
+}
+
+template<typename Provider>
+auto nd::evaluate_as_shared(Provider&& provider)
+{
+    return evaluate_as_unique(std::forward<Provider>(provider)).shared();
+}
+
+
+
+
+/**
+ * @brief      Evaluate a provider into a unique provider, dividing the work
+ *             into tiles which are load-balanced among the workers of a tile
+ *             scheduler. Each element is computed exactly as in
+ *             evaluate_as_unique, so the result is identical to the serial one.
+ *
+ * @param      source_provider  The provider to evaluate
+ * @param      scheduler        The scheduler to run on
+ *
+ * @tparam     Provider         The type of the provider
+ *
+ * @return     A unique provider
+ */
+template<typename Provider>
+auto nd::evaluate_as_unique_parallel(Provider&& source_provider, tile_scheduler_t& scheduler)
+{
+    using value_type = typename std::remove_reference_t<Provider>::value_type;
+    auto target_shape = source_provider.shape();
+    auto target_provider = make_uninitialized_unique_provider<value_type>(target_shape);
+    detail::advise_leaves(source_provider, access_advice_t::sequential);
+
+    if constexpr (detail::is_flat_readable<std::decay_t<Provider>>::value)
+    {
+        if (detail::is_flat(source_provider))
+        {
+            auto target = target_provider.data();
+            auto size = source_provider.size();
+            auto num_chunks = std::min(4 * scheduler.num_workers(), size);
+
+            scheduler.run(num_chunks, [&] (std::size_t n)
+            {
+                auto i0 = (n + 0) * size / num_chunks;
+                auto i1 = (n + 1) * size / num_chunks;
+                detail::evaluate_flat(source_provider, target, i0, i1 - i0);
+            });
+            return target_provider;
+        }
+    }
+    auto tiles = std::vector<access_pattern_t<std::decay_t<Provider>::provider_rank>>();
+
+    if constexpr (detail::is_strided_provider<std::decay_t<Provider>>::value || detail::is_stencil_provider<std::decay_t<Provider>>::value)
+    {
+        // Slabs on the first axis keep whole planes of the last axes
+        // together, which the blocked kernels need to be effective.
+        tiles = partition_shape(target_shape, std::min(4 * scheduler.num_workers(), target_shape[0]));
+    }
+    else
+    {
+        tiles = partition_tiles(target_shape, make_tile_shape<value_type>(target_shape, 4 * scheduler.num_workers()));
+    }
+
+    scheduler.run(tiles.size(), [&] (std::size_t n)
+    {
+        detail::evaluate_region(source_provider, target_provider, tiles[n]);
+    });
+    return target_provider;
+}
+
+template<typename Provider>
+auto nd::evaluate_as_shared_parallel(Provider&& provider, tile_scheduler_t& scheduler)
+{
+    return evaluate_as_unique_parallel(std::forward<Provider>(provider), scheduler).shared();
+}
+
+template<typename Provider>
+auto nd::evaluate_as_unique_parallel(Provider&& provider, thread_pool_t& pool, std::size_t num_tasks)
+{
+    auto scheduler = tile_scheduler_t(pool, num_tasks);
+    return evaluate_as_unique_parallel(std::forward<Provider>(provider), scheduler);
+}
+
+template<typename Provider>
+auto nd::evaluate_as_shared_parallel(Provider&& provider, thread_pool_t& pool, std::size_t num_tasks)
+{
+    return evaluate_as_unique_parallel(std::forward<Provider>(provider), pool, num_tasks).shared();
+}
+
+template<typename Provider>
+auto nd::evaluate_as_unique_parallel(Provider&& provider, std::size_t num_threads)
+{
+    auto& pool = default_thread_pool();
+
+    if (num_threads == 0)
+    {
+        num_threads = std::max(pool.size(), std::size_t(1));
+    }
+
+    return evaluate_as_unique_parallel(std::forward<Provider>(provider), pool, num_threads);
+}
+
+template<typename Provider>
+auto nd::evaluate_as_shared_parallel(Provider&& provider, std::size_t num_threads)
+{
+    return evaluate_as_unique_parallel(std::forward<Provider>(provider), num_threads).shared();
+}
+
+
+
+
+//=============================================================================
+// Array factories
+//=============================================================================
+
+
+
+
+/**
+ * @brief      Make an array from the given provider.
+ *
+ * @param      provider  The provider
+ *
+ * @tparam     Provider  The type of the provider
+ *
+ * @return     The array
+ */
+template<typename Provider>
+auto nd::make_array(Provider&& provider)
+{
+    return array_t<Provider>(std::forward<Provider>(provider));
+}
+
+
+
+
+/**
+ * @brief      Make an array from the given index -> value mapping and shape.
+ *
+ * @param[in]  mapping  The mapping
+ * @param[in]  shape    The shape
+ *
+ * @tparam     Mapping  The type of the index -> value mapping
+ * @tparam     Rank     The rank of the array
+ *
+ * @return     The array
+ *
+ * @note       The array uses the `basic_provider_t`, whose `operator()` is a
+ *             const method, but which preserves the reference type of the
+ *             mapping's return value. That is, if `mapping` returns a const
+ *             reference then so does the returned array when indexed. The
+ *             returned array has no `data` or `reshape` methods, and whose.
+ */
+template<typename Mapping, std::size_t Rank>
+auto nd::make_array(Mapping mapping, shape_t<Rank> shape)
+{
+    return make_array(basic_provider_t<Mapping, Rank>(mapping, shape));
+}
+
+
+
+
+/**
+ * @brief      Create a 1-dimensional array from an iterable container
+ *
+ * @param[in]  container      The container to source values from
+ *
+ * @tparam     ContainerType  The type of the container, std::vector, std::list,
+ *                            std::array, etc.
+ *
+ * @return     The array
+ */
+template<typename ContainerType>
+auto nd::make_array_from(const ContainerType& container)
+{
+    auto shape = make_shape(container.size());
+    auto result = make_unique_array<typename ContainerType::value_type>(shape);
+    auto n = std::size_t(0);
+
+    for (auto source_value : container)
+    {
+        result(n++) = source_value;
+    }
+    return std::move(result).shared();
+}
+
+
+
+
+/**
+ * @brief      Create an array whose elements are read from a file, through a
+ *             memory mapping. The file holds the raw values in row-major
+ *             order, possibly after a header.
+ *
+ * @param[in]  filename   The name of the file to map
+ * @param[in]  shape      The shape of the array
+ * @param[in]  offset     The number of bytes to skip at the start of the file
+ * @param[in]  mode       Whether the mapping is read-only or copy-on-write
+ *
+ * @tparam     ValueType  The value type of the array
+ * @tparam     Rank       The rank of the array
+ *
+ * @return     A mapped array
+ */
+template<typename ValueType, std::size_t Rank>
+auto nd::map_file(const std::string& filename, shape_t<Rank> shape, std::size_t offset, map_mode_t mode)
+{
+    return make_array(mmap_provider_t<ValueType, Rank>(shape, std::make_shared<mapped_file_t>(filename, mode), offset));
+}
+
+
+
+
+/**
+ * @brief      Make a shared (immutable, copyable, memory-backed) array with the
+ *             given shape, initialized to the default-constructed ValueType.
+ *
+ * @param[in]  shape      The shape
+ *
+ * @tparam     ValueType  The value type of the array
+ * @tparam     Rank       The rank of the array
+ *
+ * @return     The array
+ */
+template<typename ValueType, std::size_t Rank>
+auto nd::make_shared_array(shape_t<Rank> shape)
+{
+    return make_array(make_shared_provider<ValueType>(shape));
+}
+
+template<typename ValueType, typename... Args>
+auto nd::make_shared_array(Args... args)
+{
+    return make_array(make_shared_provider<ValueType>(args...));
+}
+
+
+
+
+/**
+ * @brief      Return an array with the i-th tuple index of all the elements
+ *             (maps std::get<Index>) over the array).
+ *
+ * @param[in]  array      The array of std::tuple (or std::array)
+ *
+ * @tparam     Index      The tuple index
+ * @tparam     ArrayType  The type of the array
+ *
+ * @return     The array
+ */
+template<std::size_t Index, typename ArrayType>
+auto nd::get(ArrayType array)
+{
+    return detail::get_through<Index>(array);
+}
+
+
+
+
+/**
+ * @brief      Make a unique (mutable, non-copyable, memory-backed) array with
+ *             the given shape.
+ *
+ * @param[in]  shape      The shape
+ *
+ * @tparam     ValueType  The value type of the array
+ * @tparam     Rank       The rank of the array
+ *
+ * @return     The array
+ */
+template<typename ValueType, std::size_t Rank>
+auto nd::make_unique_array(shape_t<Rank> shape)
+{
+    return make_array(make_unique_provider<ValueType>(shape));
+}
+
+template<typename ValueType, typename... Args>
+auto nd::make_unique_array(Args... args)
+{
+    return make_array(make_unique_provider<ValueType>(args...));
+}
+
+
+
+
+/**
+ * @brief      Return an index-array of the given shape, mapping the index (i,
+ *             j, ...) to itself.
+ *
+ * @param[in]  shape  The shape
+ *
+ * @tparam     Rank   The rank of the array
+ *
+ * @return     The array
+ */
+template<std::size_t Rank>
+auto nd::index_array(shape_t<Rank> shape)
+{
+    auto mapping = [] (auto&& index) { return index; };
+    return make_array(basic_provider_t<decltype(mapping), Rank>(mapping, shape));
+}
+template<typename... Args>
+auto nd::index_array(Args... args)
+{
+    return index_array(make_shape(args...));
+}
+
+
+
+
+/**
+ * @brief      Zip a sequence identically-shaped arrays together
+ *
+ * @param      arrays      The arrays
+ *
+ * @tparam     ArrayTypes  The types of the arrays
+ *
+ * @return     An array which returns tuples taken from the underlying arrays
+ */
+template<typename... ArrayTypes>
+auto nd::zip(ArrayTypes... arrays)
+{
+    constexpr std::size_t Ranks[] = {ArrayTypes::array_rank...};
+    shape_t<Ranks[0]> shapes[] = {arrays.shape()...};
+
+    if (std::adjacent_find(std::begin(shapes), std::end(shapes), std::not_equal_to<>()) != std::end(shapes))
+    {
+        throw std::logic_error("cannot zip arrays with different shapes");
+    }
+    auto mapping = [arrays...] (auto&& index)
+    {
+        return std::make_tuple(arrays(index)...);
+    };
+    return make_array(mapping, shapes[0]);
+}
+
+
+
+
+/**
+ * @brief      Turn an array of tuples into a tuple of arrays
+ *
+ * @param[in]  array      The array of tuples
+ *
+ * @tparam     ArrayType  The type of the argument array
+ *
+ * @return     The tuple of arrays
+ */
+template<typename ArrayType>
+auto nd::unzip(ArrayType array)
+{
+    auto Is = std::make_index_sequence<std::tuple_size<typename ArrayType::value_type>::value>();
+    return detail::unzip_array_impl(array, Is);
+}
+
+
+
+
+/**
+ * @brief      Return an array that is the cartesian product of the argument
+ *             arrays, A(i, j, k) == make_tuple(a(i), b(j), c(k))
+ *
+ * @param[in]  arrays      A sequence of 1d arrays
+ *
+ * @tparam     ArrayTypes  The types of the argument arrays
+ *
+ * @return     The array
+ */
+template<typename... ArrayTypes>
+auto nd::cartesian_product(ArrayTypes... arrays)
+{
+    shape_t<sizeof...(ArrayTypes)> shape = {arrays.size()...};
+
+    auto mapping = [arrays...] (auto&& index)
+    {
+        return detail::zip_apply_tuple(std::forward_as_tuple(arrays...), index.as_tuple());
+    };
+    return make_array(mapping, shape);
+}
+
+
+
+
+/**
+ * @brief      Return a tuple of N-dimensional arrays, given N 1d arrays
+ *
+ * @param[in]  arrays      The arrays
+ *
+ * @tparam     ArrayTypes  The types of the input arrays
+ *
+ * @return     The tuple of arrays
+ */
+template<typename... ArrayTypes>
+auto nd::meshgrid(ArrayTypes... arrays)
+{
+    return unzip(cartesian_product(arrays...));
+}
+
+
+
+
+/**
+ * @brief      Return an array of zeros with the given shape
+ *
+ * @param[in]  args       shape arguments
+ *
+ * @tparam     ValueType  Defaults to int; use e.g. zeros<double>(...) for other
+ *                        types
+ * @tparam     Args       Argument types (should be a positive integral type)
+ *
+ * @return     An array of zeros, only requiring storage for a single element
+ */
+template<typename ValueType, typename... Args>
+auto nd::zeros(Args... args)
+{
+    return make_array(uniform_provider_t<ValueType, sizeof...(Args)>(ValueType(0), make_shape(std::size_t(args)...)));
+}
+
+
+
+
+/**
+ * @brief      Return an array of ones with the given shape
+ *
+ * @param[in]  args       shape arguments
+ *
+ * @tparam     ValueType  Defaults to int; use e.g. ones<double>(...) for other
+ *                        types
+ * @tparam     Args       Argument types (should be a positive integral type)
+ *
+ * @return     An array of ones, only requiring storage for a single element.
+ */
+template<typename ValueType, typename... Args>
+auto nd::ones(Args... args)
+{
+    return make_array(uniform_provider_t<ValueType, sizeof...(Args)>(ValueType(1), make_shape(std::size_t(args)...)));
+}
+
+
+
+
+/**
+ * @brief      Try to promote the argument to an array of the given shape
+ *
+ * @param      arg    The argument
+ * @param[in]  shape  The shape
+ *
+ * @tparam     Arg    The argument type
+ * @tparam     Rank   The rank of the shape to promote the argument to
+ *
+ * @return     An array with the given shape
+ */
+template<typename Arg, std::size_t Rank>
+auto nd::promote(Arg arg, nd::shape_t<Rank> shape)
+{
+    if constexpr (detail::has_typedef_is_ndarray<Arg>::value)
+    {
+        return arg;
+    }
+    else
+    {
+        return make_array(uniform_provider_t<Arg, Rank>(arg, shape));
+    }
+}
+
+
+
+
+//=============================================================================
+// File input and output
+//=============================================================================
+
+
+
+
+/**
+ * @brief      A sink which writes bytes to a file, optionally bypassing the
+ *             page cache with O_DIRECT (on Linux), so a large checkpoint does
+ *             not evict the working set of the computation. Direct writes must
+ *             come from aligned memory in whole blocks: data which is aligned
+ *             and arrives in whole blocks is written as it is, and anything
+ *             else is gathered into an aligned staging buffer first. The tail
+ *             of the file, which is not a whole block, is written through the
+ *             page cache by close. If the file system does not support direct
+ *             I/O, either when the file is opened or when a write is rejected
+ *             with EINVAL, the sink falls back to ordinary writes.
+ */
+class nd::file_sink_t
+{
+public:
+
+    static constexpr std::size_t block_size = 4096;
+    using staging_buffer_t = buffer_t<char, aligned_allocator_t<char, block_size>>;
+
+    //=========================================================================
+    file_sink_t(const std::string& filename, bool direct=false, std::size_t staging_bytes=1 << 20)
+    : filename(filename)
+    , direct(direct)
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        auto flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+        if (direct)
+        {
+            fd = ::open(filename.data(), flags | O_DIRECT, 0644);
+        }
+#endif
+        if (fd == -1)
+        {
+            fd = ::open(filename.data(), flags, 0644);
+            file_sink_t::direct = false;
+        }
+        if (fd == -1)
+        {
+            throw std::runtime_error("cannot open file " + filename);
+        }
+        if (file_sink_t::direct)
+        {
+            staging = staging_buffer_t::uninitialized(std::max(staging_bytes / block_size, std::size_t(1)) * block_size);
+        }
+#else
+        throw std::runtime_error("file sinks are not supported on this platform");
+#endif
+    }
+
+    file_sink_t(file_sink_t&& other)
+    : filename(std::move(other.filename))
+    , fd(other.fd)
+    , direct(other.direct)
+    , staging(std::move(other.staging))
+    , staged(other.staged)
+    {
+        other.fd = -1;
+    }
+
+    ~file_sink_t()
+    {
+        try {
+            close();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    file_sink_t(const file_sink_t& other) = delete;
+    file_sink_t& operator=(const file_sink_t& other) = delete;
+
+    bool is_direct() const { return direct; }
+
+
+
+
+    /**
+     * @brief      Append bytes to the file.
+     *
+     * @param[in]  data   The bytes to write
+     * @param[in]  bytes  The number of bytes
+     */
+    void write(const void* data, std::size_t bytes)
+    {
+        auto source = static_cast<const char*>(data);
+
+        if (! direct)
+        {
+            write_all(source, bytes);
+            return;
+        }
+        if (staged == 0 && reinterpret_cast<std::uintptr_t>(source) % block_size == 0)
+        {
+            auto whole_blocks = bytes / block_size * block_size;
+            write_all(source, whole_blocks);
+            source += whole_blocks;
+            bytes -= whole_blocks;
+        }
+        while (bytes > 0)
+        {
+            auto n = std::min(bytes, staging.size() - staged);
+            std::copy(source, source + n, staging.data() + staged);
+            staged += n;
+            source += n;
+            bytes -= n;
+
+            if (staged == staging.size())
+            {
+                write_all(staging.data(), staged);
+                staged = 0;
+            }
+        }
+    }
+
+
+
+
+    /**
+     * @brief      Write any staged bytes, and close the file. Does nothing if
+     *             the file is already closed.
+     */
+    void close()
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        if (fd == -1)
+        {
+            return;
+        }
+        auto error = std::exception_ptr();
+
+        try {
+            auto whole_blocks = staged / block_size * block_size;
+            write_all(staging.data(), whole_blocks);
+
+            if (direct)
+            {
+                disable_direct();
+            }
+            write_all(staging.data() + whole_blocks, staged - whole_blocks);
+            staged = 0;
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        auto result = ::close(fd);
+        fd = -1;
+
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+        if (result != 0)
+        {
+            throw std::runtime_error("failed to close file " + filename);
+        }
+#endif
+    }
+
+private:
+    //=========================================================================
+    void write_all(const char* data, std::size_t bytes)
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        while (bytes > 0)
+        {
+            auto n = ::write(fd, data, bytes);
+
+            if (n < 0 && errno == EINVAL && direct)
+            {
+                disable_direct();
+                continue;
+            }
+            if (n <= 0)
+            {
+                throw std::runtime_error("failed to write file " + filename);
+            }
+            data += n;
+            bytes -= n;
+        }
+#endif
+    }
+
+    void disable_direct()
+    {
+#if defined(O_DIRECT)
+        auto flags = ::fcntl(fd, F_GETFL);
+
+        if (flags == -1 || ::fcntl(fd, F_SETFL, flags & ~O_DIRECT) == -1)
+        {
+            throw std::runtime_error("cannot turn off direct I/O for file " + filename);
+        }
+#endif
+        direct = false;
+    }
+
+    std::string filename;
+    int fd = -1;
+    bool direct = false;
+    staging_buffer_t staging;
+    std::size_t staged = 0;
+};
+
+
+
+
+/**
+ * @brief      Evaluate an array and write its values, in row-major order, to a
+ *             sink, on the background I/O worker. The calling thread only
+ *             copies the array, which for a memory-backed array is the copy
+ *             of a shared pointer; it must not be a unique array. On the I/O
+ *             worker, the array is evaluated in chunks into two aligned
+ *             buffers: while one is written to the sink by a second persistent
+ *             worker, the next chunk is evaluated into the other. Chunks are
+ *             rounded to a whole number of file_sink_t blocks.
+ *
+ * @param[in]  array        The array to write
+ * @param[in]  sink         The sink, which needs methods write(const void*,
+ *                          std::size_t) and close(); for example a file_sink_t
+ * @param[in]  chunk_bytes  The size of each of the two buffers
+ *
+ * @tparam     ArrayType    The type of the array
+ * @tparam     Sink         The type of the sink
+ *
+ * @return     A std::future<void> which is ready when the sink has been
+ *             closed, and holds any exception thrown along the way
+ */
+template<typename ArrayType, typename Sink>
+auto nd::async_write(ArrayType array, Sink sink, std::size_t chunk_bytes)
+{
+    auto task = std::make_shared<std::packaged_task<void()>>([array=std::move(array), sink=std::move(sink), chunk_bytes] () mutable
+    {
+        detail::write_double_buffered(array.get_provider(), sink, chunk_bytes);
+        sink.close();
+    });
+    auto future = task->get_future();
+    default_io_worker().submit([task] { (*task)(); });
+    return future;
+}
+
+
+
+
+/**
+ * @brief      Write an array to a file in NumPy's .npy format. Arrays with a
+ *             contiguous memory backing are written in one call; other arrays
+ *             are streamed in blocks of rows along axis 0 (see stream_to), so
+ *             that a lazy array is never fully materialized.
+ *
+ * @param[in]  array      The array to write
+ * @param[in]  filename   The name of the file to write
+ *
+ * @tparam     ArrayType  The type of the array; its value type must be an
+ *                        arithmetic type
+ */
+template<typename ArrayType>
+void nd::save_npy(const ArrayType& array, const std::string& filename)
+{
+    using value_type = value_type_of<ArrayType>;
+    using provider_type = typename std::decay_t<ArrayType>::provider_type;
+
+    auto file = std::fopen(filename.data(), "wb");
+
+    if (! file)
+    {
+        throw std::runtime_error("cannot open file " + filename);
+    }
+    auto header = detail::make_npy_header(detail::npy_descr<value_type>(), false, array.shape());
+
+    auto write = [&] (const void* data, std::size_t size, std::size_t count)
+    {
+        if (std::fwrite(data, size, count, file) != count)
+        {
+            throw std::runtime_error("failed to write file " + filename);
+        }
+    };
+
+    try {
+        write(header.data(), 1, header.size());
+
+        if constexpr (detail::is_contiguous_provider<provider_type>::value)
+        {
+            write(array.data(), sizeof(value_type), array.size());
+        }
+        else if (array.size() > 0)
+        {
+            auto row_bytes = array.size() / array.shape(0) * sizeof(value_type);
+            auto block_shape = array.shape();
+            block_shape[0] = std::max(std::size_t(1), (std::size_t(1) << 22) / row_bytes);
+
+            // The sink throws on the first failed write, so no further blocks
+            // are evaluated.
+            array | stream_to([&write] (const auto& region, const value_type* data) { write(data, sizeof(value_type), region.size()); }, block_shape);
+        }
+    }
+    catch (...)
+    {
+        std::fclose(file);
+        throw;
+    }
+    if (std::fclose(file) != 0)
+    {
+        throw std::runtime_error("failed to write file " + filename);
+    }
+}
+
+
+
+
+/**
+ * @brief      Read an array from a file in NumPy's .npy format into a new,
+ *             aligned buffer. The data is read in a single call after the
+ *             header. Files in Fortran order are read as they are, viewed
+ *             through a strided view with the axes reversed, and copied to
+ *             row-major order.
+ *
+ * @param[in]  filename   The name of the file to read
+ *
+ * @tparam     ValueType  The value type of the array, which must match the
+ *                        dtype of the file
+ * @tparam     Rank       The rank of the array, which must match the number of
+ *                        axes in the file
+ *
+ * @return     A shared array
+ */
+template<typename ValueType, std::size_t Rank>
+auto nd::load_npy(const std::string& filename)
+{
+    auto file = std::fopen(filename.data(), "rb");
+
+    if (! file)
+    {
+        throw std::runtime_error("cannot open file " + filename);
+    }
+    std::setvbuf(file, nullptr, _IONBF, 0);
+
+    auto read_payload = [&] ()
+    {
+        auto header = detail::read_npy_header(file, filename);
+        auto shape = detail::check_npy_header<ValueType, Rank>(header, filename);
+        auto buffer = buffer_t<ValueType>::uninitialized(shape.volume());
+
+        if (std::fread(buffer.data(), sizeof(ValueType), buffer.size(), file) != buffer.size())
+        {
+            throw std::runtime_error("file " + filename + " is shorter than its header says");
+        }
+        return std::make_tuple(header.fortran_order, shape, std::move(buffer));
+    };
+
+    try {
+        auto [fortran_order, shape, buffer] = read_payload();
+        std::fclose(file);
+
+        if (! fortran_order)
+        {
+            return make_array(unique_provider_t<ValueType, Rank>(shape, std::move(buffer)).shared());
+        }
+        auto storage_shape = shape_t<Rank>();
+        auto axis_order = index_t<Rank>();
+
+        for (std::size_t n = 0; n < Rank; ++n)
+        {
+            storage_shape[n] = shape[Rank - 1 - n];
+            axis_order[n] = Rank - 1 - n;
+        }
+        auto storage = unique_provider_t<ValueType, Rank>(storage_shape, std::move(buffer)).shared();
+        return make_array(evaluate_as_shared(storage.strided().permute(axis_order)));
+    }
+    catch (...)
+    {
+        std::fclose(file);
+        throw;
+    }
+}
+
+
+
+
+/**
+ * @brief      Map a file in NumPy's .npy format into memory, without reading
+ *             it. The file must be in C order; use load_npy to read files in
+ *             Fortran order.
+ *
+ * @param[in]  filename   The name of the file to map
+ * @param[in]  mode       Whether the mapping is read-only or copy-on-write
+ *
+ * @tparam     ValueType  The value type of the array, which must match the
+ *                        dtype of the file
+ * @tparam     Rank       The rank of the array, which must match the number of
+ *                        axes in the file
+ *
+ * @return     A mapped array
+ */
+template<typename ValueType, std::size_t Rank>
+auto nd::map_npy(const std::string& filename, map_mode_t mode)
+{
+    auto file = std::fopen(filename.data(), "rb");
+
+    if (! file)
+    {
+        throw std::runtime_error("cannot open file " + filename);
+    }
+    auto header = detail::npy_header_t();
+
+    try {
+        header = detail::read_npy_header(file, filename);
+        std::fclose(file);
+    }
+    catch (...)
+    {
+        std::fclose(file);
+        throw;
+    }
+    auto shape = detail::check_npy_header<ValueType, Rank>(header, filename);
+
+    if (header.fortran_order)
+    {
+        throw std::logic_error("cannot map file " + filename + " in Fortran order; use load_npy");
+    }
+    return map_file<ValueType>(filename, shape, header.data_offset, mode);
+}
+
+
+
+
+/**
+ * @brief      Write an array to a file in a chunked format: the array is cut
+ *             into tiles of the given chunk shape (see partition_tiles), and
+ *             each tile is evaluated, optionally byte-shuffled (which groups
+ *             the bytes of similar floating point values), and compressed, on
+ *             the workers of the default thread pool. Tiles are evaluated in
+ *             batches, so a lazy array is never fully materialized. The file
+ *             begins with a header describing the value type, shape, chunk
+ *             shape, and codec, followed by the offset and size of each chunk.
+ *
+ * @param[in]  array        The array to write
+ * @param[in]  filename     The name of the file to write
+ * @param[in]  chunk_shape  The shape of the chunks
+ * @param[in]  codec        The compression codec
+ * @param[in]  shuffle      Whether to byte-shuffle chunks before compressing
+ * @param[in]  num_threads  The number of threads; zero means use the whole
+ *                          default pool
+ *
+ * @tparam     ArrayType    The type of the array; its value type must be an
+ *                          arithmetic type
+ * @tparam     Rank         The rank of the array
+ */
+template<typename ArrayType, std::size_t Rank>
+void nd::save_chunked(const ArrayType& array, const std::string& filename, shape_t<Rank> chunk_shape, chunk_codec_t codec, bool shuffle, std::size_t num_threads)
+{
+    using value_type = value_type_of<ArrayType>;
+    static_assert(std::decay_t<ArrayType>::array_rank == Rank, "chunk shape must have the rank of the array");
+
+    auto tiles = partition_tiles(array.shape(), chunk_shape);
+    auto file = std::fopen(filename.data(), "wb");
+
+    if (! file)
+    {
+        throw std::runtime_error("cannot open file " + filename);
+    }
+    auto tuple = [] (auto shape)
+    {
+        auto result = std::string("(");
+
+        for (std::size_t n = 0; n < Rank; ++n)
+        {
+            result += std::to_string(shape[n]) + (Rank == 1 ? ",)" : n + 1 < Rank ? ", " : ")");
+        }
+        return result;
+    };
+    auto dict = "{'descr': '" + detail::npy_descr<value_type>() + "', "
+    + "'shape': " + tuple(array.shape()) + ", "
+    + "'chunks': " + tuple(chunk_shape) + ", "
+    + "'codec': '" + (codec == chunk_codec_t::lz ? "lz" : "none") + "', "
+    + "'shuffle': " + (shuffle ? "True" : "False") + ", }\n";
+
+    auto bytes = std::vector<unsigned char>();
+    auto put_le = [&bytes] (std::size_t value, std::size_t count)
+    {
+        for (std::size_t n = 0; n < count; ++n)
+        {
+            bytes.push_back((unsigned char)(value >> (8 * n)));
+        }
+    };
+    bytes.insert(bytes.end(), "\x93NDCHUNK", "\x93NDCHUNK" + 8);
+    put_le(dict.size(), 4);
+    bytes.insert(bytes.end(), dict.begin(), dict.end());
+
+    auto index_position = bytes.size();
+    auto offset = index_position + 16 * tiles.size();
+    auto success = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    success = success && std::fseek(file, long(offset), SEEK_SET) == 0;
+
+    auto& pool = default_thread_pool();
+
+    if (num_threads == 0)
+    {
+        num_threads = std::max(pool.size(), std::size_t(1));
+    }
+
+    auto scheduler = tile_scheduler_t(pool, num_threads);
+    auto batch_size = 4 * scheduler.num_workers();
+    auto encoded = std::vector<std::vector<unsigned char>>(batch_size);
+    bytes.clear();
+
+    for (std::size_t b0 = 0; b0 < tiles.size() && success; b0 += batch_size)
+    {
+        auto count = std::min(batch_size, tiles.size() - b0);
+
+        scheduler.run(count, [&] (std::size_t n)
+        {
+            auto chunk = evaluate_as_unique((array | select(tiles[b0 + n])).get_provider());
+            auto source = reinterpret_cast<const unsigned char*>(chunk.data());
+            encoded[n] = detail::encode_chunk(source, chunk.size() * sizeof(value_type), sizeof(value_type), codec, shuffle);
+        });
+
+        for (std::size_t n = 0; n < count; ++n)
+        {
+            success = success && std::fwrite(encoded[n].data(), 1, encoded[n].size(), file) == encoded[n].size();
+            put_le(offset, 8);
+            put_le(encoded[n].size(), 8);
+            offset += encoded[n].size();
+        }
+    }
+    success = success && std::fseek(file, long(index_position), SEEK_SET) == 0;
+    success = success && std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+
+    if (std::fclose(file) != 0 || ! success)
+    {
+        throw std::runtime_error("failed to write file " + filename);
+    }
+}
+
+
+
+
+/**
+ * @brief      Open a file written by save_chunked as an array, whose chunks are
+ *             read on demand.
+ *
+ * @param[in]  filename      The name of the file to open
+ * @param[in]  cache_chunks  The number of decoded chunks to keep in memory
+ *
+ * @tparam     ValueType     The value type of the array, which must match the
+ *                           file
+ * @tparam     Rank          The rank of the array, which must match the file
+ *
+ * @return     An array with a chunked_provider_t
+ */
+template<typename ValueType, std::size_t Rank>
+auto nd::load_chunked(const std::string& filename, std::size_t cache_chunks)
+{
+    return make_array(chunked_provider_t<ValueType, Rank>(filename, cache_chunks));
+}
+
+
+
+
+//=============================================================================
+// Operator factories
+//=============================================================================
+
+
+
+
+/**
+ * @brief      Return an operator that attempts to reshape its argument array to
+ *             the given shape.
+ *
+ * @param[in]  new_shape  The new shape
+ *
+ * @tparam     Rank       The rank of the argument array
+ *
+ * @return     The operator
+ */
+template<std::size_t Rank>
+auto nd::reshape(shape_t<Rank> new_shape)
+{
+    return [new_shape] (auto&& array)
+    {
+        const auto& provider = array.get_provider();
+
+        if (new_shape.volume() != provider.size() && ! detail::is_uniform_array<decltype(array)>::value)
+        {
+            throw std::logic_error("cannot reshape array to a different size");
+        }
+        return make_array(provider.reshape(new_shape));
+    };
+}
+template<typename... Args>
+auto nd::reshape(Args... args)
+{
+    return reshape(make_shape(args...));
+}
+
+
+
+
+/**
+ * @brief      Return an operator that evaluates an array block by block, and
+ *             pushes each block to a sink, without ever holding more than one
+ *             block in memory. Blocks are generated as in partition_tiles (in
+ *             row-major order, truncated at the upper edges), and evaluated
+ *             into a single buffer which is reused for every block.
+ *
+ * @param[in]  sink         Either a function sink(region, data), called with
+ *                          the access pattern of each block and a pointer to
+ *                          its values in row-major order, or an object with a
+ *                          method write(const void* data, std::size_t bytes),
+ *                          such as a file_sink_t. Byte sinks receive the values
+ *                          of the whole array in row-major order, so the
+ *                          blocks must be contiguous in that order: every axis
+ *                          of the block shape after the first one that is
+ *                          shorter than the array, must span the whole array.
+ *                          A sink with a close() method is closed after the
+ *                          last block, and any exception it throws propagates.
+ *                          Pass std::ref(sink) to keep the sink open, and
+ *                          close it yourself.
+ * @param[in]  block_shape  The shape of the blocks
+ *
+ * @tparam     Sink         The type of the sink
+ * @tparam     Rank         The rank of the array
+ *
+ * @return     The operator. It keeps its sink, so applying it again goes on
+ *             writing to the same sink (unless it was closed), and if the
+ *             sink can be copied, it returns a copy of it after the last
+ *             block, so that a sink which accumulates a result can be
+ *             inspected.
+ */
+template<typename Sink, std::size_t Rank>
+auto nd::stream_to(Sink sink, shape_t<Rank> block_shape)
+{
+    return [sink=std::move(sink), block_shape] (auto&& array) mutable
+    {
+        using value_type = value_type_of<decltype(array)>;
+        using target_type = typename detail::sink_target<Sink>::type;
+        target_type& target = sink;
+        static_assert(std::decay_t<decltype(array)>::array_rank == Rank, "block shape must have the rank of the array");
+
+        auto shape = array.shape();
+        auto tile_counts = shape_t<Rank>();
+
+        for (std::size_t n = 0; n < Rank; ++n)
+        {
+            if (block_shape[n] == 0)
+            {
+                throw std::logic_error("block shape must be non-zero on every axis");
+            }
+            tile_counts[n] = (shape[n] + block_shape[n] - 1) / block_shape[n];
+        }
+        if constexpr (detail::is_byte_sink<target_type>::value)
+        {
+            if (! detail::is_row_major_block(shape, block_shape))
+            {
+                throw std::logic_error("blocks streamed to a byte sink must be contiguous in row-major order");
+            }
+        }
+        auto buffer = buffer_t<value_type>::uninitialized(std::min(block_shape.volume(), shape.volume()));
+
+        for (const auto& tile_index : make_access_pattern(tile_counts))
+        {
+            auto region = make_access_pattern(shape);
+
+            for (std::size_t n = 0; n < Rank; ++n)
+            {
+                region.start[n] = tile_index[n] * block_shape[n];
+                region.final[n] = std::min(region.start[n] + block_shape[n], shape[n]);
+            }
+            detail::advise_leaves(array.get_provider(), region, access_advice_t::sequential);
+            detail::evaluate_block(array.get_provider(), region, buffer.data());
+
+            if constexpr (detail::is_byte_sink<target_type>::value)
+            {
+                target.write(buffer.data(), region.size() * sizeof(value_type));
+            }
+            else
+            {
+                target(static_cast<const access_pattern_t<Rank>&>(region), static_cast<const value_type*>(buffer.data()));
+            }
+        }
+        if constexpr (detail::has_close<Sink>::value)
+        {
+            sink.close();
+        }
+        if constexpr (std::is_copy_constructible<Sink>::value)
+        {
+            return sink;
+        }
+    };
+}
+
+
+
+
+/**
+ * @brief      Return an operator that memoizes an array: its elements are
+ *             computed on first access, a tile at a time, and stored in a
+ *             cache shared by every copy of the result. Use it on expensive
+ *             sub-expressions which are read more than once, for example
+ *             B + (B | shift_by(1).along_axis(0)). Memory-backed arrays are
+ *             returned as they are.
+ *
+ * @param[in]  budget_bytes  The most memory the stored tiles may occupy
+ *
+ * @return     The operator
+ */
+auto nd::cache(std::size_t budget_bytes)
+{
+    return [budget_bytes] (auto array)
+    {
+        using provider_type = typename decltype(array)::provider_type;
+        using value_type = typename decltype(array)::value_type;
+
+        if constexpr (detail::is_strided_viewable<provider_type>::value)
+        {
+            return array;
+        }
+        else
+        {
+            auto tile_shape = make_tile_shape<value_type>(array.shape());
+            return make_array(cached_provider_t<provider_type>(array.get_provider(), tile_shape, budget_bytes));
+        }
+    };
+}
+
+
+
+
+/**
+ * @brief      Return an operator that applies a stencil, given by an array of
+ *             weights, to a memory-backed array. The weights array has the rank
+ *             of the array it is applied to, and an odd length 2r + 1 on each
+ *             axis, its center being the weight of the element itself. Only the
+ *             non-zero weights are visited.
+ *
+ * @param[in]  weights    The weights
+ * @param[in]  boundary   How to treat elements within the radius of the edges
+ *
+ * @tparam     ArrayType  The type of the weights array
+ *
+ * @return     The operator
+ *
+ * @example    auto w = nd::make_unique_array<double>(3, 3, 3);
+ *             w(1, 1, 1) = -6.0; w(0, 1, 1) = w(2, 1, 1) = 1.0; ...
+ *             auto laplacian = u | nd::stencil(w.shared(), nd::boundary_t::periodic);
+ */
+template<typename ArrayType>
+auto nd::stencil(ArrayType weights, boundary_t boundary)
+{
+    constexpr std::size_t Rank = std::decay_t<ArrayType>::array_rank;
+    using weight_type = value_type_of<ArrayType>;
+
+    auto kernel = detail::stencil_weights_t<weight_type, Rank>();
+    auto radius = index_t<Rank>();
+
+    for (std::size_t n = 0; n < Rank; ++n)
+    {
+        if (weights.shape(n) % 2 == 0)
+        {
+            throw std::logic_error("stencil weights must have an odd length on each axis");
+        }
+        radius[n] = weights.shape(n) / 2;
+    }
+
+    for_each_index(make_access_pattern(weights.shape()), [&] (const index_t<Rank>& index)
+    {
+        auto weight = weight_type(weights(index));
+
+        if (weight != weight_type())
+        {
+            auto delta = jumps_t<Rank>();
+
+            for (std::size_t n = 0; n < Rank; ++n)
+            {
+                delta[n] = long(index[n]) - long(radius[n]);
+            }
+            kernel.deltas.push_back(delta);
+            kernel.weights.push_back(weight);
+        }
+    });
+
+    return [kernel, radius, boundary] (auto array)
+    {
+        using array_type = decltype(array);
+        using value_type = typename array_type::value_type;
+        static_assert(array_type::array_rank == Rank, "stencil weights must have the rank of the array");
+        static_assert(detail::is_strided_viewable_array<array_type>::value, "stencils apply to memory-backed arrays: evaluate lazy arrays first");
+        return make_array(stencil_provider_t<value_type, Rank, decltype(kernel)>(array.get_provider().strided(), kernel, radius, boundary));
+    };
+}
+
+
+
+
+/**
+ * @brief      Return an operator that applies a stencil, given by a kernel
+ *             function, to a memory-backed array. The kernel is called with a
+ *             reader for each element, where reader(di, dj, ...) is the value
+ *             at that offset from the element; the offsets must be within the
+ *             given radius.
+ *
+ * @param[in]  kernel    The kernel
+ * @param[in]  radius    The largest offset the kernel reads on any axis
+ * @param[in]  boundary  How to treat elements within the radius of the edges
+ *
+ * @tparam     Function  The type of the kernel
+ *
+ * @return     The operator
+ *
+ * @example    auto dudx = u | nd::stencil([] (auto at) { return at(1, 0) - at(-1, 0); }, 1, nd::boundary_t::clamp);
+ */
+template<typename Function>
+auto nd::stencil(Function kernel, std::size_t radius, boundary_t boundary)
+{
+    return [kernel, radius, boundary] (auto array)
+    {
+        using array_type = decltype(array);
+        using value_type = typename array_type::value_type;
+        constexpr std::size_t Rank = array_type::array_rank;
+        static_assert(detail::is_strided_viewable_array<array_type>::value, "stencils apply to memory-backed arrays: evaluate lazy arrays first");
+        return make_array(stencil_provider_t<value_type, Rank, Function>(array.get_provider().strided(), kernel, make_uniform_index<Rank>(radius), boundary));
+    };
+}
+
+
+
+
+/**
+ * @brief      Return an operator that applies a stencil operator to an array a
+ *             number of times, and returns the result as a shared array. For
+ *             periodic and ghost boundaries, the steps are temporally blocked:
+ *             the array is cut into tiles, and each tile is advanced several
+ *             steps in a small working buffer (loaded with the halo those steps
+ *             depend on, which neighboring tiles compute redundantly), so a
+ *             pass of up to 8 steps reads and writes the array just once. The
+ *             result is identical to applying the stencil num_steps times.
+ *             With clamp and reflect boundaries, the steps are done one sweep
+ *             at a time.
+ *
+ * @param[in]  stencil          An operator returned by nd::stencil, whose
+ *                              kernel returns the value type of the array
+ * @param[in]  num_steps        The number of times to apply it
+ *
+ * @tparam     StencilOperator  The type of the stencil operator
+ *
+ * @return     The operator
+ *
+ * @example    auto v = u | nd::repeat_stencil(nd::stencil(heat_kernel, 1, nd::boundary_t::periodic), 20);
+ */
+template<typename StencilOperator>
+auto nd::repeat_stencil(StencilOperator stencil, std::size_t num_steps)
+{
+    return [stencil, num_steps] (auto array)
+    {
+        auto applied = array | stencil;
+        static_assert(detail::is_stencil_provider<typename decltype(applied)::provider_type>::value, "repeat_stencil needs a stencil operator");
+        return make_array(detail::evaluate_stencil_steps(applied.get_provider(), num_steps, nullptr));
+    };
+}
+
+
+
+
+/**
+ * @brief      Return an operator that applies a stencil operator to an array a
+ *             number of times, as above, advancing the tiles of each pass on
+ *             the workers of a tile scheduler.
+ *
+ * @param[in]  stencil          An operator returned by nd::stencil
+ * @param[in]  num_steps        The number of times to apply it
+ * @param      scheduler        The scheduler to run on
+ *
+ * @tparam     StencilOperator  The type of the stencil operator
+ *
+ * @return     The operator
+ */
+template<typename StencilOperator>
+auto nd::repeat_stencil(StencilOperator stencil, std::size_t num_steps, tile_scheduler_t& scheduler)
+{
+    return [stencil, num_steps, &scheduler] (auto array)
+    {
+        auto applied = array | stencil;
+        static_assert(detail::is_stencil_provider<typename decltype(applied)::provider_type>::value, "repeat_stencil needs a stencil operator");
+        return make_array(detail::evaluate_stencil_steps(applied.get_provider(), num_steps, &scheduler));
+    };
+}
+
+
+
+
+/**
+ * @brief      Return an operator that copies an array into the interior of a
+ *             new padded array, with ghost zones of the given width on each
+ *             axis. The ghost zones are value-initialized; fill them with
+ *             get_provider().fill_halo.
+ *
+ * @param[in]  ghost_width  The number of ghost zones on each side of each axis
+ *
+ * @tparam     Rank         The rank of the array
+ *
+ * @return     The operator
+ *
+ * @example    auto u = initial_data | nd::pad(2, 2, 2);
+ *             u.get_provider().fill_halo(nd::boundary_t::periodic);
+ */
+template<std::size_t Rank>
+auto nd::pad(shape_t<Rank> ghost_width)
+{
+    return [ghost_width] (auto array)
+    {
+        using value_type = typename decltype(array)::value_type;
+        static_assert(decltype(array)::array_rank == Rank, "ghost width must have the rank of the array");
+        auto provider = padded_provider_t<value_type, Rank>(array.shape(), ghost_width);
+        provider.assign_interior(array);
+        return make_array(std::move(provider));
+    };
+}
+
+template<typename... Args>
+auto nd::pad(Args... args)
+{
+    return pad(make_shape(args...));
+}
+
+
+
+
+/**
+ * @brief      Return an operator that gives the interior of a padded array,
+ *             as a zero-copy strided view.
+ *
+ * @return     The operator
+ */
+auto nd::interior()
+{
+    return [] (auto array)
+    {
+        return make_array(array.get_provider().interior_view());
+    };
+}
+
+
+
+
+/**
+ * @brief      Return an operator that, applied to any array will yield a
+ *             shared, memory-backed version of that array.
+ *
+ * @return     The operator
+ */
+auto nd::to_shared()
+{
+    return [] (auto&& array)
+    {
+        return make_array(evaluate_as_shared(array.get_provider()));
+    };
+}
+
+
+
+
+/**
+ * @brief      Return an operator that, applied to any array will yield a
+ *             unique, memory-backed version of that array.
+ *
+ * @return     The operator
+ */
+auto nd::to_unique()
+{
+    return [] (auto&& array)
+    {
+        return make_array(evaluate_as_unique(array.get_provider()));
+    };
+}
+
+
+
+
+/**
+ * @brief      Return an operator that evaluates its argument array to a
+ *             shared, memory-backed array using several threads from the
+ *             default thread pool. The work is split into num_threads tasks;
+ *             the pool itself is never grown, so no more than its threads
+ *             run at once.
+ *
+ * @param[in]  num_threads  The number of threads; zero means use the whole
+ *                          default pool
+ *
+ * @return     The operator
+ */
+auto nd::to_shared_parallel(std::size_t num_threads)
+{
+    return [num_threads] (auto&& array)
+    {
+        return make_array(evaluate_as_shared_parallel(array.get_provider(), num_threads));
+    };
+}
+
+auto nd::to_shared_parallel(thread_pool_t& pool)
+{
+    return [&pool] (auto&& array)
+    {
+        auto num_tasks = std::max(pool.size(), std::size_t(1));
+        return make_array(evaluate_as_shared_parallel(array.get_provider(), pool, num_tasks));
+    };
+}
+
+auto nd::to_shared_parallel(tile_scheduler_t& scheduler)
+{
+    return [&scheduler] (auto&& array)
+    {
+        return make_array(evaluate_as_shared_parallel(array.get_provider(), scheduler));
+    };
+}
+
+
+
+
+/**
+ * @brief      Return an operator that evaluates its argument array to a
+ *             shared, memory-backed array on a fixed number of threads.
+ *
+ * @tparam     NumThreads  The number of threads
+ *
+ * @return     The operator
+ */
+template<std::size_t NumThreads>
+auto nd::evaluate_on()
+{
+    return to_shared_parallel(NumThreads);
+}
+
+
+
+
+/**
+ * @brief      Return an operator that turns an array into a bounds-checking
+ *             array.
+ *
+ * @return     The array
+ */
+auto nd::bounds_check()
+{
+    return [] (auto&& array)
+    {
+        auto mapping = [array] (auto&& index)
+        {
+            if (! array.shape().contains(index))
+            {
+                throw std::out_of_range("index out-of-range");
+            }
+            return array(index);
+        };
+        return make_array(mapping, array.shape());
+    };
+}
+
+
+
+/**
+ * @brief      Return an operator that sums the elements of an array.
+ *
+ * @return     The operator
+ *
+ * @note       The return type is the same as the array value type, except if
+ *             it's bool - in which case the return type is unsigned long. The
+ *             sum is accumulated in blocks, which are then added together,
+ *             which is more accurate for floating point types than adding
+ *             each element to a single running total.
+ */
+auto nd::sum()
+{
+    return reduction_t<detail::sum_accumulator_t>();
+}
+
+
+
+
+/**
+ * @brief      Return a reduce operator that returns true if all of its
+ *             argument array's elements evaluate to true.
+ *
+ * @return     The operator
+ */
+auto nd::all()
+{
+    return reduction_t<detail::all_accumulator_t>();
+}
+
+
+
+
+/**
+ * @brief      Return a reduce operator that returns true if any of its
+ *             argument array's elements evaluate to true.
+ *
+ * @return     The operator
+ */
+auto nd::any()
+{
+    return reduction_t<detail::any_accumulator_t>();
+}
 
 
 
 
-template<typename ValueType, std::size_t Rank>
-auto nd::make_shared_provider(shape_t<Rank> shape)
+/**
+ * @brief      Return an operator that gets the minimum value of an array.
+ *
+ * @return     The operator
+ */
+auto nd::min()
 {
-    auto buffer = std::make_shared<buffer_t<ValueType>>(shape.volume());
-    return shared_provider_t<ValueType, Rank>(shape, buffer);
+    return reduction_t<detail::min_accumulator_t>();
 }
 
-template<typename ValueType, typename... Args>
-auto nd::make_shared_provider(Args... args)
+
+
+
+/**
+ * @brief      Return an operator that gets the maximum value of an array.
+ *
+ * @return     The operator
+ */
+auto nd::max()
 {
-    return make_shared_provider<ValueType>(make_shape(args...));
+    return reduction_t<detail::max_accumulator_t>();
 }
 
-template<typename ValueType, std::size_t Rank>
-auto nd::make_unique_provider(shape_t<Rank> shape)
+
+
+
+/**
+ * @brief      Return the minimum value of an array.
+ *
+ * @param      array      The array
+ *
+ * @tparam     ArrayType  The type of the array
+ *
+ * @return     The minimum value
+ */
+template<typename ArrayType>
+auto nd::min(ArrayType&& array)
 {
-    auto buffer = buffer_t<ValueType>(shape.volume());
-    return unique_provider_t<ValueType, Rank>(shape, std::move(buffer));
+    return min()(std::forward<ArrayType>(array));
 }
 
-template<typename ValueType, typename... Args>
-auto nd::make_unique_provider(Args... args)
+
+
+
+/**
+ * @brief      Return the maximum value of an array.
+ *
+ * @param      array      The array
+ *
+ * @tparam     ArrayType  The type of the array
+ *
+ * @return     The maximum value
+ */
+template<typename ArrayType>
+auto nd::max(ArrayType&& array)
 {
-    return make_unique_provider<ValueType>(make_shape(args...));
+    return max()(std::forward<ArrayType>(array));
 }
 
-template<typename Provider>
-auto nd::evaluate_as_unique(Provider&& source_provider)
+
+
+
+/**
+ * @brief      Return a 1d array of containing the indexes where the given array
+ *             evaluates to true
+ *
+ * @param      array      The array
+ *
+ * @tparam     ArrayType  The type of the argument array
+ *
+ * @return     An immutable, memory-backed 1d array of index_t<rank>, where rank
+ *             is the rank of the argument array
+ *
+ * @note       The array is evaluated only once: matches are collected as they
+ *             are found, rather than counted in a first pass and gathered in a
+ *             second.
+ */
+template<typename ArrayType>
+auto nd::where(ArrayType array)
 {
-    using value_type = typename std::remove_reference_t<Provider>::value_type;
-    auto target_shape = source_provider.shape();
-    auto target_accessor = make_access_pattern(target_shape);
-    auto target_provider = make_unique_provider<value_type>(target_shape);
+    return detail::compact_where<index_t<ArrayType::array_rank>>(array, nullptr, [] (const auto& index)
+    {
+        return index;
+    });
+}
+
+
 
-    for (auto index : target_accessor)
+
+/**
+ * @brief      Return the same indexes as where, computed on the default thread
+ *             pool. The array is cut into slabs along its first axis; each
+ *             worker collects the matches in its slabs into slab-local
+ *             buffers, and the buffers are concatenated at offsets given by a
+ *             prefix sum of their sizes. The indexes are in row-major order,
+ *             as in the serial version.
+ *
+ * @param      array        The array
+ * @param[in]  num_threads  The number of threads; zero means use the whole
+ *                          default pool
+ *
+ * @tparam     ArrayType    The type of the argument array
+ *
+ * @return     An immutable, memory-backed 1d array of index_t<rank>
+ */
+template<typename ArrayType>
+auto nd::where_parallel(ArrayType array, std::size_t num_threads)
+{
+    auto scheduler = tile_scheduler_t(num_threads);
+
+    return detail::compact_where<index_t<ArrayType::array_rank>>(array, &scheduler, [] (const auto& index)
     {
-        target_provider(index) = source_provider(index);
-    }
-    return target_provider;
+        return index;
+    });
 }
 
-template<typename Provider>
-auto nd::evaluate_as_shared(Provider&& provider)
+
+
+
+/**
+ * @brief      Return a 1d array of the flat (row-major) offsets where the given
+ *             array evaluates to true. This takes 1 / rank of the memory of the
+ *             result of where. For a memory-backed array with row-major layout,
+ *             the offsets index directly into its data.
+ *
+ * @param      array      The array
+ *
+ * @tparam     ArrayType  The type of the argument array
+ *
+ * @return     An immutable, memory-backed 1d array of std::size_t
+ */
+template<typename ArrayType>
+auto nd::where_offsets(ArrayType array)
 {
-    return evaluate_as_unique(std::forward<Provider>(provider)).shared();
+    auto strides = make_strides_row_major(array.shape());
+
+    return detail::compact_where<std::size_t>(array, nullptr, [strides] (const auto& index)
+    {
+        return strides.compute_offset(index);
+    });
 }
 
+template<typename ArrayType>
+auto nd::where_offsets_parallel(ArrayType array, std::size_t num_threads)
+{
+    auto scheduler = tile_scheduler_t(num_threads);
+    auto strides = make_strides_row_major(array.shape());
 
+    return detail::compact_where<std::size_t>(array, &scheduler, [strides] (const auto& index)
+    {
+        return strides.compute_offset(index);
+    });
+}
 
 
-//=============================================================================
-// Array factories
-//=============================================================================
+
+
+/**
+ * @brief      Return an operator that shifts an array along an axis
+ *
+ * @param[in]  delta  The amount to shift by
+ *
+ * @return     The operator
+ *
+ * @example    B = A | shift_by(-2).along_axis(1); // B(i, j) == A(i, j + 2)
+ */
+auto nd::shift_by(int delta)
+{
+    return axis_shifter_t(0, delta);
+}
 
 
 
 
 /**
- * @brief      Make an array from the given provider.
+ * @brief      Return an operator that freezes one index its argument array,
+ *             reducing its rank by 1.
  *
- * @param      provider  The provider
+ * @param[in]  axis_to_freeze  The axis to freeze
  *
- * @tparam     Provider  The type of the provider
+ * @return     The operator
+ */
+auto nd::freeze_axis(std::size_t axis_to_freeze)
+{
+    return axis_freezer_t<1>(make_index(axis_to_freeze));
+}
+
+
+
+
+/**
+ * @brief      Return a reducer operator, which can apply the given operator
+ *             along a given axis
  *
- * @return     The array
+ * @param      reduction     The reduction
+ *
+ * @tparam     OperatorType  The type of function object to be applied along an
+ *                           axis
+ *
+ * @return     The operator
  */
-template<typename Provider>
-auto nd::make_array(Provider&& provider)
+template<typename OperatorType>
+auto nd::collect(OperatorType reduction)
 {
-    return array_t<Provider>(std::forward<Provider>(provider));
+    return axis_reducer_t<OperatorType>(0, reduction);
 }
 
 
 
 
 /**
- * @brief      Make an array from the given index -> value mapping and shape.
+ * @brief      Return an operator that concats the given array onto another.
  *
- * @param[in]  mapping  The mapping
- * @param[in]  shape    The shape
+ * @param      array_to_concat  The array to concatenate
  *
- * @tparam     Mapping  The type of the index -> value mapping
- * @tparam     Rank     The rank of the array
+ * @tparam     ArrayType        The type of the array to concatenate
  *
- * @return     The array
+ * @return     The operator
  *
- * @note       The array uses the `basic_provider_t`, whose `operator()` is a
- *             const method, but which preserves the reference type of the
- *             mapping's return value. That is, if `mapping` returns a const
- *             reference then so does the returned array when indexed. The
- *             returned array has no `data` or `reshape` methods, and whose.
+ * @note       The returned operator will fail to compile if applied to arrays
+ *             of a different rank than the array to concatenate. It will throw
+ *             a logic_error if the array shapes are incompatible.
  */
-template<typename Mapping, std::size_t Rank>
-auto nd::make_array(Mapping mapping, shape_t<Rank> shape)
+template<typename ArrayType>
+auto nd::concat(ArrayType array_to_concat)
+{
+    return concatenator_t<ArrayType>(0, array_to_concat);
+}
+
+
+
+
+/**
+ * @brief      Reads an index from an array.
+ *
+ * @param[in]  index_to_read  The index to read
+ *
+ * @tparam     Rank           The rank of the array that can be read from
+ *
+ * @return     The operator
+ */
+template<std::size_t Rank>
+auto nd::read_index(index_t<Rank> index_to_read)
+{
+    return [index_to_read] (auto&& array)
+    {
+        return array(index_to_read);
+    };
+}
+template<typename... Args>
+auto nd::read_index(Args... args)
+{
+    return read_index(make_index(args...));
+}
+
+
+
+
+
+/**
+ * @brief      Return an operator that reorders the axes of an array, so that
+ *             B(i[axis_order[0]], i[axis_order[1]], ...) == A(i), that is, axis
+ *             n of B is axis axis_order[n] of A.
+ *
+ * @param[in]  axis_order  A permutation of [0, Rank)
+ *
+ * @tparam     Rank        The rank of the array to operate on
+ *
+ * @return     The operator
+ *
+ * @note       Applied to a memory-backed array, the result is a zero-copy
+ *             strided view. Evaluating that view to a memory-backed array uses
+ *             a cache-blocked copy.
+ */
+template<std::size_t Rank>
+auto nd::permute_axes(index_t<Rank> axis_order)
+{
+    auto sorted = axis_order;
+    std::sort(sorted.begin(), sorted.end());
+
+    if (sorted != index_t<Rank>::range())
+    {
+        throw std::logic_error("axis order must be a permutation of the array axes");
+    }
+
+    return [axis_order] (auto&& array)
+    {
+        static_assert(std::decay_t<decltype(array)>::array_rank == Rank, "axis order must have the same rank as the array");
+
+        auto shape = shape_t<Rank>();
+
+        for (std::size_t n = 0; n < Rank; ++n)
+        {
+            shape[n] = array.shape(axis_order[n]);
+        }
+
+        if constexpr (detail::is_uniform_array<decltype(array)>::value)
+        {
+            return make_array(array.get_provider().reshape(shape));
+        }
+        else if constexpr (detail::is_strided_viewable_array<decltype(array)>::value)
+        {
+            return make_array(array.get_provider().strided().permute(axis_order));
+        }
+        else
+        {
+            auto mapping = [axis_order, array] (auto&& index)
+            {
+                auto source_index = index_t<Rank>();
+
+                for (std::size_t n = 0; n < Rank; ++n)
+                {
+                    source_index[axis_order[n]] = index[n];
+                }
+                return array(source_index);
+            };
+            return make_array(mapping, shape);
+        }
+    };
+}
+
+template<typename... Args>
+auto nd::permute_axes(Args... args)
 {
-    return make_array(basic_provider_t<Mapping, Rank>(mapping, shape));
+    return permute_axes(make_index(args...));
 }
 
 
 
 
 /**
- * @brief      Create a 1-dimensional array from an iterable container
+ * @brief      Return an operator that generates an array B by indexing into a
+ *             source array A. B has the value type of A, but the shape of the
+ *             index array I. The value type of I must be index_t<A.rank()>.
  *
- * @param[in]  container      The container to source values from
+ * @param[in]  array_of_indexes  An N-dimensional array of M-dimensional indexes
  *
- * @tparam     ContainerType  The type of the container, std::vector, std::list,
- *                            std::array, etc.
+ * @tparam     ArrayType         The type of the index array
  *
- * @return     The array
+ * @return     The operator
  */
-template<typename ContainerType>
-auto nd::make_array_from(const ContainerType& container)
+template<typename ArrayType>
+auto nd::read_indexes(ArrayType array_of_indexes)
 {
-    auto shape = make_shape(container.size());
-    auto result = make_unique_array<typename ContainerType::value_type>(shape);
-    auto n = std::size_t(0);
-
-    for (auto source_value : container)
+    return [array_of_indexes] (auto array_to_index)
     {
-        result(n++) = source_value;
-    }
-    return std::move(result).shared();
+        detail::advise_leaves(array_to_index.get_provider(), access_advice_t::random);
+
+        auto mapping = [array_of_indexes, array_to_index] (auto&& index)
+        {
+            return array_to_index(array_of_indexes(index));
+        };
+        return make_array(mapping, array_of_indexes.shape());
+    };
 }
 
 
 
 
 /**
- * @brief      Make a shared (immutable, copyable, memory-backed) array with the
- *             given shape, initialized to the default-constructed ValueType.
+ * @brief      Return an operator that selects a subset of an array.
  *
- * @param[in]  shape      The shape
+ * @param[in]  region_to_select  The region to select
  *
- * @tparam     ValueType  The value type of the array
- * @tparam     Rank       The rank of the array
+ * @tparam     Rank              Rank of both the source and target arrays
  *
- * @return     The array
+ * @return     The operator
  */
-template<typename ValueType, std::size_t Rank>
-auto nd::make_shared_array(shape_t<Rank> shape)
+template<std::size_t Rank>
+auto nd::select(access_pattern_t<Rank> region_to_select)
 {
-    return make_array(make_shared_provider<ValueType>(shape));
+    return selector_t<Rank>(region_to_select);
 }
 
-template<typename ValueType, typename... Args>
-auto nd::make_shared_array(Args... args)
+auto nd::select_axis(std::size_t axis_to_select)
 {
-    return make_array(make_shared_provider<ValueType>(args...));
+    return axis_selector_t(axis_to_select, 0, 0, 1, false);
 }
 
 
 
 
 /**
- * @brief      Return an array with the i-th tuple index of all the elements
- *             (maps std::get<Index>) over the array).
+ * @brief      Replace a subset of an array with the contents of another.
  *
- * @param[in]  array      The array of std::tuple (or std::array)
+ * @param[in]  region_to_replace  The region to replace
+ * @param      replacement_array  The replacement array
  *
- * @tparam     Index      The tuple index
- * @tparam     ArrayType  The type of the array
+ * @tparam     Rank               Rank of both the array to patch and the
+ *                                replacement array
+ * @tparam     ArrayType          The type of the replacement array
  *
- * @return     The array
+ * @return     A function returning arrays which map their indexes to the
+ *             replacement_array, if those indexes are in the region to replace
  */
-template<std::size_t Index, typename ArrayType>
-auto nd::get(ArrayType array)
+template<std::size_t Rank, typename ArrayType>
+auto nd::replace(access_pattern_t<Rank> region_to_replace, ArrayType replacement_array)
 {
-    return detail::get_through<Index>(array);
+    return replacer_t<Rank, ArrayType>(region_to_replace, replacement_array);
 }
 
 
 
 
 /**
- * @brief      Make a unique (mutable, non-copyable, memory-backed) array with
- *             the given shape.
+ * @brief      Return a select operator starting at the given index.
  *
- * @param[in]  shape      The shape
+ * @param[in]  starting_index  The starting index
  *
- * @tparam     ValueType  The value type of the array
- * @tparam     Rank       The rank of the array
+ * @tparam     Rank            The rank of the array to operate on
  *
- * @return     The array
+ * @return     The operator
  */
-template<typename ValueType, std::size_t Rank>
-auto nd::make_unique_array(shape_t<Rank> shape)
+template<std::size_t Rank>
+auto nd::select_from(index_t<Rank> starting_index)
 {
-    return make_array(make_unique_provider<ValueType>(shape));
+    return selector_t<Rank>().from(starting_index);
 }
 
-template<typename ValueType, typename... Args>
-auto nd::make_unique_array(Args... args)
+template<typename... Args>
+auto nd::select_from(Args... args)
 {
-    return make_array(make_unique_provider<ValueType>(args...));
+    return select_from(make_index(args...));
 }
 
 
 
 
 /**
- * @brief      Return an index-array of the given shape, mapping the index (i,
- *             j, ...) to itself.
+ * @brief      Return a replace operator starting at the begin index.
  *
- * @param[in]  shape  The shape
+ * @param[in]  starting_index  The starting index
  *
- * @tparam     Rank   The rank of the array
+ * @tparam     Rank            The rank of the array to operate on
  *
- * @return     The array
+ * @return     The operator
  */
 template<std::size_t Rank>
-auto nd::index_array(shape_t<Rank> shape)
+auto nd::replace_from(index_t<Rank> starting_index)
 {
-    auto mapping = [] (auto&& index) { return index; };
-    return make_array(basic_provider_t<decltype(mapping), Rank>(mapping, shape));
+    auto zeros = make_array([] (auto) { return 0; }, make_uniform_shape<Rank>(1));
+    return replacer_t<Rank, decltype(zeros)>({}, zeros).from(starting_index);
 }
+
 template<typename... Args>
-auto nd::index_array(Args... args)
+auto nd::replace_from(Args... args)
 {
-    return index_array(make_shape(args...));
+    return replace_from(make_index(args...));
 }
 
 
 
 
 /**
- * @brief      Zip a sequence identically-shaped arrays together
+ * @brief      Return an operator that maps the values of an array using the
+ *             given function object.
  *
- * @param      arrays      The arrays
+ * @param      function  The function
  *
- * @tparam     ArrayTypes  The types of the arrays
+ * @tparam     Function  The type of the function object
  *
- * @return     An array which returns tuples taken from the underlying arrays
+ * @return     The operator
+ *
+ * @note       This is the N-dimensional version of the transform operator
  */
-template<typename... ArrayTypes>
-auto nd::zip(ArrayTypes... arrays)
+template<typename Function>
+auto nd::map(Function function)
 {
-    constexpr std::size_t Ranks[] = {ArrayTypes::array_rank...};
-    shape_t<Ranks[0]> shapes[] = {arrays.shape()...};
-
-    if (std::adjacent_find(std::begin(shapes), std::end(shapes), std::not_equal_to<>()) != std::end(shapes))
-    {
-        throw std::logic_error("cannot zip arrays with different shapes");
-    }
-    auto mapping = [arrays...] (auto&& index)
+    return [function] (auto array)
     {
-        return std::make_tuple(arrays(index)...);
+        using provider_type = typename decltype(array)::provider_type;
+
+        if constexpr (detail::is_uniform_provider<provider_type>::value)
+        {
+            using value_type = std::decay_t<std::invoke_result_t<Function, const typename provider_type::value_type&>>;
+            return make_array(uniform_provider_t<value_type, provider_type::provider_rank>(function(array.get_provider().value()), array.shape()));
+        }
+        else
+        {
+            return make_array(elementwise_provider_t<Function, provider_type>(function, array.get_provider()));
+        }
     };
-    return make_array(mapping, shapes[0]);
 }
 
 
 
 
 /**
- * @brief      Turn an array of tuples into a tuple of arrays
+ * @brief      Return an operator that calls std::apply(fn, arg) for each arg in
+ *             the operand array. The value type of that array must be some type
+ *             of std::tuple.
  *
- * @param[in]  array      The array of tuples
+ * @param[in]  fn        The function
  *
- * @tparam     ArrayType  The type of the argument array
+ * @tparam     Function  The type of the function object
  *
- * @return     The tuple of arrays
+ * @return     The operator
  */
-template<typename ArrayType>
-auto nd::unzip(ArrayType array)
+template<typename Function>
+auto nd::apply(Function fn)
 {
-    auto Is = std::make_index_sequence<std::tuple_size<typename ArrayType::value_type>::value>();
-    return detail::unzip_array_impl(array, Is);
+    return [fn] (auto array)
+    {
+        return array | nd::map([fn] (auto args) { return std::apply(fn, args); });
+    };
 }
 
 
 
 
 /**
- * @brief      Return an array that is the cartesian product of the argument
- *             arrays, A(i, j, k) == make_tuple(a(i), b(j), c(k))
+ * @brief      Return a function that operates on two arrays, given a function
+ *             that operates on their value types. The arrays are broadcast
+ *             against each other, so they may have different ranks, and axes
+ *             of size 1 are repeated to match the other array.
  *
- * @param[in]  arrays      A sequence of 1d arrays
+ * @param      function  The function
  *
- * @tparam     ArrayTypes  The types of the argument arrays
+ * @tparam     Function  The function type
  *
- * @return     The array
+ * @return     The operator
  */
-template<typename... ArrayTypes>
-auto nd::cartesian_product(ArrayTypes... arrays)
+template<typename Function>
+auto nd::binary_op(Function function)
 {
-    shape_t<sizeof...(ArrayTypes)> shape = {arrays.size()...};
+    return [function] (auto A, auto B)
+    {
+        using provider_a = typename decltype(A)::provider_type;
+        using provider_b = typename decltype(B)::provider_type;
+
+        if constexpr (detail::is_uniform_provider<provider_a>::value && detail::is_uniform_provider<provider_b>::value)
+        {
+            constexpr std::size_t rank = std::max(provider_a::provider_rank, provider_b::provider_rank);
+            using value_type = std::decay_t<std::invoke_result_t<Function, const typename provider_a::value_type&, const typename provider_b::value_type&>>;
+            auto shape = detail::broadcast_shapes<rank>(A.shape(), B.shape());
+            return make_array(uniform_provider_t<value_type, rank>(function(A.get_provider().value(), B.get_provider().value()), shape));
+        }
+        else
+        {
+            return make_array(elementwise_provider_t<Function, provider_a, provider_b>(function, A.get_provider(), B.get_provider()));
+        }
+    };
+}
+
+
+
+
+//=============================================================================
+// The array class itself
+//=============================================================================
+
+
+
+
+/**
+ * @brief      The actual array class template
+ *
+ * @tparam     Rank      The array dimensionality
+ * @tparam     Provider  Type defining the index space and mapping from indexes
+ *                       to values
+ */
+template<typename Provider>
+class nd::array_t
+{
+public:
+
+
+
+    //=========================================================================
+    using provider_type = Provider;
+    using value_type = typename Provider::value_type;
+    using is_ndarray = std::true_type;
+    static constexpr std::size_t array_rank = Provider::provider_rank;
+
+
+
+
+    // iterator
+    //=========================================================================
+    struct iterator
+    {
+        using iterator_category = std::input_iterator_tag;
+        using value_type = typename Provider::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = value_type*;
+        using reference = value_type&;
+
+        iterator& operator++() { ++current; return *this; }
+        bool operator==(const iterator& other) const { return current == other.current; }
+        bool operator!=(const iterator& other) const { return current != other.current; }
+        decltype(auto) operator*() const { return array(*current); }
+
+        array_t array;
+        typename access_pattern_t<array_rank>::iterator current;
+    };
+
+
+
+
+    //=========================================================================
+    array_t() {}
+    array_t(Provider&& provider) : provider(std::move(provider)) {}
 
-    auto mapping = [arrays...] (auto&& index)
-    {
-        return detail::zip_apply_tuple(std::forward_as_tuple(arrays...), index.as_tuple());
-    };
-    return make_array(mapping, shape);
-}
 
 
 
+    // indexing functions
+    //=========================================================================
+    template<typename... Args> decltype(auto) operator()(Args... args) const { return provider(make_index(args...)); }
+    template<typename... Args> decltype(auto) operator()(Args... args)       { return provider(make_index(args...)); }
+    decltype(auto) operator()(const index_t<array_rank>& index) const { return provider(index); }
+    decltype(auto) operator()(const index_t<array_rank>& index)       { return provider(index); }
+    decltype(auto) data()     const    { return provider.data(); }
+    decltype(auto) data()              { return provider.data(); }
+    decltype(auto) begin()    const    { return iterator {*this, indexes().begin()}; }
+    decltype(auto) end()      const    { return iterator {*this, indexes().end()}; }
+    constexpr std::size_t rank() const { return array_rank; }
 
-/**
- * @brief      Return a tuple of N-dimensional arrays, given N 1d arrays
- *
- * @param[in]  arrays      The arrays
- *
- * @tparam     ArrayTypes  The types of the input arrays
- *
- * @return     The tuple of arrays
- */
-template<typename... ArrayTypes>
-auto nd::meshgrid(ArrayTypes... arrays)
-{
-    return unzip(cartesian_product(arrays...));
-}
 
 
 
+    // query functions and operator support
+    //=========================================================================
+    auto shape() const { return provider.shape(); }
+    auto shape(std::size_t axis) const { return provider.shape()[axis]; }
+    auto size() const { return provider.size(); }
+    auto indexes() const { return make_access_pattern(provider.shape()); }
+    const Provider& get_provider() const { return provider; }
+    template<typename Function> auto operator|(Function&& fn) const & { return fn(*this); }
+    template<typename Function> auto operator|(Function&& fn)      && { return fn(std::move(*this)); }
 
-/**
- * @brief      Return an array of zeros with the given shape
- *
- * @param[in]  args       shape arguments
- *
- * @tparam     ValueType  Defaults to int; use e.g. zeros<double>(...) for other
- *                        types
- * @tparam     Args       Argument types (should be a positive integral type)
- *
- * @return     An array of zeros, only requiring storage for a single element
- */
-template<typename ValueType, typename... Args>
-auto nd::zeros(Args... args)
-{
-    return make_array([] (auto) { return ValueType(0); }, make_shape(std::size_t(args)...));
-}
 
 
 
+    // methods converting this to a memory-backed array
+    //=========================================================================
+    auto unique() const { return make_array(evaluate_as_unique(provider)); }
+    auto shared() const { return make_array(evaluate_as_shared(provider)); }
+    auto unique_parallel(std::size_t num_threads=0) const { return make_array(evaluate_as_unique_parallel(provider, num_threads)); }
+    auto shared_parallel(std::size_t num_threads=0) const { return make_array(evaluate_as_shared_parallel(provider, num_threads)); }
 
-/**
- * @brief      Return an array of ones with the given shape
- *
- * @param[in]  args       shape arguments
- *
- * @tparam     ValueType  Defaults to int; use e.g. ones<double>(...) for other
- *                        types
- * @tparam     Args       Argument types (should be a positive integral type)
- *
- * @return     An array of ones, only requiring storage for a single element.
- */
-template<typename ValueType, typename... Args>
-auto nd::ones(Args... args)
-{
-    return make_array([] (auto) { return ValueType(1); }, make_shape(std::size_t(args)...));
-}
 
 
 
+    // arithmetic operators
+    //=========================================================================
+    template<typename T> auto operator+(T&& A) const { return bin_op(std::forward<T>(A), std::plus<>()); }
+    template<typename T> auto operator-(T&& A) const { return bin_op(std::forward<T>(A), std::minus<>()); }
+    template<typename T> auto operator*(T&& A) const { return bin_op(std::forward<T>(A), std::multiplies<>()); }
+    template<typename T> auto operator/(T&& A) const { return bin_op(std::forward<T>(A), std::divides<>()); }
+    template<typename T> auto operator&&(T&& A) const { return bin_op(std::forward<T>(A), std::logical_and<>()); }
+    template<typename T> auto operator||(T&& A) const { return bin_op(std::forward<T>(A), std::logical_or<>()); }
+    template<typename T> auto operator==(T&& A) const { return bin_op(std::forward<T>(A), std::equal_to<>()); }
+    template<typename T> auto operator!=(T&& A) const { return bin_op(std::forward<T>(A), std::not_equal_to<>()); }
+    template<typename T> auto operator<=(T&& A) const { return bin_op(std::forward<T>(A), std::less_equal<>()); }
+    template<typename T> auto operator>=(T&& A) const { return bin_op(std::forward<T>(A), std::greater_equal<>()); }
+    template<typename T> auto operator<(T&& A) const { return bin_op(std::forward<T>(A), std::less<>()); }
+    template<typename T> auto operator>(T&& A) const { return bin_op(std::forward<T>(A), std::greater<>()); }
+    auto operator+() const { return *this | map([] (auto&& x) { return +x; }); }
+    auto operator-() const { return *this | map([] (auto&& x) { return -x; }); }
+    auto operator!() const { return *this | map(std::logical_not<>()); }
 
-/**
- * @brief      Try to promote the argument to an array of the given shape
- *
- * @param      arg    The argument
- * @param[in]  shape  The shape
- *
- * @tparam     Arg    The argument type
- * @tparam     Rank   The rank of the shape to promote the argument to
- *
- * @return     An array with the given shape
- */
-template<typename Arg, std::size_t Rank>
-auto nd::promote(Arg arg, nd::shape_t<Rank> shape)
-{
-    if constexpr (detail::has_typedef_is_ndarray<Arg>::value)
-    {
-        return arg;
-    }
-    else
+
+
+
+private:
+    //=========================================================================
+    template<typename OtherType, typename Function>
+    auto bin_op(OtherType&& other, Function&& function) const
     {
-        return make_array([arg] (auto) { return arg; }, shape);
+        auto F = binary_op(std::forward<Function>(function));
+        auto B = promote(std::forward<OtherType>(other), shape());
+        return F(*this, std::move(B));
     }
-}
+    Provider provider;
+};
 
 
 
 
 //=============================================================================
-// Operator factories
+// non-template operators
 //=============================================================================
 
 
 
 
 /**
- * @brief      Return an operator that attempts to reshape its argument array to
- *             the given shape.
- *
- * @param[in]  new_shape  The new shape
+ * @brief      Return a 1d array [0 .. count - 1]
  *
- * @tparam     Rank       The rank of the argument array
+ * @param[in]  count  The number of elements
  *
- * @return     The operator
+ * @return     The array, not requiring any storage
  */
-template<std::size_t Rank>
-auto nd::reshape(shape_t<Rank> new_shape)
-{
-    return [new_shape] (auto&& array)
-    {
-        const auto& provider = array.get_provider();
-
-        if (new_shape.volume() != provider.size())
-        {
-            throw std::logic_error("cannot reshape array to a different size");
-        }
-        return make_array(provider.reshape(new_shape));
-    };
-}
-template<typename... Args>
-auto nd::reshape(Args... args)
+auto nd::arange(int count)
 {
-    return reshape(make_shape(args...));
+    return make_array([] (auto index) { return index[0]; }, nd::make_shape(count));
 }
 
 
 
 
 /**
- * @brief      Return an operator that, applied to any array will yield a
- *             shared, memory-backed version of that array.
+ * @brief      Return a 1d array [start, start + skip .. count - 1]
  *
- * @return     The operator
+ * @param[in]  start      The starting element
+ * @param[in]  final      The final element (one past the end)
+ * @param[in]  step       The step size
+ *
+ * @return     The array, not requiring any storage
  */
-auto nd::to_shared()
+auto nd::arange(int start, int final, int step)
 {
-    return [] (auto&& array)
+    if (step == 0 || final / step - start / step < 0)
     {
-        return make_array(evaluate_as_shared(array.get_provider()));
-    };
+        throw std::invalid_argument("nd::range");
+    }
+    return make_array([=] (auto index)
+    {
+        return start + index[0] * step;
+    }, nd::make_shape(final / step - start / step));
 }
 
 
 
 
 /**
- * @brief      Return an operator that, applied to any array will yield a
- *             unique, memory-backed version of that array.
+ * @brief      Return a 1d array of equally spaced values
  *
- * @return     The operator
+ * @param[in]  x0         The starting value
+ * @param[in]  x1         The final value (inclusive)
+ * @param[in]  count      The number of elements in the return array
+ *
+ * @tparam     ValueType  The value type
+ *
+ * @return     The array
  */
-auto nd::to_unique()
+auto nd::linspace(double x0, double x1, std::size_t count)
 {
-    return [] (auto&& array)
+    auto mapping = [x0, x1, count] (auto index)
     {
-        return make_array(evaluate_as_unique(array.get_provider()));
+        return x0 + (x1 - x0) * index[0] / (count - 1);
     };
+    return make_array(mapping, make_shape(count));
 }
 
 
 
 
 /**
- * @brief      Return an operator that turns an array into a bounds-checking
+ * @brief      Return an operator that breaks up a 1d array into a 1d ragged
+ *             array of size num_groups, whose elements are arrays with
+ *             equitable size and whose disjoint union equals the original
  *             array.
  *
- * @return     The array
+ * @param[in]  num_groups  The number groups to divvy up on
+ *
+ * @return     The operator
+ * @note       This function is useful for parallelization tasks.
  */
-auto nd::bounds_check()
+auto nd::divvy(std::size_t num_groups)
 {
-    return [] (auto&& array)
+    return [num_groups] (auto array)
     {
-        auto mapping = [array] (auto&& index)
+        static_assert(array.rank() == 1, "can only divvy a 1d array");
+
+        return make_array([num_groups, array] (auto group_index)
         {
-            if (! array.shape().contains(index))
+            std::size_t start = (group_index[0] + 0) * array.size() / num_groups;
+            std::size_t final = (group_index[0] + 1) * array.size() / num_groups;
+
+            return make_array([array, start] (auto element_index)
             {
-                throw std::out_of_range("index out-of-range");
-            }
-            return array(index);
-        };
-        return make_array(mapping, array.shape());
+                return array(start + element_index[0]);
+            }, make_shape(final - start));
+        }, make_shape(num_groups));
     };
 }
 
 
 
-/**
- * @brief      Return an operator that sums the elements of an array.
- *
- * @return     The operator
- *
- * @note       The return type is the same as the array value type, except if
- *             it's bool - in which case the return type is unsigned long.
- */
-auto nd::sum()
-{
-    return [] (auto&& array)
-    {
-        using value_type = value_type_of<decltype(array)>;
-        using is_boolean = std::is_same<value_type, bool>;
-        using result_type = std::conditional_t<is_boolean::value, unsigned long, value_type>;
 
-        auto result = result_type();
-
-        for (const auto& i : array.indexes())
-        {
-            result += array(i);
-        }
-        return result;
-    };
-}
+//=============================================================================
+// to_string overloads
+//=============================================================================
 
 
 
 
-/**
- * @brief      Return a reduce operator that returns true if all of its
- *             argument array's elements evaluate to true.
- *
- * @return     The operator
- */
-auto nd::all()
+template<std::size_t Rank>
+auto nd::to_string(const index_t<Rank>& index)
 {
-    return [] (auto&& array)
+    auto result = std::string("[ ");
+
+    for (std::size_t axis = 0; axis < Rank; ++axis)
     {
-        for (const auto& i : array.indexes()) if (! array(i)) return false;
-        return true;
-    };
+        result += std::to_string(index[axis]) + " ";
+    }
+    return result + "]";
 }
 
+template<std::size_t Rank>
+auto nd::to_string(const shape_t<Rank>& index)
+{
+    auto result = std::string("< ");
 
+    for (std::size_t axis = 0; axis < Rank; ++axis)
+    {
+        result += std::to_string(index[axis]) + " ";
+    }
+    return result + ">";
+}
 
-
-/**
- * @brief      Return a reduce operator that returns true if any of its
- *             argument array's elements evaluate to true.
- *
- * @return     The operator
- */
-auto nd::any()
+template<std::size_t Rank>
+auto nd::to_string(const access_pattern_t<Rank>& region)
 {
-    return [] (auto&& array)
-    {
-        for (const auto& i : array.indexes()) if (array(i)) return true;
-        return false;
-    };
+    return to_string(region.start) + " -> " + to_string(region.final);
 }
 
 
 
 
+//=============================================================================
+// Helper functions
+//=============================================================================
+
 
-/**
- * @brief      Return an operator that gets the minimum value of an array.
- *
- * @return     The operator
- */
-auto nd::min()
-{
-    return [] (auto&& array) { return min(std::forward<decltype(array)>(array)); };
-}
 
 
+template<std::size_t Index, typename ArrayType>
+auto nd::detail::get_through(const ArrayType& array)
+{
+    return make_array([array] (auto index) { return std::get<Index>(array(index)); }, array.shape());
+};
 
+template<typename Function, typename Tuple, std::size_t... Is>
+auto nd::detail::transform_tuple_impl(Function&& fn, const Tuple& t, std::index_sequence<Is...>)
+{
+    return std::make_tuple(fn(std::get<Is>(t))...);
+}
 
-/**
- * @brief      Return an operator that gets the maximum value of an array.
- *
- * @return     The operator
- */
-auto nd::max()
+template<typename Function, typename Tuple>
+auto nd::detail::transform_tuple(Function&& fn, const Tuple& t)
 {
-    return [] (auto&& array) { return max(std::forward<decltype(array)>(array)); };
+    return transform_tuple_impl(std::forward<Function>(fn), t, std::make_index_sequence<std::tuple_size<Tuple>::value>());
 }
 
+template<typename FunctionTuple, typename ArgumentTuple, std::size_t... Is>
+auto nd::detail::zip_apply_tuple_impl(FunctionTuple&& fn, ArgumentTuple&& args, std::index_sequence<Is...>)
+{
+    return std::make_tuple(std::get<Is>(fn)(std::get<Is>(args))...);
+}
 
+template<typename FunctionTuple, typename ArgumentTuple>
+auto nd::detail::zip_apply_tuple(FunctionTuple&& fn, ArgumentTuple&& args)
+{
+    return zip_apply_tuple_impl(
+        std::forward<FunctionTuple>(fn),
+        std::forward<ArgumentTuple>(args),
+        std::make_index_sequence<std::tuple_size<ArgumentTuple>::value>());
+}
 
+template<typename ArrayType, std::size_t... Is>
+auto nd::detail::unzip_array_impl(ArrayType array, std::index_sequence<Is...>)
+{
+    return std::make_tuple(get_through<Is>(array)...);
+}
 
-/**
- * @brief      Return the minimum value of an array.
- *
- * @param      array      The array
- *
- * @tparam     ArrayType  The type of the array
- *
- * @return     The minimum value
- */
-template<typename ArrayType>
-auto nd::min(ArrayType&& array)
+template<typename ResultSequence, typename SourceSequence, typename IndexContainer, typename Sequence>
+auto nd::detail::insert_elements(const SourceSequence& source, IndexContainer indexes, Sequence values)
 {
-    auto result = value_type_of<ArrayType>();
-    auto first = true;
+    static_assert(indexes.size() == values.size());
+
+    auto source1_n = std::size_t(0);
+    auto source2_n = std::size_t(0);
+    auto result = ResultSequence();
 
-    for (const auto& i : array.indexes())
+    for (std::size_t n = 0; n < result.size(); ++n)
     {
-        if (first || array(i) < result)
+        if (std::find(std::begin(indexes), std::end(indexes), n) == std::end(indexes))
+        {
+            result[n] = source[source1_n++];
+        }
+        else
         {
-            result = array(i);
+            result[n] = values[source2_n++];
         }
-        first = false;
     }
     return result;
 }
 
-
-
-
-/**
- * @brief      Return the maximum value of an array.
- *
- * @param      array      The array
- *
- * @tparam     ArrayType  The type of the array
- *
- * @return     The maximum value
- */
-template<typename ArrayType>
-auto nd::max(ArrayType&& array)
+template<typename Function, typename... Args>
+bool nd::detail::invoke_and_continue(Function&& fn, Args&&... args)
 {
-    auto result = value_type_of<ArrayType>();
-    auto first = true;
+    if constexpr (std::is_same<std::invoke_result_t<Function, Args...>, bool>::value)
+    {
+        return fn(std::forward<Args>(args)...);
+    }
+    else
+    {
+        fn(std::forward<Args>(args)...);
+        return true;
+    }
+}
 
-    for (const auto& i : array.indexes())
+template<typename SourceProvider, typename TargetProvider, std::size_t Rank>
+void nd::detail::evaluate_region(const SourceProvider& source, TargetProvider& target, const access_pattern_t<Rank>& region)
+{
+    if constexpr (is_strided_provider<SourceProvider>::value)
     {
-        if (first || array(i) > result)
+        if (evaluate_region_blocked(source, target, region))
         {
-            result = array(i);
+            return;
         }
-        first = false;
     }
-    return result;
-}
+    if constexpr (is_stencil_provider<SourceProvider>::value)
+    {
+        auto strides = make_strides_row_major(target.shape());
+
+        for (const auto& block : source.cache_blocks(region))
+        {
+            for_each_row(block, [&] (const index_t<Rank>& index, std::size_t count)
+            {
+                source.evaluate_row(index, count, target.data() + strides.compute_offset(index));
+            });
+        }
+        return;
+    }
+    auto strides = make_strides_row_major(target.shape());
+    auto start = region.start[Rank - 1];
 
+    for_each_row(region, [&] (index_t<Rank> index, std::size_t count)
+    {
+        auto row = target.data() + strides.compute_offset(index);
 
+        if constexpr (is_strided_provider<SourceProvider>::value)
+        {
+            auto source_row = source.data() + source.offset(index);
+            auto source_jump = source.strides()[Rank - 1];
 
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                row[i] = source_row[std::ptrdiff_t(i) * source_jump];
+            }
+        }
+        else
+        {
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                index[Rank - 1] = start + i;
+                row[i] = source(index);
+            }
+        }
+    });
+}
 
 /**
- * @brief      Return a 1d array of containing the indexes where the given array
- *             evaluates to true
- *
- * @param      array      The array
- *
- * @tparam     ArrayType  The type of the argument array
- *
- * @return     An immutable, memory-backed 1d array of index_t<rank>, where rank
- *             is the rank of the argument array
+ * Copy a region of a strided source into a row-major target, in square blocks
+ * spanning the target's last axis and the source's fastest-varying axis, so
+ * that both reads and writes stay within a few cache lines (e.g. transposes).
+ * Returns false, doing nothing, if the source's last axis is already its
+ * fastest-varying one.
  */
-template<typename ArrayType>
-auto nd::where(ArrayType array)
+template<typename SourceProvider, typename TargetProvider, std::size_t Rank>
+bool nd::detail::evaluate_region_blocked(const SourceProvider& source, TargetProvider& target, const access_pattern_t<Rank>& region)
 {
-    auto bool_array = array | map([] (auto x) { return bool(x); });
-    auto index_list = make_unique_array<index_t<bool_array.rank()>>(bool_array | sum());
+    using value_type = typename SourceProvider::value_type;
+    constexpr std::size_t L = Rank - 1;
+    constexpr std::size_t block = sizeof(value_type) <= 4 ? 64 : sizeof(value_type) <= 8 ? 32 : 16;
 
-    std::size_t n = 0;
+    auto source_strides = source.strides();
+    auto target_strides = make_strides_row_major(target.shape());
+    auto region_shape = region.shape();
+    auto a = L;
 
-    for (auto index : bool_array.indexes())
+    for (std::size_t n = 0; n < L; ++n)
     {
-        if (bool_array(index))
+        if (region_shape[n] > 1 && std::abs(source_strides[n]) < std::abs(source_strides[a]))
         {
-            index_list(n++) = index;
+            a = n;
         }
     }
-    return index_list.shared();
-}
+    if (a == L || region_shape[L] <= 1)
+    {
+        return false;
+    }
 
+    auto outer = region;
+    outer.final[a] = outer.start[a] + 1;
+    outer.final[L] = outer.start[L] + 1;
 
+    auto sa = source_strides[a];
+    auto sL = source_strides[L];
+    auto ta = std::ptrdiff_t(target_strides[a]);
 
+    for_each_index(outer, [&] (const index_t<Rank>& index)
+    {
+        auto source_base = source.data() + source.offset(index);
+        auto target_base = target.data() + target_strides.compute_offset(index);
 
-/**
- * @brief      Return an operator that shifts an array along an axis
- *
- * @param[in]  delta  The amount to shift by
- *
- * @return     The operator
- *
- * @example    B = A | shift_by(-2).along_axis(1); // B(i, j) == A(i, j + 2)
- */
-auto nd::shift_by(int delta)
-{
-    return axis_shifter_t(0, delta);
+        for (std::size_t i0 = 0; i0 < region_shape[a]; i0 += block)
+        {
+            for (std::size_t j0 = 0; j0 < region_shape[L]; j0 += block)
+            {
+                auto i1 = std::min(i0 + block, region_shape[a]);
+                auto j1 = std::min(j0 + block, region_shape[L]);
+
+                for (std::size_t i = i0; i < i1; ++i)
+                {
+                    auto source_row = source_base + std::ptrdiff_t(i) * sa;
+                    auto target_row = target_base + std::ptrdiff_t(i) * ta;
+
+                    for (std::size_t j = j0; j < j1; ++j)
+                    {
+                        target_row[j] = source_row[std::ptrdiff_t(j) * sL];
+                    }
+                }
+            }
+        }
+    });
+    return true;
 }
 
+template<typename ArrayType, typename Accumulator, std::size_t Rank>
+void nd::detail::reduce_region(const ArrayType& array, const access_pattern_t<Rank>& region, Accumulator& accumulator, std::atomic<bool>& stop)
+{
+    constexpr std::size_t block = 1024;
+    auto jump = region.jumps[Rank - 1];
 
+    for_each_row(region, [&] (index_t<Rank> index, std::size_t count)
+    {
+        auto start = index[Rank - 1];
 
+        for (std::size_t i0 = 0; i0 < count; i0 += block)
+        {
+            if (stop.load(std::memory_order_relaxed))
+            {
+                return false;
+            }
+            auto block_accumulator = Accumulator();
+            auto i1 = std::min(i0 + block, count);
 
-/**
- * @brief      Return an operator that freezes one index its argument array,
- *             reducing its rank by 1.
- *
- * @param[in]  axis_to_freeze  The axis to freeze
- *
- * @return     The operator
- */
-auto nd::freeze_axis(std::size_t axis_to_freeze)
-{
-    return axis_freezer_t<1>(make_index(axis_to_freeze));
+            for (std::size_t i = i0; i < i1; ++i)
+            {
+                index[Rank - 1] = start + i * jump;
+
+                if (! block_accumulator.add(array(index)))
+                {
+                    accumulator.combine(block_accumulator);
+                    stop.store(true, std::memory_order_relaxed);
+                    return false;
+                }
+            }
+            accumulator.combine(block_accumulator);
+        }
+        return true;
+    });
 }
 
+template<typename ValueType, std::size_t Rank, typename Accumulator>
+void nd::detail::reduce_region_along(const strided_shared_provider_t<ValueType, Rank>& source, const access_pattern_t<Rank>& region, Accumulator* target, const jumps_t<Rank>& target_jumps)
+{
+    auto source_jump = source.strides()[Rank - 1];
+    auto target_jump = target_jumps[Rank - 1];
 
+    for_each_row(region, [&] (const index_t<Rank>& index, std::size_t count)
+    {
+        auto source_row = source.data() + source.offset(index);
+        auto target_row = target;
 
+        for (std::size_t n = 0; n < Rank; ++n)
+        {
+            target_row += std::ptrdiff_t(index[n]) * target_jumps[n];
+        }
 
-/**
- * @brief      Return a reducer operator, which can apply the given operator
- *             along a given axis
- *
- * @param      reduction     The reduction
- *
- * @tparam     OperatorType  The type of function object to be applied along an
- *                           axis
- *
- * @return     The operator
- */
-template<typename OperatorType>
-auto nd::collect(OperatorType reduction)
-{
-    return axis_reducer_t<OperatorType>(0, reduction);
-}
+        if (target_jump == 0)
+        {
+            auto row_accumulator = Accumulator();
 
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                if (! row_accumulator.add(source_row[std::ptrdiff_t(i) * source_jump]))
+                {
+                    break;
+                }
+            }
+            target_row->combine(row_accumulator);
+        }
+        else
+        {
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                auto element_accumulator = Accumulator();
+                element_accumulator.add(source_row[std::ptrdiff_t(i) * source_jump]);
+                target_row[std::ptrdiff_t(i) * target_jump].combine(element_accumulator);
+            }
+        }
+    });
+}
 
+template<typename Provider, typename Accumulator>
+void nd::detail::reduce_flat(const Provider& source, std::size_t start, std::size_t count, Accumulator& accumulator, std::atomic<bool>& stop)
+{
+    constexpr std::size_t block = 1024;
 
+    for (std::size_t i0 = start; i0 < start + count; i0 += block)
+    {
+        if (stop.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+        auto block_accumulator = Accumulator();
+        auto i1 = std::min(i0 + block, start + count);
 
-/**
- * @brief      Return an operator that concats the given array onto another.
- *
- * @param      array_to_concat  The array to concatenate
- *
- * @tparam     ArrayType        The type of the array to concatenate
- *
- * @return     The operator
- *
- * @note       The returned operator will fail to compile if applied to arrays
- *             of a different rank than the array to concatenate. It will throw
- *             a logic_error if the array shapes are incompatible.
- */
-template<typename ArrayType>
-auto nd::concat(ArrayType array_to_concat)
-{
-    return concatenator_t<ArrayType>(0, array_to_concat);
+        for (std::size_t i = i0; i < i1; ++i)
+        {
+            if (! block_accumulator.add(source.at_offset(i)))
+            {
+                accumulator.combine(block_accumulator);
+                stop.store(true, std::memory_order_relaxed);
+                return;
+            }
+        }
+        accumulator.combine(block_accumulator);
+    }
 }
 
-
-
-
-/**
- * @brief      Reads an index from an array.
- *
- * @param[in]  index_to_read  The index to read
- *
- * @tparam     Rank           The rank of the array that can be read from
- *
- * @return     The operator
- */
-template<std::size_t Rank>
-auto nd::read_index(index_t<Rank> index_to_read)
+template<typename Accumulator>
+Accumulator nd::detail::combine_tree(std::vector<Accumulator>& partials)
 {
-    return [index_to_read] (auto&& array)
+    if (partials.empty())
     {
-        return array(index_to_read);
-    };
+        return Accumulator();
+    }
+    for (std::size_t stride = 1; stride < partials.size(); stride *= 2)
+    {
+        for (std::size_t n = 0; n + stride < partials.size(); n += 2 * stride)
+        {
+            partials[n].combine(partials[n + stride]);
+        }
+    }
+    return partials[0];
 }
-template<typename... Args>
-auto nd::read_index(Args... args)
+
+template<typename ResultType, typename ArrayType, typename Encoder>
+auto nd::detail::compact_where(const ArrayType& array, tile_scheduler_t* scheduler, Encoder encode)
 {
-    return read_index(make_index(args...));
-}
+    constexpr std::size_t Rank = ArrayType::array_rank;
+    auto num_slabs = scheduler ? std::min(array.shape()[0], 4 * scheduler->num_workers()) : 1;
+    auto slabs = partition_shape(array.shape(), std::max(num_slabs, std::size_t(1)));
+
+    // Matches are collected in chunks of about 1 MiB, each freed as soon as it
+    // has been copied to the result, so the peak memory is the result plus
+    // one chunk, rather than twice the result. A chunk starts small and
+    // doubles up to the full size, so slabs with few matches stay cheap.
+    auto chunk_size = std::max(std::size_t(1), (std::size_t(1) << 20) / sizeof(ResultType));
+    auto first_chunk_size = std::min(chunk_size, std::size_t(64));
+    auto matches = std::vector<std::vector<std::vector<ResultType>>>(slabs.size());
+
+    auto collect_slab = [&] (std::size_t n)
+    {
+        auto jump = slabs[n].jumps[Rank - 1];
+
+        for_each_row(slabs[n], [&] (index_t<Rank> index, std::size_t count)
+        {
+            auto start = index[Rank - 1];
 
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                index[Rank - 1] = start + i * jump;
+
+                if (bool(array(index)))
+                {
+                    auto& chunks = matches[n];
+
+                    if (chunks.empty() || chunks.back().size() == chunk_size)
+                    {
+                        chunks.emplace_back();
+                        chunks.back().reserve(chunks.size() == 1 ? first_chunk_size : chunk_size);
+                    }
+                    else if (chunks.back().size() == chunks.back().capacity())
+                    {
+                        chunks.back().reserve(std::min(2 * chunks.back().size(), chunk_size));
+                    }
+                    chunks.back().push_back(encode(index));
+                }
+            }
+        });
+    };
 
+    if (scheduler)
+    {
+        scheduler->run(slabs.size(), collect_slab);
+    }
+    else
+    {
+        collect_slab(0);
+    }
 
+    auto offsets = std::vector<std::size_t>(slabs.size() + 1, 0);
 
-/**
- * @brief      Return an operator that generates an array B by indexing into a
- *             source array A. B has the value type of A, but the shape of the
- *             index array I. The value type of I must be index_t<A.rank()>.
- *
- * @param[in]  array_of_indexes  An N-dimensional array of M-dimensional indexes
- *
- * @tparam     ArrayType         The type of the index array
- *
- * @return     The operator
- */
-template<typename ArrayType>
-auto nd::read_indexes(ArrayType array_of_indexes)
-{
-    return [array_of_indexes] (auto array_to_index)
+    for (std::size_t n = 0; n < slabs.size(); ++n)
     {
-        auto mapping = [array_of_indexes, array_to_index] (auto&& index)
+        offsets[n + 1] = offsets[n];
+
+        for (const auto& chunk : matches[n])
         {
-            return array_to_index(array_of_indexes(index));
-        };
-        return make_array(mapping, array_of_indexes.shape());
-    };
-}
+            offsets[n + 1] += chunk.size();
+        }
+    }
 
+    auto result = make_uninitialized_unique_provider<ResultType>(make_shape(offsets.back()));
+    auto merge_slab = [&] (std::size_t n)
+    {
+        auto target = result.data() + offsets[n];
 
+        for (auto& chunk : matches[n])
+        {
+            target = std::copy(chunk.begin(), chunk.end(), target);
+            std::vector<ResultType>().swap(chunk);
+        }
+    };
 
+    if (scheduler)
+    {
+        scheduler->run(slabs.size(), merge_slab);
+    }
+    else
+    {
+        merge_slab(0);
+    }
+    return make_array(std::move(result).shared());
+}
 
-/**
- * @brief      Return an operator that selects a subset of an array.
- *
- * @param[in]  region_to_select  The region to select
- *
- * @tparam     Rank              Rank of both the source and target arrays
- *
- * @return     The operator
- */
-template<std::size_t Rank>
-auto nd::select(access_pattern_t<Rank> region_to_select)
+#if defined(__GNUC__) && defined(__x86_64__)
+namespace nd::detail
 {
-    return selector_t<Rank>(region_to_select);
+    template<typename Provider, typename ValueType>
+    __attribute__((target("avx2"))) void evaluate_packed_avx2(const Provider& source, ValueType* target, std::size_t start, std::size_t count)
+    {
+        evaluate_packed<32>(source, target, start, count);
+    }
+
+    template<typename Provider, typename ValueType>
+    __attribute__((target("avx512f"))) void evaluate_packed_avx512(const Provider& source, ValueType* target, std::size_t start, std::size_t count)
+    {
+        evaluate_packed<64>(source, target, start, count);
+    }
 }
+#endif
 
-auto nd::select_axis(std::size_t axis_to_select)
+template<typename Provider, typename ValueType>
+void nd::detail::evaluate_flat(const Provider& source, ValueType* target, std::size_t start, std::size_t count)
 {
-    return axis_selector_t(axis_to_select, 0, 0, 1, false);
+#if defined(__GNUC__) && defined(__x86_64__)
+    if constexpr (is_packable<Provider>::value)
+    {
+        switch (simd_level())
+        {
+            case simd_level_t::avx512: evaluate_packed_avx512(source, target, start, count); return;
+            case simd_level_t::avx2: evaluate_packed_avx2(source, target, start, count); return;
+            case simd_level_t::sse2: evaluate_packed<16>(source, target, start, count); return;
+            case simd_level_t::scalar: break;
+        }
+    }
+#endif
+    for (std::size_t i = start; i < start + count; ++i)
+    {
+        target[i] = source.at_offset(i);
+    }
 }
 
-
-
-
-/**
- * @brief      Replace a subset of an array with the contents of another.
- *
- * @param[in]  region_to_replace  The region to replace
- * @param      replacement_array  The replacement array
- *
- * @tparam     Rank               Rank of both the array to patch and the
- *                                replacement array
- * @tparam     ArrayType          The type of the replacement array
- *
- * @return     A function returning arrays which map their indexes to the
- *             replacement_array, if those indexes are in the region to replace
- */
-template<std::size_t Rank, typename ArrayType>
-auto nd::replace(access_pattern_t<Rank> region_to_replace, ArrayType replacement_array)
+#if defined(__GNUC__) && defined(__x86_64__)
+template<typename Function, typename Pack, typename Result>
+__attribute__((always_inline)) inline void nd::detail::combine_packs(const Pack& a, const Pack& b, Result& result)
 {
-    return replacer_t<Rank, ArrayType>(region_to_replace, replacement_array);
+    if constexpr (std::is_same<Function, std::plus<>>::value)          result = a + b;
+    if constexpr (std::is_same<Function, std::minus<>>::value)         result = a - b;
+    if constexpr (std::is_same<Function, std::multiplies<>>::value)    result = a * b;
+    if constexpr (std::is_same<Function, std::divides<>>::value)       result = a / b;
+    if constexpr (std::is_same<Function, std::less<>>::value)          result = a < b;
+    if constexpr (std::is_same<Function, std::less_equal<>>::value)    result = a <= b;
+    if constexpr (std::is_same<Function, std::greater<>>::value)       result = a > b;
+    if constexpr (std::is_same<Function, std::greater_equal<>>::value) result = a >= b;
+    if constexpr (std::is_same<Function, std::equal_to<>>::value)      result = a == b;
+    if constexpr (std::is_same<Function, std::not_equal_to<>>::value)  result = a != b;
 }
 
-
-
-
 /**
- * @brief      Return a select operator starting at the given index.
- *
- * @param[in]  starting_index  The starting index
- *
- * @tparam     Rank            The rank of the array to operate on
- *
- * @return     The operator
+ * Loads packs from an operand of a packable expression. The readers mirror the
+ * expression tree, holding raw pointers to the leaf data (and the values of
+ * uniform leaves), so nothing is reloaded through the providers on each pack.
+ * The pack type is deduced by load, since GCC drops the vector attribute of a
+ * dependent typedef used as a template argument.
  */
-template<std::size_t Rank>
-auto nd::select_from(index_t<Rank> starting_index)
+template<typename Provider>
+struct nd::detail::pack_reader_t
 {
-    return selector_t<Rank>().from(starting_index);
-}
+    pack_reader_t(const Provider& source) : data(source.data()) {}
 
-template<typename... Args>
-auto nd::select_from(Args... args)
+    template<typename Pack>
+    __attribute__((always_inline)) void load(std::size_t offset, Pack& result) const
+    {
+        std::memcpy(&result, data + offset, sizeof(Pack));
+    }
+    const typename Provider::value_type* data;
+};
+
+namespace nd::detail
 {
-    return select_from(make_index(args...));
-}
+    template<typename ValueType, std::size_t Rank>
+    struct pack_reader_t<uniform_provider_t<ValueType, Rank>>
+    {
+        pack_reader_t(const uniform_provider_t<ValueType, Rank>& source) : value(source.value()) {}
 
+        template<typename Pack>
+        __attribute__((always_inline)) void load(std::size_t, Pack& result) const
+        {
+            result = Pack{} + value;
+        }
+        ValueType value;
+    };
 
+    template<typename Function, typename A, typename B>
+    struct pack_reader_t<elementwise_provider_t<Function, A, B>>
+    {
+        pack_reader_t(const elementwise_provider_t<Function, A, B>& source)
+        : a(std::get<0>(source.operands()))
+        , b(std::get<1>(source.operands())) {}
 
+        template<typename Pack>
+        __attribute__((always_inline)) void load(std::size_t offset, Pack& result) const
+        {
+            auto pack_a = Pack{};
+            auto pack_b = Pack{};
+            a.load(offset, pack_a);
+            b.load(offset, pack_b);
+            combine_packs<Function>(pack_a, pack_b, result);
+        }
+        pack_reader_t<A> a;
+        pack_reader_t<B> b;
+    };
+}
 
 /**
- * @brief      Return a replace operator starting at the begin index.
- *
- * @param[in]  starting_index  The starting index
- *
- * @tparam     Rank            The rank of the array to operate on
- *
- * @return     The operator
+ * Evaluate a packable expression (see is_packable) over a flat range, one
+ * pack of PackBytes at a time, with a scalar loop for the remainder. The pack
+ * types are GCC vector extensions, which compile to the instruction set of
+ * the calling function: the AVX2 and AVX-512 entry points above are built
+ * with target attributes, and this function is inlined into them.
  */
-template<std::size_t Rank>
-auto nd::replace_from(index_t<Rank> starting_index)
+template<std::size_t PackBytes, typename Provider, typename ValueType>
+__attribute__((always_inline)) inline void nd::detail::evaluate_packed(const Provider& source, ValueType* target, std::size_t start, std::size_t count)
 {
-    auto zeros = make_array([] (auto) { return 0; }, make_uniform_shape<Rank>(1));
-    return replacer_t<Rank, decltype(zeros)>({}, zeros).from(starting_index);
+    using operand_a = std::tuple_element_t<0, std::decay_t<decltype(source.operands())>>;
+    using operand_b = std::tuple_element_t<1, std::decay_t<decltype(source.operands())>>;
+    using function_type = std::decay_t<decltype(source.get_function())>;
+    using element_type = typename operand_a::value_type;
+    typedef element_type pack_t __attribute__((vector_size(PackBytes)));
+    constexpr std::size_t width = PackBytes / sizeof(element_type);
+
+    auto reader_a = pack_reader_t<operand_a>(std::get<0>(source.operands()));
+    auto reader_b = pack_reader_t<operand_b>(std::get<1>(source.operands()));
+    auto i = start;
+    auto final = start + count;
+
+    for (; i + width <= final; i += width)
+    {
+        auto a = pack_t{};
+        auto b = pack_t{};
+        reader_a.load(i, a);
+        reader_b.load(i, b);
+
+        if constexpr (std::is_same<ValueType, bool>::value)
+        {
+            typedef signed char mask_t __attribute__((vector_size(width)));
+            auto mask = decltype(a < b){};
+            combine_packs<function_type>(a, b, mask);
+            mask_t flags = mask_t{} - __builtin_convertvector(mask, mask_t);
+            std::memcpy(target + i, &flags, width);
+        }
+        else
+        {
+            auto result = pack_t{};
+            combine_packs<function_type>(a, b, result);
+            std::memcpy(target + i, &result, PackBytes);
+        }
+    }
+    for (; i < final; ++i)
+    {
+        target[i] = source.at_offset(i);
+    }
 }
+#endif
 
-template<typename... Args>
-auto nd::replace_from(Args... args)
+template<typename Provider>
+bool nd::detail::is_flat(const Provider& provider)
 {
-    return replace_from(make_index(args...));
+    if constexpr (is_elementwise_provider<Provider>::value)
+    {
+        return provider.is_flat();
+    }
+    else
+    {
+        return true;
+    }
 }
 
+void nd::detail::advise_mapping(const mapped_file_t& file, const void* begin, std::size_t count, access_advice_t advice)
+{
+    file.advise(begin, count, advice);
+}
 
-
-
-/**
- * @brief      Return an operator that maps the values of an array using the
- *             given function object.
- *
- * @param      function  The function
- *
- * @tparam     Function  The type of the function object
- *
- * @return     The operator
- *
- * @note       This is the N-dimensional version of the transform operator
- */
-template<typename Function>
-auto nd::map(Function function)
+template<typename Provider>
+void nd::detail::advise_leaves(const Provider& provider, access_advice_t advice)
 {
-    return [function] (auto array)
+    if constexpr (is_mapped_provider<Provider>::value || is_strided_provider<Provider>::value)
     {
-        auto mapping = [array, function] (auto&& index) { return function(array(index)); };
-        return make_array(mapping, array.shape());
-    };
+        provider.advise(advice);
+    }
+    else if constexpr (is_elementwise_provider<Provider>::value)
+    {
+        std::apply([advice] (const auto&... operand) { (advise_leaves(operand, advice), ...); }, provider.operands());
+    }
 }
 
-
-
-
-/**
- * @brief      Return an operator that calls std::apply(fn, arg) for each arg in
- *             the operand array. The value type of that array must be some type
- *             of std::tuple.
- *
- * @param[in]  fn        The function
- *
- * @tparam     Function  The type of the function object
- *
- * @return     The operator
- */
-template<typename Function>
-auto nd::apply(Function fn)
+template<typename Provider, std::size_t Rank>
+void nd::detail::advise_leaves(const Provider& provider, const access_pattern_t<Rank>& region, access_advice_t advice)
 {
-    return [fn] (auto array)
+    if constexpr (is_mapped_provider<Provider>::value || is_strided_provider<Provider>::value)
     {
-        return array | nd::map([fn] (auto args) { return std::apply(fn, args); });
-    };
+        provider.advise(region, advice);
+    }
+    else if constexpr (is_elementwise_provider<Provider>::value)
+    {
+        std::apply([&] (const auto&... operand)
+        {
+            // broadcast operands are not indexed by the region, so they are
+            // advised as a whole
+            auto advise_operand = [&] (const auto& operand)
+            {
+                if constexpr (std::decay_t<decltype(operand)>::provider_rank == Rank)
+                {
+                    if (operand.shape() == provider.shape())
+                    {
+                        advise_leaves(operand, region, advice);
+                        return;
+                    }
+                }
+                advise_leaves(operand, advice);
+            };
+            (advise_operand(operand), ...);
+        }, provider.operands());
+    }
 }
 
+template<typename ValueType, std::size_t Rank, typename Kernel>
+auto nd::detail::evaluate_stencil_steps(const stencil_provider_t<ValueType, Rank, Kernel>& stencil, std::size_t num_steps, tile_scheduler_t* scheduler)
+{
+    using provider_type = stencil_provider_t<ValueType, Rank, Kernel>;
+    static_assert(std::is_same<typename provider_type::value_type, ValueType>::value, "a repeated stencil must return the value type of its source");
 
+    constexpr std::size_t L = Rank - 1;
+    constexpr std::size_t max_steps_per_pass = 8;
+    constexpr std::size_t working_set_bytes = std::size_t(1) << 22;
+    constexpr std::size_t min_row_length = 512;
+    constexpr double max_redundancy = 1.4;
 
+    auto radius = stencil.radius();
+    auto boundary = stencil.boundary();
+    auto view = stencil.source();
 
-/**
- * @brief      Return a function that operates on two arrays, given a function
- *             that operates on their value types.
- *
- * @param      function  The function
- *
- * @tparam     Function  The function type
- *
- * @return     The operator
- */
-template<typename Function>
-auto nd::binary_op(Function function)
-{
-    return [function] (auto A, auto B)
+    if (num_steps == 0)
+    {
+        return evaluate_as_shared(view);
+    }
+    if (boundary == boundary_t::ghost)
+    {
+        for (std::size_t n = 0; n < Rank; ++n)
+        {
+            if (view.shape()[n] < 2 * num_steps * radius[n])
+            {
+                throw std::logic_error("array of shape " + to_string(view.shape()) + " is too small for the ghost zones of " + std::to_string(num_steps) + " stencil steps");
+            }
+        }
+    }
+    auto result = shared_provider_t<ValueType, Rank>();
+    auto buffers = std::vector<std::shared_ptr<buffer_t<ValueType>>>(2);
+
+    auto run = [scheduler] (std::size_t count, auto&& fn)
     {
-        if (A.shape() != B.shape())
+        if (scheduler)
+        {
+            scheduler->run(count, fn);
+        }
+        else
         {
-            throw std::logic_error("binary operation applied to arrays of different shapes");
+            for (std::size_t n = 0; n < count; ++n)
+            {
+                fn(n, 0);
+            }
         }
-        auto mapping = [function, A, B] (auto&& index)
-        {
-            return function(A(index), B(index));
-        };
-        return make_array(mapping, A.shape());
     };
-}
+    auto row_major_jumps = [] (const shape_t<Rank>& shape)
+    {
+        auto strides = make_strides_row_major(shape);
+        auto jumps = jumps_t<Rank>();
 
+        for (std::size_t n = 0; n < Rank; ++n)
+        {
+            jumps[n] = strides[n];
+        }
+        return jumps;
+    };
 
+    // Clamped and reflected edges do not commute with the stencil, so a tile
+    // near the edge can't be advanced from a padded copy of its
+    // surroundings; those arrays are swept one step at a time.
+    if (boundary == boundary_t::clamp || boundary == boundary_t::reflect)
+    {
+        for (std::size_t step = 0; step < num_steps; ++step)
+        {
+            auto next = provider_type(view, stencil.kernel(), radius, boundary);
+            result = scheduler ? evaluate_as_shared_parallel(next, *scheduler) : evaluate_as_shared(next);
+            view = result.strided();
+        }
+        return result;
+    }
 
+    for (auto remaining = num_steps; remaining > 0;)
+    {
+        auto shape = view.shape();
+        auto steps = std::min(remaining, max_steps_per_pass);
+        auto target_shape = shape;
+        auto tile_shape = shape_t<Rank>();
 
-//=============================================================================
-// The array class itself
-//=============================================================================
+        auto window_shape = [&] (const shape_t<Rank>& tile)
+        {
+            auto window = tile;
 
+            for (std::size_t n = 0; n < Rank; ++n)
+            {
+                window[n] += 2 * steps * radius[n];
+            }
+            return window;
+        };
 
+        // Choose the number of steps for this pass, and the largest tile for
+        // which the two buffers holding a tile's window (the tile and the
+        // cells it depends on, steps * radius deep) fit in the working set. If
+        // the redundant work on the halos would be too much, take fewer steps.
+        // Tiles are cubic, except that they span at least min_row_length on
+        // the last axis (or whole rows): the last step writes the tile to the
+        // target, and short rows scattered over a large array make those
+        // writes far slower than the stencil itself.
+        for (;; --steps)
+        {
+            for (std::size_t n = 0; n < Rank; ++n)
+            {
+                target_shape[n] = boundary == boundary_t::ghost ? shape[n] - 2 * steps * radius[n] : shape[n];
+            }
+            auto largest = *std::max_element(target_shape.begin(), target_shape.end());
+            tile_shape = make_uniform_shape<Rank>(1);
 
+            for (std::size_t t = 2; t <= largest; ++t)
+            {
+                auto candidate = shape_t<Rank>();
+
+                for (std::size_t n = 0; n < Rank; ++n)
+                {
+                    candidate[n] = std::max(std::min(t, target_shape[n]), std::size_t(1));
+                }
+                candidate[L] = std::max(std::min(std::max(t, min_row_length), target_shape[L]), std::size_t(1));
+                if (2 * window_shape(candidate).volume() * sizeof(ValueType) > working_set_bytes)
+                {
+                    break;
+                }
+                tile_shape = candidate;
+            }
+            auto work = 0.0;
 
-/**
- * @brief      The actual array class template
- *
- * @tparam     Rank      The array dimensionality
- * @tparam     Provider  Type defining the index space and mapping from indexes
- *                       to values
- */
-template<typename Provider>
-class nd::array_t
-{
-public:
+            for (std::size_t s = 1; s <= steps; ++s)
+            {
+                auto volume = 1.0;
 
+                for (std::size_t n = 0; n < Rank; ++n)
+                {
+                    volume *= tile_shape[n] + 2 * (steps - s) * radius[n];
+                }
+                work += volume;
+            }
+            if (steps == 1 || work <= max_redundancy * steps * tile_shape.volume())
+            {
+                break;
+            }
+        }
 
+        // Passes alternate between two target buffers, so that after the
+        // first two, the target's pages are already mapped (the shape only
+        // changes from pass to pass for ghost zones).
+        std::swap(buffers[0], buffers[1]);
+        auto& buffer = buffers[0];
 
-    //=========================================================================
-    using provider_type = Provider;
-    using value_type = typename Provider::value_type;
-    using is_ndarray = std::true_type;
-    static constexpr std::size_t array_rank = Provider::provider_rank;
+        if (! buffer || buffer->size() != target_shape.volume())
+        {
+            buffer = std::make_shared<buffer_t<ValueType>>(buffer_t<ValueType>::uninitialized(target_shape.volume()));
+        }
+        auto target = buffer->data();
+        auto target_strides = make_strides_row_major(target_shape);
+        auto tiles = target_shape.volume() ? partition_tiles(target_shape, tile_shape) : std::vector<access_pattern_t<Rank>>();
+        auto num_workers = scheduler ? scheduler->num_workers() : 1;
+        auto scratch = std::vector<buffer_t<ValueType>>();
 
+        for (std::size_t w = 0; w < 2 * num_workers; ++w)
+        {
+            scratch.push_back(buffer_t<ValueType>::uninitialized(window_shape(tile_shape).volume()));
+        }
 
+        run(tiles.size(), [&] (std::size_t n, std::size_t worker)
+        {
+            const auto& tile = tiles[n];
+            auto a = scratch[2 * worker + 0].data();
+            auto b = scratch[2 * worker + 1].data();
+            auto shape_in = window_shape(tile.shape());
+
+            // The window's element at q is at source index tile.start + q
+            // (ghost zones), or at tile.start + q - steps * radius, wrapped
+            // around the array (periodic).
+            auto source_index = [&] (std::size_t axis, std::size_t q)
+            {
+                if (boundary == boundary_t::ghost)
+                {
+                    return tile.start[axis] + q;
+                }
+                return boundary_index(long(tile.start[axis] + q) - long(steps * radius[axis]), shape[axis], boundary);
+            };
+            auto in_strides = make_strides_row_major(shape_in);
+            auto jump = view.strides()[L];
+
+            // Rows are copied in runs which are contiguous in the source; a
+            // periodic row wraps around at most a few times.
+            for_each_row(make_access_pattern(shape_in), [&] (const index_t<Rank>& q, std::size_t count)
+            {
+                auto index = index_t<Rank>();
+
+                for (std::size_t m = 0; m < L; ++m)
+                {
+                    index[m] = source_index(m, q[m]);
+                }
+                auto source_row = view.data() + view.offset(index);
+                auto row = a + in_strides.compute_offset(q);
+
+                for (std::size_t i = 0, k = source_index(L, q[L]); i < count; k = 0)
+                {
+                    auto run_length = std::min(count - i, shape[L] - k);
+
+                    if (jump == 1)
+                    {
+                        std::copy_n(source_row + k, run_length, row + i);
+                    }
+                    else
+                    {
+                        for (std::size_t j = 0; j < run_length; ++j)
+                        {
+                            row[i + j] = source_row[std::ptrdiff_t(k + j) * jump];
+                        }
+                    }
+                    i += run_length;
+                }
+            });
+
+            // Advance the window a step at a time, each step losing the radius
+            // on each side, so that the last one leaves just the tile, which
+            // is written to the target.
+            for (std::size_t s = 1; s <= steps; ++s)
+            {
+                auto shape_out = shape_in;
+
+                for (std::size_t m = 0; m < Rank; ++m)
+                {
+                    shape_out[m] -= 2 * radius[m];
+                }
+                auto memory = std::shared_ptr<const ValueType>(std::shared_ptr<const ValueType>(), a);
+                auto local = strided_shared_provider_t<ValueType, Rank>(shape_in, row_major_jumps(shape_in), memory);
+                auto step = provider_type(local, stencil.kernel(), radius, boundary_t::ghost);
+                auto out_strides = make_strides_row_major(shape_out);
+
+                for_each_row(make_access_pattern(shape_out), [&] (const index_t<Rank>& q, std::size_t count)
+                {
+                    if (s < steps)
+                    {
+                        step.evaluate_row(q, count, b + out_strides.compute_offset(q));
+                    }
+                    else
+                    {
+                        auto p = q;
+
+                        for (std::size_t m = 0; m < Rank; ++m)
+                        {
+                            p[m] += tile.start[m];
+                        }
+                        step.evaluate_row(q, count, target + target_strides.compute_offset(p));
+                    }
+                });
+                std::swap(a, b);
+                shape_in = shape_out;
+            }
+        });
 
+        result = shared_provider_t<ValueType, Rank>(target_shape, buffer);
+        view = result.strided();
+        remaining -= steps;
+    }
+    return result;
+}
 
-    // iterator
-    //=========================================================================
-    struct iterator
+template<typename Provider, typename ValueType, std::size_t Rank>
+void nd::detail::evaluate_block(const Provider& source, const access_pattern_t<Rank>& region, ValueType* target)
+{
+    if constexpr (is_strided_viewable<Provider>::value)
     {
-        using iterator_category = std::input_iterator_tag;
-        using value_type = typename Provider::value_type;
-        using difference_type = std::ptrdiff_t;
-        using pointer = value_type*;
-        using reference = value_type&;
-
-        iterator& operator++() { ++current; return *this; }
-        bool operator==(const iterator& other) const { return current == other.current; }
-        bool operator!=(const iterator& other) const { return current != other.current; }
-        decltype(auto) operator*() const { return array(*current); }
-
-        array_t array;
-        typename access_pattern_t<array_rank>::iterator current;
-    };
-
+        auto view = source.strided();
+        auto jump = view.strides()[Rank - 1];
 
+        for_each_row(region, [&] (const index_t<Rank>& index, std::size_t count)
+        {
+            auto row = view.data() + view.offset(index);
 
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                *target++ = row[std::ptrdiff_t(i) * jump];
+            }
+        });
+        return;
+    }
+    else if constexpr (is_stencil_provider<Provider>::value)
+    {
+        for_each_row(region, [&] (const index_t<Rank>& index, std::size_t count)
+        {
+            source.evaluate_row(index, count, target);
+            target += count;
+        });
+        return;
+    }
+    else if constexpr (is_flat_readable<Provider>::value)
+    {
+        if (is_flat(source))
+        {
+            auto strides = make_strides_row_major(source.shape());
 
-    //=========================================================================
-    array_t() {}
-    array_t(Provider&& provider) : provider(std::move(provider)) {}
+            for_each_row(region, [&] (const index_t<Rank>& index, std::size_t count)
+            {
+                auto offset = strides.compute_offset(index);
+
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    *target++ = source.at_offset(offset + i);
+                }
+            });
+            return;
+        }
+    }
+    for_each_index(region, [&] (const index_t<Rank>& index)
+    {
+        *target++ = source(index);
+    });
+}
 
+template<std::size_t Rank>
+bool nd::detail::is_row_major_block(const shape_t<Rank>& shape, const shape_t<Rank>& block_shape)
+{
+    // A block is contiguous if, before the last axis it does not span, it is
+    // one element wide.
+    for (int n = Rank - 1; n >= 0; --n)
+    {
+        if (block_shape[n] < shape[n])
+        {
+            for (int m = 0; m < n; ++m)
+            {
+                if (block_shape[m] != 1 && shape[m] != 1)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+    return true;
+}
 
+template<typename Provider, typename ValueType>
+void nd::detail::evaluate_flat_range(const Provider& source, ValueType* target, std::size_t start, std::size_t count)
+{
+    if constexpr (is_flat_readable<Provider>::value)
+    {
+        if (is_flat(source))
+        {
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                target[i] = source.at_offset(start + i);
+            }
+            return;
+        }
+    }
+    constexpr std::size_t Rank = Provider::provider_rank;
+    auto shape = source.shape();
+    auto pattern = make_access_pattern(shape);
+    auto index = index_t<Rank>();
 
+    for (int n = Rank - 1; n >= 0; --n)
+    {
+        index[n] = start % shape[n];
+        start /= shape[n];
+    }
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        target[i] = source(index);
+        pattern.advance(index);
+    }
+}
 
-    // indexing functions
-    //=========================================================================
-    template<typename... Args> decltype(auto) operator()(Args... args) const { return provider(make_index(args...)); }
-    template<typename... Args> decltype(auto) operator()(Args... args)       { return provider(make_index(args...)); }
-    decltype(auto) operator()(const index_t<array_rank>& index) const { return provider(index); }
-    decltype(auto) operator()(const index_t<array_rank>& index)       { return provider(index); }
-    decltype(auto) data()     const    { return provider.data(); }
-    decltype(auto) data()              { return provider.data(); }
-    decltype(auto) begin()    const    { return iterator {*this, indexes().begin()}; }
-    decltype(auto) end()      const    { return iterator {*this, indexes().end()}; }
-    constexpr std::size_t rank() const { return array_rank; }
+template<typename Provider, typename Sink>
+void nd::detail::write_double_buffered(const Provider& source, Sink& sink, std::size_t chunk_bytes)
+{
+    using value_type = typename Provider::value_type;
+    using allocator_type = aligned_allocator_t<value_type, file_sink_t::block_size>;
+
+    // Each chunk but the last is a whole number of blocks, so that a direct
+    // sink can write it without staging.
+    auto block_values = file_sink_t::block_size / std::gcd(file_sink_t::block_size, sizeof(value_type));
+    auto size = source.size();
+    auto chunk_size = std::max(chunk_bytes / sizeof(value_type) / block_values, std::size_t(1)) * block_values;
+    buffer_t<value_type, allocator_type> buffers[2] = {
+        buffer_t<value_type, allocator_type>::uninitialized(std::min(chunk_size, size)),
+        buffer_t<value_type, allocator_type>::uninitialized(std::min(chunk_size, size)),
+    };
+    std::size_t filled[2] = {0, 0};
+    auto mutex = std::mutex();
+    auto condition = std::condition_variable();
+    auto finished = false;
+    auto error = std::exception_ptr();
 
+    auto writer = std::make_shared<std::packaged_task<void()>>([&] ()
+    {
+        for (std::size_t k = 0;; ++k)
+        {
+            auto slot = k % 2;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [&] { return filled[slot] > 0 || finished; });
 
+                if (filled[slot] == 0)
+                {
+                    return;
+                }
+            }
+            try {
+                sink.write(buffers[slot].data(), filled[slot] * sizeof(value_type));
+            }
+            catch (...)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    error = std::current_exception();
+                }
+                condition.notify_all();
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                filled[slot] = 0;
+            }
+            condition.notify_all();
+        }
+    });
+    auto written = writer->get_future();
+    sink_writer().submit([writer] { (*writer)(); });
 
+    try {
+        for (std::size_t start = 0, k = 0; start < size; start += chunk_size, ++k)
+        {
+            auto slot = k % 2;
+            auto count = std::min(chunk_size, size - start);
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [&] { return filled[slot] == 0 || error; });
 
-    // query functions and operator support
-    //=========================================================================
-    auto shape() const { return provider.shape(); }
-    auto shape(std::size_t axis) const { return provider.shape()[axis]; }
-    auto size() const { return provider.size(); }
-    auto indexes() const { return make_access_pattern(provider.shape()); }
-    const Provider& get_provider() const { return provider; }
-    template<typename Function> auto operator|(Function&& fn) const & { return fn(*this); }
-    template<typename Function> auto operator|(Function&& fn)      && { return fn(std::move(*this)); }
+                if (error)
+                {
+                    break;
+                }
+            }
+            evaluate_flat_range(source, buffers[slot].data(), start, count);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                filled[slot] = count;
+            }
+            condition.notify_all();
+        }
+    }
+    catch (...)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        error = std::current_exception();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+    }
+    condition.notify_all();
+    written.get();
 
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
 
+template<std::size_t Rank, std::size_t... Ranks>
+auto nd::detail::broadcast_shapes(const shape_t<Ranks>&... shapes)
+{
+    auto result = make_uniform_shape<Rank>(1);
 
+    auto merge = [&result] (auto rank, const auto& shape)
+    {
+        constexpr std::size_t R = decltype(rank)::value;
 
-    // methods converting this to a memory-backed array
-    //=========================================================================
-    auto unique() const { return make_array(evaluate_as_unique(provider)); }
-    auto shared() const { return make_array(evaluate_as_shared(provider)); }
+        for (std::size_t n = 0; n < R; ++n)
+        {
+            auto& target = result[Rank - R + n];
 
+            if (target == 1)
+            {
+                target = shape[n];
+            }
+            else if (shape[n] != 1 && shape[n] != target)
+            {
+                throw std::logic_error("cannot broadcast arrays of incompatible shapes");
+            }
+        }
+    };
+    (merge(std::integral_constant<std::size_t, Ranks>(), shapes), ...);
+    return result;
+}
 
+template<std::size_t Rank, std::size_t SourceRank>
+auto nd::detail::broadcast_index(const index_t<Rank>& index, const shape_t<SourceRank>& source_shape)
+{
+    auto result = index_t<SourceRank>();
 
+    for (std::size_t n = 0; n < SourceRank; ++n)
+    {
+        result[n] = source_shape[n] == 1 ? 0 : index[Rank - SourceRank + n];
+    }
+    return result;
+}
 
-    // arithmetic operators
-    //=========================================================================
-    template<typename T> auto operator+(T&& A) const { return bin_op(std::forward<T>(A), std::plus<>()); }
-    template<typename T> auto operator-(T&& A) const { return bin_op(std::forward<T>(A), std::minus<>()); }
-    template<typename T> auto operator*(T&& A) const { return bin_op(std::forward<T>(A), std::multiplies<>()); }
-    template<typename T> auto operator/(T&& A) const { return bin_op(std::forward<T>(A), std::divides<>()); }
-    template<typename T> auto operator&&(T&& A) const { return bin_op(std::forward<T>(A), std::logical_and<>()); }
-    template<typename T> auto operator||(T&& A) const { return bin_op(std::forward<T>(A), std::logical_or<>()); }
-    template<typename T> auto operator==(T&& A) const { return bin_op(std::forward<T>(A), std::equal_to<>()); }
-    template<typename T> auto operator!=(T&& A) const { return bin_op(std::forward<T>(A), std::not_equal_to<>()); }
-    template<typename T> auto operator<=(T&& A) const { return bin_op(std::forward<T>(A), std::less_equal<>()); }
-    template<typename T> auto operator>=(T&& A) const { return bin_op(std::forward<T>(A), std::greater_equal<>()); }
-    template<typename T> auto operator<(T&& A) const { return bin_op(std::forward<T>(A), std::less<>()); }
-    template<typename T> auto operator>(T&& A) const { return bin_op(std::forward<T>(A), std::greater<>()); }
-    auto operator+() const { return *this | map([] (auto&& x) { return +x; }); }
-    auto operator-() const { return *this | map([] (auto&& x) { return -x; }); }
-    auto operator!() const { return *this | map(std::logical_not<>()); }
+template<typename ValueType>
+std::string nd::detail::npy_descr()
+{
+    static_assert(std::is_arithmetic<ValueType>::value, "npy files can only hold arithmetic types");
 
+    const std::uint16_t one = 1;
+    auto is_little_endian = *reinterpret_cast<const unsigned char*>(&one) == 1;
+    auto kind = std::is_same<ValueType, bool>::value ? 'b' : std::is_floating_point<ValueType>::value ? 'f' : std::is_signed<ValueType>::value ? 'i' : 'u';
+    auto order = sizeof(ValueType) == 1 ? '|' : is_little_endian ? '<' : '>';
 
+    return std::string{order, kind} + std::to_string(sizeof(ValueType));
+}
 
+template<std::size_t Rank>
+std::string nd::detail::make_npy_header(const std::string& descr, bool fortran_order, const shape_t<Rank>& shape)
+{
+    auto dict = std::string("{'descr': '") + descr + "', 'fortran_order': " + (fortran_order ? "True" : "False") + ", 'shape': (";
 
-private:
-    //=========================================================================
-    template<typename OtherType, typename Function>
-    auto bin_op(OtherType&& other, Function&& function) const
+    for (std::size_t n = 0; n < Rank; ++n)
     {
-        auto F = binary_op(std::forward<Function>(function));
-        auto B = promote(std::forward<OtherType>(other), shape());
-        return F(*this, std::move(B));
+        dict += std::to_string(shape[n]) + (Rank == 1 ? ",)" : n + 1 < Rank ? ", " : ")");
     }
-    Provider provider;
-};
+    dict += ", }";
 
+    // The magic string, version, and header length take 10 bytes, and the
+    // whole header is padded with spaces and a newline to a multiple of 64
+    // bytes, so the data which follows it is aligned.
+    auto total = (10 + dict.size() + 1 + 63) / 64 * 64;
+    dict.append(total - 10 - dict.size() - 1, ' ');
+    dict += '\n';
 
+    if (dict.size() > 0xffff)
+    {
+        throw std::logic_error("npy header is too long");
+    }
+    auto preamble = std::string("\x93NUMPY\x01\x00", 8);
+    preamble += char(dict.size() & 0xff);
+    preamble += char(dict.size() >> 8);
 
+    return preamble + dict;
+}
 
-//=============================================================================
-// non-template operators
-//=============================================================================
-
-
+nd::detail::npy_header_t nd::detail::read_npy_header(std::FILE* file, const std::string& filename)
+{
+    unsigned char preamble[12];
 
+    if (std::fread(preamble, 1, 8, file) != 8 || std::string(reinterpret_cast<char*>(preamble), 6) != "\x93NUMPY")
+    {
+        throw std::runtime_error("file " + filename + " is not in npy format");
+    }
+    auto length_bytes = preamble[6] == 1 ? 2 : 4;
 
-/**
- * @brief      Return a 1d array [0 .. count - 1]
- *
- * @param[in]  count  The number of elements
- *
- * @return     The array, not requiring any storage
- */
-auto nd::arange(int count)
-{
-    return make_array([] (auto index) { return index[0]; }, nd::make_shape(count));
-}
+    if (std::fread(preamble + 8, 1, length_bytes, file) != std::size_t(length_bytes))
+    {
+        throw std::runtime_error("file " + filename + " is not in npy format");
+    }
+    auto dict_length = std::size_t(0);
 
+    for (int n = length_bytes - 1; n >= 0; --n)
+    {
+        dict_length = (dict_length << 8) | preamble[8 + n];
+    }
 
+    // The length comes from the file, so it is checked before a string is
+    // allocated for it: NumPy's own headers are a few hundred bytes, and none
+    // may run past the end of the file (when the file can be measured).
+    auto position = std::ftell(file);
+    auto remaining = long(-1);
 
+    if (position >= 0 && std::fseek(file, 0, SEEK_END) == 0)
+    {
+        remaining = std::ftell(file) - position;
+        std::fseek(file, position, SEEK_SET);
+    }
+    if (dict_length > (std::size_t(1) << 20) || (remaining >= 0 && dict_length > std::size_t(remaining)))
+    {
+        throw std::runtime_error("file " + filename + " has a corrupt npy header");
+    }
+    auto dict = std::string(dict_length, ' ');
 
-/**
- * @brief      Return a 1d array [start, start + skip .. count - 1]
- *
- * @param[in]  start      The starting element
- * @param[in]  final      The final element (one past the end)
- * @param[in]  step       The step size
- *
- * @return     The array, not requiring any storage
- */
-auto nd::arange(int start, int final, int step)
+    if (std::fread(&dict[0], 1, dict_length, file) != dict_length)
+    {
+        throw std::runtime_error("file " + filename + " is not in npy format");
+    }
+    auto header = npy_header_t();
+    auto descr = header_value(dict, "descr", filename);
+
+    header.descr = descr.substr(1, descr.find(descr[0], 1) - 1);
+    header.fortran_order = header_value(dict, "fortran_order", filename).compare(0, 4, "True") == 0;
+    header.shape = parse_header_tuple(header_value(dict, "shape", filename));
+    header.data_offset = 8 + length_bytes + dict_length;
+    return header;
+}
+
+std::string nd::detail::header_value(const std::string& dict, const std::string& key, const std::string& filename)
 {
-    if (step == 0 || final / step - start / step < 0)
+    auto pos = dict.find("'" + key + "'");
+
+    if (pos == std::string::npos || (pos = dict.find(':', pos)) == std::string::npos)
     {
-        throw std::invalid_argument("nd::range");
+        throw std::runtime_error("header in " + filename + " has no key " + key);
     }
-    return make_array([=] (auto index)
+    return dict.substr(dict.find_first_not_of(' ', pos + 1));
+}
+
+std::vector<std::size_t> nd::detail::parse_header_tuple(const std::string& text)
+{
+    auto result = std::vector<std::size_t>();
+
+    for (auto c = text.data() + 1; *c && *c != ')';)
     {
-        return start + index[0] * step;
-    }, nd::make_shape(final / step - start / step));
+        if (std::isdigit(*c))
+        {
+            char* end;
+            result.push_back(std::strtoull(c, &end, 10));
+            c = end;
+        }
+        else
+        {
+            ++c;
+        }
+    }
+    return result;
 }
 
+void nd::detail::byte_shuffle(const unsigned char* source, unsigned char* target, std::size_t num_bytes, std::size_t element_size)
+{
+    auto num_elements = num_bytes / element_size;
 
+    for (std::size_t i = 0; i < num_elements; ++i)
+    {
+        for (std::size_t b = 0; b < element_size; ++b)
+        {
+            target[b * num_elements + i] = source[i * element_size + b];
+        }
+    }
+}
 
+void nd::detail::byte_unshuffle(const unsigned char* source, unsigned char* target, std::size_t num_bytes, std::size_t element_size)
+{
+    auto num_elements = num_bytes / element_size;
 
-/**
- * @brief      Return a 1d array of equally spaced values
- *
- * @param[in]  x0         The starting value
- * @param[in]  x1         The final value (inclusive)
- * @param[in]  count      The number of elements in the return array
- *
- * @tparam     ValueType  The value type
- *
- * @return     The array
- */
-auto nd::linspace(double x0, double x1, std::size_t count)
+    for (std::size_t b = 0; b < element_size; ++b)
+    {
+        for (std::size_t i = 0; i < num_elements; ++i)
+        {
+            target[i * element_size + b] = source[b * num_elements + i];
+        }
+    }
+}
+
+std::vector<unsigned char> nd::detail::lz_compress(const unsigned char* source, std::size_t num_bytes)
 {
-    auto mapping = [x0, x1, count] (auto index)
+    // The stream is a sequence of (token, literals, offset) records, in the
+    // style of the LZ4 block format. The high nibble of the token is the
+    // number of literals, the low nibble the match length minus 4, and a
+    // nibble of 15 continues in bytes of 255 until a smaller byte. Each match
+    // is a copy from up to 65535 bytes back. The last record has no match.
+    auto result = std::vector<unsigned char>();
+    auto table = std::vector<std::uint32_t>(1 << 14, 0);
+    auto read32 = [source] (std::size_t i) { std::uint32_t x; std::memcpy(&x, source + i, 4); return x; };
+    auto hash = [] (std::uint32_t x) { return (x * 2654435761u) >> 18; };
+
+    auto put_length = [&result] (std::size_t length)
     {
-        return x0 + (x1 - x0) * index[0] / (count - 1);
+        for (; length >= 255; length -= 255)
+        {
+            result.push_back(255);
+        }
+        result.push_back((unsigned char)(length));
     };
-    return make_array(mapping, make_shape(count));
-}
+    auto put_record = [&] (std::size_t anchor, std::size_t num_literals, std::size_t offset, std::size_t match_length)
+    {
+        auto m = match_length ? match_length - 4 : 0;
+        result.push_back((unsigned char)((std::min<std::size_t>(num_literals, 15) << 4) | std::min<std::size_t>(m, 15)));
 
+        if (num_literals >= 15)
+        {
+            put_length(num_literals - 15);
+        }
+        result.insert(result.end(), source + anchor, source + anchor + num_literals);
 
+        if (match_length)
+        {
+            result.push_back((unsigned char)(offset & 0xff));
+            result.push_back((unsigned char)(offset >> 8));
 
+            if (m >= 15)
+            {
+                put_length(m - 15);
+            }
+        }
+    };
 
-/**
- * @brief      Return an operator that breaks up a 1d array into a 1d ragged
- *             array of size num_groups, whose elements are arrays with
- *             equitable size and whose disjoint union equals the original
- *             array.
- *
- * @param[in]  num_groups  The number groups to divvy up on
- *
- * @return     The operator
- * @note       This function is useful for parallelization tasks.
- */
-auto nd::divvy(std::size_t num_groups)
-{
-    return [num_groups] (auto array)
+    auto anchor = std::size_t(0);
+    auto i = std::size_t(0);
+
+    while (i + 4 <= num_bytes)
     {
-        static_assert(array.rank() == 1, "can only divvy a 1d array");
+        auto h = hash(read32(i));
+        auto candidate = std::size_t(table[h]);
+        table[h] = std::uint32_t(i + 1);
 
-        return make_array([num_groups, array] (auto group_index)
+        if (candidate && i + 1 - candidate <= 65535 && read32(candidate - 1) == read32(i))
         {
-            std::size_t start = (group_index[0] + 0) * array.size() / num_groups;
-            std::size_t final = (group_index[0] + 1) * array.size() / num_groups;
+            auto match = candidate - 1;
+            auto length = std::size_t(4);
 
-            return make_array([array, start] (auto element_index)
+            while (i + length < num_bytes && source[match + length] == source[i + length])
             {
-                return array(start + element_index[0]);
-            }, make_shape(final - start));
-        }, make_shape(num_groups));
-    };
+                ++length;
+            }
+            put_record(anchor, i - anchor, i - match, length);
+            i += length;
+            anchor = i;
+        }
+        else
+        {
+            i += 1 + ((i - anchor) >> 6);
+        }
+    }
+    put_record(anchor, num_bytes - anchor, 0, 0);
+    return result;
 }
 
+void nd::detail::lz_decompress(const unsigned char* source, std::size_t num_source_bytes, unsigned char* target, std::size_t num_bytes)
+{
+    auto corrupt = [] () { return std::runtime_error("compressed chunk is corrupt"); };
+    auto s = std::size_t(0);
+    auto t = std::size_t(0);
 
+    auto get_length = [&] (std::size_t length)
+    {
+        if (length == 15)
+        {
+            unsigned char byte;
+
+            do {
+                if (s == num_source_bytes)
+                {
+                    throw corrupt();
+                }
+                byte = source[s++];
+                length += byte;
+            } while (byte == 255);
+        }
+        return length;
+    };
 
+    while (s < num_source_bytes)
+    {
+        auto token = source[s++];
+        auto num_literals = get_length(token >> 4);
 
-//=============================================================================
-// to_string overloads
-//=============================================================================
-
+        if (num_literals > num_source_bytes - s || num_literals > num_bytes - t)
+        {
+            throw corrupt();
+        }
+        std::copy(source + s, source + s + num_literals, target + t);
+        s += num_literals;
+        t += num_literals;
 
+        if (s == num_source_bytes)
+        {
+            break;
+        }
+        if (num_source_bytes - s < 2)
+        {
+            throw corrupt();
+        }
+        auto offset = std::size_t(source[s]) | (std::size_t(source[s + 1]) << 8);
+        s += 2;
+        auto length = get_length(token & 15) + 4;
 
+        if (offset == 0 || offset > t || length > num_bytes - t)
+        {
+            throw corrupt();
+        }
+        for (std::size_t n = 0; n < length; ++n, ++t)
+        {
+            target[t] = target[t - offset];
+        }
+    }
+    if (t != num_bytes)
+    {
+        throw corrupt();
+    }
+}
 
-template<std::size_t Rank>
-auto nd::to_string(const index_t<Rank>& index)
+std::vector<unsigned char> nd::detail::encode_chunk(const unsigned char* source, std::size_t num_bytes, std::size_t element_size, chunk_codec_t codec, bool shuffle)
 {
-    auto result = std::string("[ ");
+    auto result = std::vector<unsigned char>(num_bytes);
 
-    for (std::size_t axis = 0; axis < Rank; ++axis)
+    if (shuffle)
     {
-        result += std::to_string(index[axis]) + " ";
+        byte_shuffle(source, result.data(), num_bytes, element_size);
     }
-    return result + "]";
+    else
+    {
+        std::memcpy(result.data(), source, num_bytes);
+    }
+    if (codec == chunk_codec_t::lz)
+    {
+        auto compressed = lz_compress(result.data(), num_bytes);
+
+        if (compressed.size() < num_bytes)
+        {
+            return compressed;
+        }
+    }
+    return result;
 }
 
-template<std::size_t Rank>
-auto nd::to_string(const shape_t<Rank>& index)
+void nd::detail::decode_chunk(const std::vector<unsigned char>& stored, unsigned char* target, std::size_t num_bytes, std::size_t element_size, chunk_codec_t codec, bool shuffle)
 {
-    auto result = std::string("< ");
+    // With the lz codec, chunks are stored raw when compressing them does not
+    // make them smaller, so a chunk is compressed exactly when it is shorter
+    // than its contents. Raw chunks must have exactly the contents' size.
+    auto compressed = codec == chunk_codec_t::lz && stored.size() < num_bytes;
 
-    for (std::size_t axis = 0; axis < Rank; ++axis)
+    if (! compressed && stored.size() != num_bytes)
     {
-        result += std::to_string(index[axis]) + " ";
+        throw std::runtime_error("chunk of " + std::to_string(stored.size()) + " bytes is corrupt: expected " + std::to_string(num_bytes) + " bytes");
+    }
+    if (! shuffle && ! compressed)
+    {
+        std::memcpy(target, stored.data(), num_bytes);
+    }
+    else if (! shuffle)
+    {
+        lz_decompress(stored.data(), stored.size(), target, num_bytes);
+    }
+    else if (! compressed)
+    {
+        byte_unshuffle(stored.data(), target, num_bytes, element_size);
+    }
+    else
+    {
+        auto shuffled = std::vector<unsigned char>(num_bytes);
+        lz_decompress(stored.data(), stored.size(), shuffled.data(), num_bytes);
+        byte_unshuffle(shuffled.data(), target, num_bytes, element_size);
     }
-    return result + ">";
 }
 
-template<std::size_t Rank>
-auto nd::to_string(const access_pattern_t<Rank>& region)
+template<typename ValueType, std::size_t Rank>
+nd::shape_t<Rank> nd::detail::check_npy_header(const npy_header_t& header, const std::string& filename)
 {
-    return to_string(region.start) + " -> " + to_string(region.final);
+    if (header.descr != npy_descr<ValueType>())
+    {
+        throw std::logic_error("file " + filename + " has dtype " + header.descr + ", expected " + npy_descr<ValueType>());
+    }
+    if (header.shape.size() != Rank)
+    {
+        throw std::logic_error("file " + filename + " has " + std::to_string(header.shape.size()) + " axes, expected " + std::to_string(Rank));
+    }
+    return shape_t<Rank>::from_range(header.shape);
 }
 
-
-
-
-//=============================================================================
-// Helper functions
-//=============================================================================
-
-
-
-
-template<std::size_t Index, typename ArrayType>
-auto nd::detail::get_through(const ArrayType& array)
+template<typename ValueType>
+struct nd::detail::sum_accumulator_t
 {
-    return make_array([array] (auto index) { return std::get<Index>(array(index)); }, array.shape());
+    using result_type = std::conditional_t<std::is_same<ValueType, bool>::value, unsigned long, ValueType>;
+    bool add(const ValueType& x) { value += x; return true; }
+    void add_repeated(const ValueType& x, std::size_t count) { value += result_type(x) * result_type(count); }
+    void combine(const sum_accumulator_t& other) { value += other.value; }
+    result_type result() const { return value; }
+    result_type value = result_type();
 };
 
-template<typename Function, typename Tuple, std::size_t... Is>
-auto nd::detail::transform_tuple_impl(Function&& fn, const Tuple& t, std::index_sequence<Is...>)
+template<typename ValueType>
+struct nd::detail::min_accumulator_t
 {
-    return std::make_tuple(fn(std::get<Is>(t))...);
-}
+    bool add(const ValueType& x) { if (empty || x < value) value = x; empty = false; return true; }
+    void add_repeated(const ValueType& x, std::size_t count) { if (count) add(x); }
+    void combine(const min_accumulator_t& other) { if (! other.empty) add(other.value); }
+    ValueType result() const { return value; }
+    ValueType value = ValueType();
+    bool empty = true;
+};
 
-template<typename Function, typename Tuple>
-auto nd::detail::transform_tuple(Function&& fn, const Tuple& t)
+template<typename ValueType>
+struct nd::detail::max_accumulator_t
 {
-    return transform_tuple_impl(std::forward<Function>(fn), t, std::make_index_sequence<std::tuple_size<Tuple>::value>());
-}
+    bool add(const ValueType& x) { if (empty || x > value) value = x; empty = false; return true; }
+    void add_repeated(const ValueType& x, std::size_t count) { if (count) add(x); }
+    void combine(const max_accumulator_t& other) { if (! other.empty) add(other.value); }
+    ValueType result() const { return value; }
+    ValueType value = ValueType();
+    bool empty = true;
+};
 
-template<typename FunctionTuple, typename ArgumentTuple, std::size_t... Is>
-auto nd::detail::zip_apply_tuple_impl(FunctionTuple&& fn, ArgumentTuple&& args, std::index_sequence<Is...>)
+template<typename ValueType>
+struct nd::detail::all_accumulator_t
 {
-    return std::make_tuple(std::get<Is>(fn)(std::get<Is>(args))...);
-}
+    bool add(const ValueType& x) { value = bool(x); return value; }
+    void add_repeated(const ValueType& x, std::size_t count) { if (count) value = value && bool(x); }
+    void combine(const all_accumulator_t& other) { value = value && other.value; }
+    bool result() const { return value; }
+    bool value = true;
+};
 
-template<typename FunctionTuple, typename ArgumentTuple>
-auto nd::detail::zip_apply_tuple(FunctionTuple&& fn, ArgumentTuple&& args)
+template<typename ValueType>
+struct nd::detail::any_accumulator_t
 {
-    return zip_apply_tuple_impl(
-        std::forward<FunctionTuple>(fn),
-        std::forward<ArgumentTuple>(args),
-        std::make_index_sequence<std::tuple_size<ArgumentTuple>::value>());
-}
+    bool add(const ValueType& x) { value = bool(x); return ! value; }
+    void add_repeated(const ValueType& x, std::size_t count) { if (count) value = value || bool(x); }
+    void combine(const any_accumulator_t& other) { value = value || other.value; }
+    bool result() const { return value; }
+    bool value = false;
+};
 
-template<typename ArrayType, std::size_t... Is>
-auto nd::detail::unzip_array_impl(ArrayType array, std::index_sequence<Is...>)
+/**
+ * Map an index which may be outside [0, size) into it, by wrapping it around
+ * (periodic), by clamping it to the nearest edge, or by mirroring it at the
+ * edges (reflect, so that index -1 maps to 0, and size maps to size - 1).
+ */
+std::size_t nd::detail::boundary_index(long index, std::size_t size, boundary_t boundary)
 {
-    return std::make_tuple(get_through<Is>(array)...);
+    auto m = long(size);
+
+    if (index >= 0 && index < m)
+    {
+        return index;
+    }
+    if (boundary == boundary_t::periodic)
+    {
+        return ((index % m) + m) % m;
+    }
+    if (boundary == boundary_t::reflect)
+    {
+        auto i = ((index % (2 * m)) + 2 * m) % (2 * m);
+        return i < m ? i : 2 * m - 1 - i;
+    }
+    return std::min(std::max(index, 0l), m - 1);
 }
 
-template<typename ResultSequence, typename SourceSequence, typename IndexContainer, typename Sequence>
-auto nd::detail::insert_elements(const SourceSequence& source, IndexContainer indexes, Sequence values)
+/**
+ * Gives a stencil kernel the values around an element which is at least the
+ * stencil radius from the edges of the array, by pointer offsets from it.
+ */
+template<typename ValueType, std::size_t Rank>
+struct nd::detail::stencil_reader_t
 {
-    static_assert(indexes.size() == values.size());
+    const ValueType& operator()(const jumps_t<Rank>& delta) const
+    {
+        auto offset = std::ptrdiff_t(0);
 
-    auto source1_n = std::size_t(0);
-    auto source2_n = std::size_t(0);
-    auto result = ResultSequence();
+        for (std::size_t n = 0; n < Rank; ++n)
+        {
+            offset += delta[n] * strides[n];
+        }
+        return center[offset];
+    }
 
-    for (std::size_t n = 0; n < result.size(); ++n)
+    template<typename... Args>
+    const ValueType& operator()(Args... deltas) const
     {
-        if (std::find(std::begin(indexes), std::end(indexes), n) == std::end(indexes))
+        return operator()(make_jumps(deltas...));
+    }
+
+    const ValueType* center;
+    jumps_t<Rank> strides;
+};
+
+/**
+ * Gives a stencil kernel the values around an element near the edges of the
+ * array, wrapping (periodic) or clamping the indexes which fall outside it.
+ */
+template<typename ValueType, std::size_t Rank>
+struct nd::detail::boundary_reader_t
+{
+    const ValueType& operator()(const jumps_t<Rank>& delta) const
+    {
+        auto shape = source->shape();
+        auto index = index_t<Rank>();
+
+        for (std::size_t n = 0; n < Rank; ++n)
         {
-            result[n] = source[source1_n++];
+            index[n] = boundary_index(long(center[n]) + delta[n], shape[n], boundary);
         }
-        else
+        return (*source)(index);
+    }
+
+    template<typename... Args>
+    const ValueType& operator()(Args... deltas) const
+    {
+        return operator()(make_jumps(deltas...));
+    }
+
+    const strided_shared_provider_t<ValueType, Rank>* source;
+    index_t<Rank> center;
+    boundary_t boundary;
+};
+
+/**
+ * A stencil kernel given by the non-zero entries of an array of weights: the
+ * offsets from the center element, and the weights for each.
+ */
+template<typename ValueType, std::size_t Rank>
+struct nd::detail::stencil_weights_t
+{
+    template<typename Reader>
+    auto operator()(const Reader& at) const
+    {
+        auto result = decltype(weights[0] * at(deltas[0]))();
+
+        for (std::size_t k = 0; k < deltas.size(); ++k)
         {
-            result[n] = values[source2_n++];
+            result += weights[k] * at(deltas[k]);
         }
+        return result;
     }
-    return result;
-}
+
+    std::vector<jumps_t<Rank>> deltas;
+    std::vector<ValueType> weights;
+};
 
 template<typename ResultSequence, typename SourceSequence, typename IndexContainer>
 auto nd::detail::remove_elements(const SourceSequence& source, IndexContainer indexes)
@@ -1,5 +1,9 @@
 #include "ndarray.hpp"
 #include "catch.hpp"
+#if defined(__unix__) || defined(__APPLE__)
+#include <signal.h>
+#include <sys/wait.h>
+#endif
 
 
 
@@ -82,6 +86,61 @@ TEST_CASE("buffer works as expected", "[buffer]")
         REQUIRE(C[0] == 1.5);
         REQUIRE(C[99] == 1.5);
     }
+
+    SECTION("buffer memory is aligned to a cache line")
+    {
+        nd::buffer_t<char> A(3);
+        nd::buffer_t<double, nd::aligned_allocator_t<double, 256>> B(5);
+        REQUIRE(reinterpret_cast<std::uintptr_t>(A.data()) % 64 == 0);
+        REQUIRE(reinterpret_cast<std::uintptr_t>(B.data()) % 256 == 0);
+    }
+
+    SECTION("large buffers are allocated on huge page boundaries")
+    {
+        auto allocator = nd::aligned_allocator_t<double>(1 << 20);
+        nd::buffer_t<double> A(1 << 18, 2.0, allocator);
+        REQUIRE(A.get_allocator().huge_page_bytes == 1 << 20);
+        REQUIRE(reinterpret_cast<std::uintptr_t>(A.data()) % (1 << 21) == 0);
+        REQUIRE(A[(1 << 18) - 1] == 2.0);
+    }
+
+    SECTION("can instantiate an uninitialized buffer")
+    {
+        auto A = nd::buffer_t<double>::uninitialized(100);
+        auto B = nd::buffer_t<std::string>::uninitialized(3);
+        REQUIRE(A.size() == 100);
+        REQUIRE(B.size() == 3);
+        REQUIRE(B[2].empty());
+        REQUIRE(nd::buffer_t<int>::uninitialized(0).data() == nullptr);
+    }
+
+    SECTION("memory is freed if constructing an element throws")
+    {
+        struct throwing_t
+        {
+            throwing_t(int* remaining) : remaining(remaining) {}
+            throwing_t(const throwing_t& other) : remaining(other.remaining)
+            {
+                if ((*remaining)-- == 0)
+                {
+                    throw std::runtime_error("copy failed");
+                }
+            }
+            int* remaining;
+        };
+        auto remaining = 100;
+        auto values = std::vector<throwing_t>(4, throwing_t(&remaining));
+        auto pool = nd::buffer_pool_t();
+        auto scope = pool.use();
+
+        remaining = 2;
+        REQUIRE_THROWS_AS((nd::buffer_t<throwing_t>(4, values[0])), std::runtime_error);
+        REQUIRE(pool.cached_bytes() == 64);
+        remaining = 2;
+        REQUIRE_THROWS_AS((nd::buffer_t<throwing_t>(values.begin(), values.end())), std::runtime_error);
+        REQUIRE(pool.cached_bytes() == 64);
+        REQUIRE(pool.misses() == 1);
+    }
 }
 
 TEST_CASE("access patterns work OK", "[access_pattern]")
@@ -501,3 +560,1390 @@ TEST_CASE("can shift an array", "[shift]")
     REQUIRE((A | nd::shift_by(+2).along_axis(0) | nd::read_index(2, 0)) == nd::make_index(0, 0));
     REQUIRE((A | nd::shift_by(+2).along_axis(1) | nd::read_index(0, 2)) == nd::make_index(0, 0));
 }
+
+TEST_CASE("arrays can be evaluated in parallel", "[parallel] [thread_pool]")
+{
+    auto A = nd::index_array(13, 7, 5) | nd::map([] (auto i) { return i[0] * 100.0 + i[1] * 10.0 + i[2]; });
+    auto B = A | nd::to_shared();
+
+    SECTION("on the default thread pool")
+    {
+        auto C = A | nd::to_shared_parallel(4);
+        REQUIRE(C.shape() == B.shape());
+        REQUIRE(std::equal(B.data(), B.data() + B.size(), C.data()));
+        REQUIRE(bool((A.shared_parallel() == B) | nd::all()));
+        REQUIRE(bool((A | nd::evaluate_on<3>()) == B | nd::all()));
+    }
+    SECTION("with more threads than rows")
+    {
+        auto C = A | nd::to_shared_parallel(32);
+        REQUIRE(std::equal(B.data(), B.data() + B.size(), C.data()));
+    }
+    SECTION("on a user-supplied thread pool")
+    {
+        auto pool = nd::thread_pool_t(3);
+        auto C = A | nd::to_shared_parallel(pool);
+        REQUIRE(pool.size() == 3);
+        REQUIRE(std::equal(B.data(), B.data() + B.size(), C.data()));
+    }
+    SECTION("exceptions thrown by tasks reach the caller")
+    {
+        auto pool = nd::thread_pool_t(2);
+        REQUIRE_THROWS_AS(pool.run(4, [] (std::size_t n) { if (n == 2) throw std::runtime_error("task failed"); }), std::runtime_error);
+    }
+}
+
+TEST_CASE("shapes can be cut into tiles", "[partition_tiles] [make_tile_shape]")
+{
+    auto tiles = nd::partition_tiles(nd::make_shape(10, 7), nd::make_shape(4, 3));
+    auto covered = nd::make_unique_array<int>(10, 7);
+    REQUIRE(tiles.size() == 9);
+    REQUIRE(tiles.back().final == nd::make_index(10, 7));
+
+    for (auto tile : tiles)
+        for (auto index : tile)
+            covered(index) += 1;
+
+    REQUIRE(bool((covered.shared() == 1) | nd::all()));
+    REQUIRE(nd::partition_tiles(nd::make_shape(0, 7), nd::make_shape(4, 3)).empty());
+    REQUIRE(nd::make_tile_shape<double>(nd::make_shape(1000, 1000)) == nd::make_shape(4, 1000));
+    REQUIRE(nd::make_tile_shape<double>(nd::make_shape(10, 100000)) == nd::make_shape(1, 4096));
+    REQUIRE(nd::make_tile_shape<double>(nd::make_shape(8, 8), 4) == nd::make_shape(2, 8));
+}
+
+TEST_CASE("tile scheduler balances uneven work", "[tile_scheduler]")
+{
+    auto A = nd::index_array(64, 16) | nd::map([] (auto i)
+    {
+        auto x = 0.0;
+
+        for (std::size_t n = 0; n < (i[0] < 8 ? 2000u : 1u); ++n)
+            x += 1.0 / (n + 1);
+
+        return x + i[1];
+    });
+    auto scheduler = nd::tile_scheduler_t(4);
+    auto B = A | nd::to_shared_parallel(scheduler);
+    auto C = A | nd::to_shared();
+    auto tiles_executed = std::size_t(0);
+
+    for (auto s : scheduler.stats())
+        tiles_executed += s.tiles_executed;
+
+    REQUIRE(std::equal(B.data(), B.data() + B.size(), C.data()));
+    REQUIRE(scheduler.stats().size() == 4);
+    REQUIRE(scheduler.utilization().size() == 4);
+    REQUIRE(tiles_executed == nd::partition_tiles(A.shape(), nd::make_tile_shape<double>(A.shape(), 16)).size());
+}
+
+TEST_CASE("memory-backed arrays are evaluated with a flat copy", "[evaluate_as_unique] [shared_provider]")
+{
+    auto A = (nd::index_array(6, 5, 4) | nd::map([] (auto i) { return int(i[0] * 100 + i[1] * 10 + i[2]); })).shared();
+    auto B = A.unique();
+    auto C = A.shared_parallel(3);
+    static_assert(nd::detail::is_contiguous_provider<decltype(A)::provider_type>::value);
+    REQUIRE(B.data() != A.data());
+    REQUIRE(C.data() != A.data());
+    REQUIRE(std::equal(A.data(), A.data() + A.size(), B.data()));
+    REQUIRE(std::equal(A.data(), A.data() + A.size(), C.data()));
+    REQUIRE(B(5, 4, 3) == 543);
+}
+
+TEST_CASE("access patterns can be iterated row by row", "[for_each_row] [for_each_index]")
+{
+    auto pat = nd::make_access_pattern(4, 6, 9).with_start(1, 0, 2).with_jumps(1, 2, 3);
+    auto expected = std::vector<nd::index_t<3>>(pat.begin(), pat.end());
+    auto visited = std::vector<nd::index_t<3>>();
+    auto num_rows = std::size_t(0);
+
+    nd::for_each_index(pat, [&] (const auto& index) { visited.push_back(index); });
+    nd::for_each_row(pat, [&] (auto index, auto count) { REQUIRE(count == 3); REQUIRE(index[2] == 2); ++num_rows; });
+
+    REQUIRE(visited == expected);
+    REQUIRE(num_rows == 9);
+    REQUIRE_FALSE(nd::for_each_index(pat, [&] (const auto& index) { return index[1] < 2; }));
+    REQUIRE(nd::for_each_index(nd::make_access_pattern(0, 3), [] (const auto&) { return false; }));
+    REQUIRE((nd::zeros(0, 3) | nd::to_shared()).size() == 0);
+}
+
+TEST_CASE("operators on memory-backed arrays yield strided views", "[strided_shared_provider] [select] [shift] [freeze_axis]")
+{
+    auto A = (nd::index_array(6, 8) | nd::map([] (auto i) { return int(i[0] * 10 + i[1]); })).shared();
+    auto L = nd::index_array(6, 8) | nd::map([] (auto i) { return int(i[0] * 10 + i[1]); });
+
+    SECTION("select is zero-copy and agrees with the lazy version")
+    {
+        auto B = A | nd::select_from(1, 2).to(5, 8).jumping(2, 3);
+        static_assert(std::is_same<decltype(B), nd::strided_array<int, 2>>::value);
+        REQUIRE(B.shape() == nd::make_shape(2, 2));
+        REQUIRE(B.data() == A.data() + 10);
+        REQUIRE(bool((B == (L | nd::select_from(1, 2).to(5, 8).jumping(2, 3))) | nd::all()));
+        REQUIRE(bool(((B | nd::select_from(1, 0).to(2, 2)) == (L | nd::select_from(3, 2).to(4, 8).jumping(1, 3))) | nd::all()));
+        REQUIRE_FALSE(B.get_provider().is_contiguous());
+        REQUIRE_THROWS(B | nd::reshape(4));
+    }
+    SECTION("select_axis, shift_by and freeze_axis agree with the lazy versions")
+    {
+        REQUIRE(bool(((A | nd::select_axis(1).from(1).to(1).from_the_end().jumping(2)) == (L | nd::select_axis(1).from(1).to(1).from_the_end().jumping(2))) | nd::all()));
+        REQUIRE(bool(((A | nd::shift_by(-2).along_axis(1)) == (L | nd::shift_by(-2).along_axis(1))) | nd::all()));
+        REQUIRE(bool(((A | nd::shift_by(-3).along_axis(0)) == (L | nd::shift_by(-3).along_axis(0))) | nd::all()));
+        REQUIRE(bool(((A | nd::freeze_axis(0).at_index(4)) == (L | nd::freeze_axis(0).at_index(4))) | nd::all()));
+        REQUIRE(bool(((A | nd::freeze_axis(1).at_index(3)) == (L | nd::freeze_axis(1).at_index(3))) | nd::all()));
+        REQUIRE((A | nd::freeze_axis(1).at_index(3)).data() == A.data() + 3);
+    }
+    SECTION("strided views evaluate and reshape correctly")
+    {
+        auto B = A | nd::select_axis(0).from(2).to(4);
+        REQUIRE(B.get_provider().is_contiguous());
+        REQUIRE((B | nd::reshape(16))(9) == 31);
+        REQUIRE(bool(((A | nd::select_axis(1).jumping(3).to(8)).shared() == (L | nd::select_axis(1).jumping(3).to(8))) | nd::all()));
+        REQUIRE(bool(((A | nd::select_axis(1).jumping(3).to(8)).shared_parallel(2) == (L | nd::select_axis(1).jumping(3).to(8))) | nd::all()));
+    }
+}
+
+TEST_CASE("axes of an array can be permuted", "[permute_axes]")
+{
+    auto L = nd::index_array(5, 6, 7) | nd::map([] (auto i) { return int(i[0] * 100 + i[1] * 10 + i[2]); });
+    auto A = L.shared();
+
+    REQUIRE((L | nd::permute_axes(2, 0, 1)).shape() == nd::make_shape(7, 5, 6));
+    REQUIRE((L | nd::permute_axes(2, 0, 1) | nd::read_index(3, 1, 2)) == 123);
+    REQUIRE((A | nd::permute_axes(2, 0, 1) | nd::read_index(3, 1, 2)) == 123);
+    REQUIRE((A | nd::permute_axes(2, 0, 1)).data() == A.data());
+    REQUIRE_THROWS(nd::permute_axes(0, 0, 1));
+
+    for (auto order : {nd::make_index(0, 2, 1), nd::make_index(2, 1, 0), nd::make_index(1, 0, 2), nd::make_index(2, 0, 1)})
+    {
+        auto B = (A | nd::permute_axes(order)).shared();
+        auto C = (A | nd::permute_axes(order)).shared_parallel(3);
+        auto D = L | nd::permute_axes(order);
+        REQUIRE(bool((B == D) | nd::all()));
+        REQUIRE(bool((C == D) | nd::all()));
+    }
+    auto T = (nd::index_array(100, 70) | nd::map([] (auto i) { return double(i[0] * 1000 + i[1]); })).shared();
+    auto U = T | nd::permute_axes(1, 0) | nd::to_shared();
+    REQUIRE(U.shape() == nd::make_shape(70, 100));
+    REQUIRE(U(69, 99) == 99069.0);
+    REQUIRE(bool((U == (T | nd::permute_axes(1, 0) | nd::map([] (auto x) { return x; }))) | nd::all()));
+}
+
+TEST_CASE("reductions can run in parallel", "[sum] [min] [max] [all] [any] [parallel]")
+{
+    auto A = nd::index_array(97, 53) | nd::map([] (auto i) { return 1.0 / (1.0 + i[0] * 53 + i[1]); });
+    auto I = nd::index_array(97, 53) | nd::map([] (auto i) { return int(i[0] * 53 + i[1]) - 1000; });
+    auto pool = nd::thread_pool_t(3);
+
+    REQUIRE((I | nd::sum().in_parallel(4)) == (I | nd::sum()));
+    REQUIRE((I | nd::sum().on(pool)) == (I | nd::sum()));
+    REQUIRE((I | nd::min().in_parallel(4)) == -1000);
+    REQUIRE((I | nd::max().on(pool)) == 97 * 53 - 1001);
+    REQUIRE((I | nd::min()) == -1000);
+    REQUIRE(nd::max(I) == 97 * 53 - 1001);
+    REQUIRE(bool((I > -1001) | nd::all().in_parallel(4)));
+    REQUIRE_FALSE(bool((I > -1000) | nd::all().on(pool)));
+    REQUIRE(bool((I == 3000) | nd::any().in_parallel(4)));
+    REQUIRE_FALSE(bool((I == 9000) | nd::any().on(pool)));
+    REQUIRE(((I > 0) | nd::sum().in_parallel(2)) == 97 * 53 - 1001);
+    REQUIRE((A | nd::sum().in_parallel(4)) == Approx(A | nd::sum()));
+
+    auto s1 = A | nd::sum().deterministic();
+    auto s2 = A | nd::sum().deterministic().in_parallel(2);
+    auto s3 = A | nd::sum().deterministic().on(pool);
+    REQUIRE(s1 == s2);
+    REQUIRE(s1 == s3);
+    REQUIRE((nd::zeros<double>(0, 4) | nd::sum().in_parallel(2)) == 0.0);
+}
+
+TEST_CASE("reductions along an axis of a memory-backed array are eager", "[collect] [sum] [min] [max] [all] [any]")
+{
+    auto L = nd::index_array(7, 5, 6) | nd::map([] (auto i) { return int(i[0] * 30 + i[1] * 6 + i[2]) % 17 - 8; });
+    auto S = L | nd::to_shared();
+    auto T = S | nd::permute_axes(2, 0, 1);
+    auto P = L | nd::permute_axes(2, 0, 1);
+    auto pool = nd::thread_pool_t(3);
+
+    for (std::size_t axis = 0; axis < 3; ++axis)
+    {
+        auto eager = S | nd::collect(nd::sum()).along_axis(axis);
+        auto lazy = L | nd::collect(nd::sum()).along_axis(axis);
+
+        REQUIRE((std::is_same<decltype(eager)::provider_type, nd::shared_provider_t<int, 2>>::value));
+        REQUIRE(eager.shape() == lazy.shape());
+        REQUIRE(((eager == lazy) | nd::all()));
+        REQUIRE((((S | nd::collect(nd::sum().on(pool)).along_axis(axis)) == lazy) | nd::all()));
+        REQUIRE((((S | nd::collect(nd::min()).along_axis(axis)) == (L | nd::collect(nd::min()).along_axis(axis))) | nd::all()));
+        REQUIRE((((S | nd::collect(nd::max()).along_axis(axis)) == (L | nd::collect(nd::max()).along_axis(axis))) | nd::all()));
+        REQUIRE((((T | nd::collect(nd::sum()).along_axis(axis)) == (P | nd::collect(nd::sum()).along_axis(axis))) | nd::all()));
+        REQUIRE((((T | nd::collect(nd::max().in_parallel(2)).along_axis(axis)) == (P | nd::collect(nd::max()).along_axis(axis))) | nd::all()));
+
+        auto B = (S > 6) | nd::to_shared();
+        REQUIRE((((B | nd::collect(nd::any()).along_axis(axis)) == ((L > 6) | nd::collect(nd::any()).along_axis(axis))) | nd::all()));
+        REQUIRE((((B | nd::collect(nd::all()).along_axis(axis)) == ((L > 6) | nd::collect(nd::all()).along_axis(axis))) | nd::all()));
+    }
+}
+
+// The largest single allocation made through operator new while tracking is
+// on; used to check that small results don't reserve large buffers.
+static std::atomic<bool> track_allocations(false);
+static std::atomic<std::size_t> largest_allocation(0);
+
+void* operator new(std::size_t size)
+{
+    if (track_allocations)
+    {
+        auto seen = largest_allocation.load();
+
+        while (size > seen && ! largest_allocation.compare_exchange_weak(seen, size))
+        {
+        }
+    }
+    if (auto ptr = std::malloc(size ? size : 1))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+TEST_CASE("where evaluates its argument once, and can run in parallel", "[where] [parallel]")
+{
+    auto calls = std::make_shared<std::atomic<int>>(0);
+    auto A = nd::index_array(23, 11) | nd::map([calls] (auto i) { ++*calls; return (i[0] * 11 + i[1]) % 7 == 3; });
+    auto I = nd::where(A);
+
+    REQUIRE(*calls == 23 * 11);
+    REQUIRE(I.size() == 36);
+    REQUIRE(I(0) == nd::make_index(0, 3));
+    REQUIRE(I(1) == nd::make_index(0, 10));
+    REQUIRE(bool((A | nd::read_indexes(I)) | nd::all()));
+
+    auto J = nd::where_parallel(A, 3);
+    REQUIRE(J.size() == I.size());
+    REQUIRE(bool((J == I) | nd::all()));
+
+    auto F = nd::where_offsets(A);
+    auto G = nd::where_offsets_parallel(A, 3);
+    REQUIRE(F.size() == I.size());
+    REQUIRE(F(0) == 3);
+    REQUIRE(F(1) == 10);
+    REQUIRE(bool((F == G) | nd::all()));
+    REQUIRE(nd::where(nd::zeros<int>(4, 4)).size() == 0);
+    REQUIRE(nd::where_parallel(nd::ones<int>(2, 4), 4).size() == 8);
+
+    auto B = nd::index_array(600, 1000) | nd::map([] (auto i) { return i[1] % 2 == 1; });
+    auto H = nd::where_offsets(B);
+    REQUIRE(H.size() == 300000);
+    REQUIRE(bool((H == (nd::arange(1, 600000, 2) | nd::map([] (int i) { return std::size_t(i); }))) | nd::all()));
+    REQUIRE(bool((nd::where_offsets_parallel(B, 3) == H) | nd::all()));
+
+    SECTION("few matches don't reserve a full chunk")
+    {
+        auto C = nd::index_array(64, 64) | nd::map([] (auto i) { return i[0] * 64 + i[1] < 3; });
+        largest_allocation = 0;
+        track_allocations = true;
+        auto K = nd::where(C);
+        auto L = nd::where_offsets_parallel(C, 3);
+        track_allocations = false;
+        REQUIRE(K.size() == 3);
+        REQUIRE(L.size() == 3);
+        REQUIRE(largest_allocation < 4096);
+    }
+}
+
+TEST_CASE("buffers can be drawn from a pool", "[buffer]")
+{
+    auto pool = nd::buffer_pool_t();
+    auto step = [] (auto u)
+    {
+        auto v = nd::make_unique_array<double>(u.shape());
+
+        for (std::size_t i = 0; i < u.size(); ++i)
+        {
+            v.data()[i] = u.data()[i] + 1.0;
+        }
+        return std::move(v).shared();
+    };
+
+    SECTION("steady state loops allocate nothing new")
+    {
+        auto scope = pool.use();
+        auto u = nd::make_shared_array<double>(100, 10);
+
+        u = step(u) | nd::to_shared();
+        u = step(u) | nd::to_shared();
+        auto misses = pool.misses();
+
+        for (int n = 0; n < 10; ++n)
+        {
+            u = step(u) | nd::to_shared();
+        }
+        REQUIRE(pool.misses() == misses);
+        REQUIRE(pool.hits() >= 20);
+        REQUIRE(u(0, 0) == 12.0);
+        REQUIRE(nd::current_buffer_pool() == &pool);
+    }
+
+    SECTION("buffers return to the pool after the scope ends")
+    {
+        auto u = nd::shared_array<double, 1>();
+        {
+            auto scope = pool.use();
+            u = nd::make_shared_array<double>(1000);
+        }
+        REQUIRE(nd::current_buffer_pool() == nullptr);
+        REQUIRE(pool.cached_bytes() == 0);
+        u = nd::make_shared_array<double>(10);
+        REQUIRE(pool.cached_bytes() >= 8000);
+        pool.release();
+        REQUIRE(pool.cached_bytes() == 0);
+    }
+
+    SECTION("size classes are powers of two, then multiples of 2 MiB")
+    {
+        REQUIRE(nd::buffer_pool_t::size_class(1) == 64);
+        REQUIRE(nd::buffer_pool_t::size_class(65) == 128);
+        REQUIRE(nd::buffer_pool_t::size_class(4096) == 4096);
+        REQUIRE(nd::buffer_pool_t::size_class(1 << 21) == 1 << 21);
+        REQUIRE(nd::buffer_pool_t::size_class((1 << 21) + 1) == 2 << 21);
+        REQUIRE(nd::buffer_pool_t::size_class(5 << 21) == 5 << 21);
+    }
+
+    SECTION("blocks past the cached-bytes limit go back to the heap")
+    {
+        auto small_pool = nd::buffer_pool_t(10000);
+        {
+            auto scope = small_pool.use();
+            auto u = nd::make_unique_array<double>(1000);
+            auto v = nd::make_unique_array<double>(1000);
+        }
+        REQUIRE(small_pool.max_cached_bytes() == 10000);
+        REQUIRE(small_pool.cached_bytes() == 8192);
+    }
+}
+
+TEST_CASE("elementwise expressions over memory-backed arrays are evaluated flat", "[map] [binary_op] [parallel]")
+{
+    auto A = nd::linspace(1.0, 2.0, 60) | nd::to_shared() | nd::reshape(3, 4, 5);
+    auto B = nd::linspace(2.0, 3.0, 60) | nd::to_shared() | nd::reshape(3, 4, 5);
+    auto E = A + B * 2.0;
+    auto F = A < B;
+    auto G = nd::index_array(3, 4) | nd::map([] (auto i) { return i[0]; });
+
+    static_assert(nd::detail::is_flat_readable<decltype(E)::provider_type>::value);
+    static_assert(nd::detail::is_flat_readable<decltype(F)::provider_type>::value);
+    static_assert(! nd::detail::is_flat_readable<decltype(G)::provider_type>::value);
+
+    auto C = E | nd::to_shared();
+    auto D = E | nd::to_shared_parallel(3);
+
+    for (auto index : A.indexes())
+    {
+        REQUIRE(C(index) == A(index) + B(index) * 2.0);
+        REQUIRE(D(index) == C(index));
+    }
+    REQUIRE(E.get_provider().at_offset(59) == 2.0 + 3.0 * 2.0);
+    REQUIRE(bool(((A < B) | nd::to_shared()) | nd::all()));
+    REQUIRE(bool(((-A | nd::map([] (double x) { return x * x; })) == (A * A)) | nd::all()));
+    REQUIRE(((nd::index_array(3, 4, 5) | nd::map([] (auto i) { return double(i[2]); })) + A | nd::to_shared())(0, 0, 4) == A(0, 0, 4) + 4.0);
+
+    static_assert(nd::detail::is_packable<decltype(E)::provider_type>::value);
+    static_assert(nd::detail::is_packable<decltype(F)::provider_type>::value);
+    static_assert(! nd::detail::is_packable<decltype(A + 2)::provider_type>::value);
+    static_assert(! nd::detail::is_packable<decltype(-A + B)::provider_type>::value);
+
+    SECTION("every pack kernel the CPU supports agrees with the scalar loop")
+    {
+        auto X = nd::linspace(0.0, 1.0, 101) | nd::to_shared();
+        auto Y = X | nd::map([] (double x) { return 1.0 - x; }) | nd::to_shared();
+        auto P = X | nd::map([] (double x) { return float(x); }) | nd::to_shared();
+        auto I = nd::arange(101) | nd::to_shared();
+        auto detected = nd::simd_level();
+
+        for (int level = 0; level <= int(detected); ++level)
+        {
+            nd::simd_level() = nd::simd_level_t(level);
+            REQUIRE(bool((((X * Y - X / 3.0) | nd::to_shared_parallel(3)) == (X | nd::map([] (double x) { return x * (1.0 - x) - x / 3.0; }))) | nd::all()));
+            REQUIRE(bool((((P + P * 2.0f) | nd::to_shared()) == (P | nd::map([] (float x) { return x + x * 2.0f; }))) | nd::all()));
+            REQUIRE(bool((((I * I - I / 3) | nd::to_shared_parallel(3)) == (I | nd::map([] (int i) { return i * i - i / 3; }))) | nd::all()));
+            REQUIRE(((X < Y) | nd::to_shared_parallel(3) | nd::map([] (bool b) { return int(b); }) | nd::sum()) == 50);
+            REQUIRE(((X >= Y) | nd::to_shared() | nd::map([] (bool b) { return int(b); }) | nd::sum()) == 51);
+        }
+        nd::simd_level() = detected;
+    }
+}
+
+TEST_CASE("expression trees can be introspected", "[map] [binary_op] [select]")
+{
+    auto A = nd::linspace(1.0, 2.0, 20) | nd::to_shared() | nd::reshape(4, 5);
+    auto B = nd::index_array(4, 5) | nd::map([] (auto i) { return double(i[0]); });
+    auto E = A * 2.0 + A;
+    auto F = B | nd::select_from(1, 1).to(4, 5);
+    using E_provider = decltype(E)::provider_type;
+    using F_provider = decltype(F)::provider_type;
+
+    static_assert(nd::provider_traits<decltype(A)::provider_type>::is_contiguous);
+    static_assert(nd::provider_traits<E_provider>::is_elementwise);
+    static_assert(nd::provider_traits<E_provider>::is_flat_readable);
+    static_assert(! nd::provider_traits<E_provider>::is_contiguous);
+    static_assert(! nd::provider_traits<decltype(B)::provider_type>::is_flat_readable);
+    static_assert(std::is_same<F_provider, nd::strided_provider_t<decltype(B)::provider_type>>::value);
+    static_assert(std::tuple_size<decltype(nd::leaf_providers(E.get_provider()))>::value == 3);
+    static_assert(nd::provider_traits<std::tuple_element_t<1, decltype(nd::leaf_providers(E.get_provider()))>>::is_uniform);
+
+    REQUIRE(F.shape() == nd::make_shape(3, 4));
+    REQUIRE(F(2, 3) == 3.0);
+    REQUIRE(std::get<0>(nd::leaf_providers(E.get_provider())).data() == A.data());
+    REQUIRE((E | nd::sum()) == Approx(3.0 * (A | nd::sum())));
+    REQUIRE((E | nd::sum().in_parallel(3)) == Approx(E | nd::sum()));
+    REQUIRE((E | nd::sum().deterministic()) == (E | nd::sum().deterministic().in_parallel(2)));
+    REQUIRE((E | nd::max()) == 6.0);
+    REQUIRE_FALSE(bool((A > 1.5) | nd::all()));
+}
+
+TEST_CASE("binary operators broadcast their operands", "[binary_op] [broadcast]")
+{
+    auto A = nd::linspace(0.0, 11.0, 12) | nd::to_shared() | nd::reshape(3, 4);
+    auto row = nd::linspace(0.0, 300.0, 4) | nd::to_shared();
+    auto col = nd::linspace(1.0, 3.0, 3) | nd::to_shared() | nd::reshape(3, 1);
+    auto B = A + row;
+    auto C = A * col;
+    auto D = row + col;
+
+    REQUIRE(B.shape() == nd::make_shape(3, 4));
+    REQUIRE(C.shape() == nd::make_shape(3, 4));
+    REQUIRE(D.shape() == nd::make_shape(3, 4));
+    REQUIRE_FALSE(B.get_provider().is_flat());
+    REQUIRE((A + A).get_provider().is_flat());
+
+    for (auto index : A.indexes())
+    {
+        REQUIRE(B(index) == A(index) + row(index[1]));
+        REQUIRE(C(index) == A(index) * col(index[0], 0));
+        REQUIRE(D(index) == row(index[1]) + col(index[0], 0));
+    }
+    auto E = (B - C + 1.0) | nd::to_shared();
+    auto F = (B - C + 1.0) | nd::to_shared_parallel(3);
+    REQUIRE(bool((E == F) | nd::all()));
+    REQUIRE(E(2, 3) == A(2, 3) + row(3) - A(2, 3) * col(2, 0) + 1.0);
+    REQUIRE((C | nd::sum()) == Approx(1.0 * 6 + 2.0 * 22 + 3.0 * 38));
+    REQUIRE(((row + (nd::index_array(3, 4) | nd::map([] (auto i) { return double(i[0]); }))) | nd::to_shared())(2, 1) == 102.0);
+    REQUIRE_THROWS(A + nd::linspace(0.0, 1.0, 3));
+    REQUIRE_THROWS(A + (nd::ones<double>(2, 1)));
+}
+
+TEST_CASE("uniform arrays reshape, select, and reduce in constant time", "[uniform] [reshape] [reduction]")
+{
+    auto A = nd::ones<double>(10, 20);
+    auto Z = nd::zeros<int>(6);
+
+    static_assert(std::is_same<decltype(A), nd::uniform_array<double, 2>>::value);
+    static_assert(nd::provider_traits<decltype(A)::provider_type>::is_uniform);
+
+    auto B = A | nd::reshape(3, 7, 5);
+    REQUIRE(B.shape() == nd::make_shape(3, 7, 5));
+    REQUIRE(B(2, 6, 4) == 1.0);
+    REQUIRE((A | nd::select_from(2, 4).to(5, 10)).shape() == nd::make_shape(3, 6));
+    REQUIRE((A | nd::select_axis(1).from(3).to(3).from_the_end()).shape() == nd::make_shape(10, 14));
+    REQUIRE((A | nd::shift_by(-2).along_axis(1)).shape() == nd::make_shape(10, 18));
+    REQUIRE((A | nd::freeze_axis(0).at_index(2)).shape() == nd::make_shape(20));
+    REQUIRE((A | nd::permute_axes(1, 0)).shape() == nd::make_shape(20, 10));
+    REQUIRE(nd::provider_traits<decltype(A | nd::select_from(2, 4).to(5, 10))::provider_type>::is_uniform);
+
+    REQUIRE((A | nd::sum()) == 200.0);
+    REQUIRE((Z | nd::sum()) == 0);
+    REQUIRE((A | nd::min()) == 1.0);
+    REQUIRE((A | nd::max()) == 1.0);
+    REQUIRE((A | nd::all()));
+    REQUIRE_FALSE((Z | nd::any()));
+    REQUIRE((nd::zeros<double>(0) | nd::all()));
+
+    auto C = A | nd::collect(nd::sum()).along_axis(1);
+    REQUIRE(nd::provider_traits<decltype(C)::provider_type>::is_uniform);
+    REQUIRE(C.shape() == nd::make_shape(10));
+    REQUIRE(C(4) == 20.0);
+
+    auto D = A * 3.0 + nd::ones<double>(20);
+    static_assert(std::is_same<decltype(D), nd::uniform_array<double, 2>>::value);
+    REQUIRE(D.shape() == nd::make_shape(10, 20));
+    REQUIRE(D(9, 19) == 4.0);
+    REQUIRE(((A | nd::map([] (double x) { return x > 0.5; })) | nd::all()));
+    REQUIRE_THROWS(A + nd::ones<double>(3));
+
+    auto E = (nd::linspace(0.0, 1.0, 20) | nd::to_shared()) + A;
+    REQUIRE_FALSE(nd::provider_traits<decltype(E)::provider_type>::is_uniform);
+    REQUIRE((E | nd::sum()) == Approx(200.0 + 10 * 10.0));
+}
+
+TEST_CASE("arrays can be memory-mapped from a file", "[mmap]")
+{
+    auto filename = std::string("ndarray_test_mmap.bin");
+    auto values = nd::linspace(0.0, 23.0, 24) | nd::to_shared();
+    auto header = std::string(16, 'h');
+
+    {
+        auto file = std::fopen(filename.data(), "wb");
+        std::fwrite(header.data(), 1, header.size(), file);
+        std::fwrite(values.data(), sizeof(double), values.size(), file);
+        std::fclose(file);
+    }
+
+    SECTION("a read-only mapping behaves like a shared array")
+    {
+        auto A = nd::map_file<double>(filename, nd::make_shape(4, 6), 16);
+        static_assert(std::is_same<decltype(A), nd::mapped_array<double, 2>>::value);
+        static_assert(nd::provider_traits<decltype(A)::provider_type>::is_contiguous);
+
+        REQUIRE(A.shape() == nd::make_shape(4, 6));
+        REQUIRE(A(2, 3) == 15.0);
+        REQUIRE(A.data()[23] == 23.0);
+        REQUIRE((A | nd::reshape(24))(17) == 17.0);
+        REQUIRE((A | nd::sum()) == Approx(276.0));
+        REQUIRE(bool(((A | nd::to_shared() | nd::reshape(24)) == values) | nd::all()));
+        REQUIRE(bool(((A | nd::to_shared_parallel(2) | nd::reshape(24)) == values) | nd::all()));
+
+        auto B = A | nd::select_from(1, 2).to(4, 6);
+        static_assert(nd::provider_traits<decltype(B)::provider_type>::is_strided);
+        REQUIRE(B.data() == A.data() + 8);
+        REQUIRE(B(0, 0) == 8.0);
+        REQUIRE((A | nd::collect(nd::sum()).along_axis(0))(1) == 1.0 + 7.0 + 13.0 + 19.0);
+        REQUIRE((A | nd::read_indexes(nd::where(A > 20.0)))(1) == 22.0);
+        REQUIRE_THROWS(A.get_provider().writable_data());
+    }
+
+    SECTION("a copy-on-write mapping can be written to without changing the file")
+    {
+        auto A = nd::map_file<double>(filename, nd::make_shape(24), 16, nd::map_mode_t::copy_on_write);
+        A.get_provider().writable_data()[0] = 100.0;
+        REQUIRE(A(0) == 100.0);
+        REQUIRE(nd::map_file<double>(filename, nd::make_shape(24), 16)(0) == 0.0);
+    }
+
+    SECTION("mapping fails for missing, short, or misaligned files")
+    {
+        REQUIRE_THROWS(nd::map_file<double>("ndarray_test_missing.bin", nd::make_shape(1)));
+        REQUIRE_THROWS(nd::map_file<double>(filename, nd::make_shape(25), 16));
+        REQUIRE_THROWS(nd::map_file<double>(filename, nd::make_shape(2), 3));
+    }
+
+#if defined(__linux__)
+    SECTION("selections of a mapping advise only the pages they span")
+    {
+        auto rows = nd::index_array(64, 512) | nd::map([] (auto i) { return double(i[0]); }) | nd::to_shared();
+        auto file = std::fopen(filename.data(), "wb");
+        std::fwrite(rows.data(), sizeof(double), rows.size(), file);
+        std::fclose(file);
+
+        // address ranges of this process's mappings flagged for sequential read
+        auto sequential_ranges = [] ()
+        {
+            auto ranges = std::vector<std::pair<std::uintptr_t, std::uintptr_t>>();
+            auto smaps = std::fopen("/proc/self/smaps", "r");
+            auto line = std::array<char, 512>();
+            auto range = std::pair<std::uintptr_t, std::uintptr_t>();
+
+            while (std::fgets(line.data(), line.size(), smaps))
+            {
+                auto first = 0ul, final = 0ul;
+
+                if (std::sscanf(line.data(), "%lx-%lx ", &first, &final) == 2)
+                {
+                    range = { first, final };
+                }
+                else if (std::strncmp(line.data(), "VmFlags:", 8) == 0 && std::strstr(line.data(), " sr"))
+                {
+                    ranges.push_back(range);
+                }
+            }
+            std::fclose(smaps);
+            return ranges;
+        };
+        auto A = nd::map_file<double>(filename, nd::make_shape(64, 512));
+        auto base = reinterpret_cast<std::uintptr_t>(A.data());
+        auto B = A | nd::select_from(16, 0).to(32, 512) | nd::to_shared();
+
+        REQUIRE(B(0, 0) == 16.0);
+        REQUIRE(sequential_ranges() == std::vector<std::pair<std::uintptr_t, std::uintptr_t>>{{base + 16 * 4096, base + 32 * 4096}});
+
+        A | nd::select_from(40, 0).to(48, 512) | nd::stream_to([] (const auto&, const double*) {}, nd::make_shape(4, 512));
+        REQUIRE(sequential_ranges().size() == 2);
+        REQUIRE(sequential_ranges()[1] == std::make_pair(base + 40 * 4096, base + 48 * 4096));
+    }
+#endif
+    std::remove(filename.data());
+}
+
+TEST_CASE("arrays can be saved to and loaded from npy files", "[npy] [mmap]")
+{
+    auto filename = std::string("ndarray_test.npy");
+
+    SECTION("memory-backed and lazy arrays round trip")
+    {
+        auto A = nd::linspace(0.0, 1.0, 60) | nd::to_shared() | nd::reshape(3, 4, 5);
+        nd::save_npy(A, filename);
+        auto B = nd::load_npy<double, 3>(filename);
+        auto C = nd::map_npy<double, 3>(filename);
+
+        REQUIRE(B.shape() == A.shape());
+        REQUIRE(C.shape() == A.shape());
+        REQUIRE(bool((A == B) | nd::all()));
+        REQUIRE(bool((A == C) | nd::all()));
+        REQUIRE(reinterpret_cast<std::uintptr_t>(C.data()) % 64 == 0);
+
+        auto D = nd::index_array(5000, 300) | nd::map([] (auto i) { return int(i[0] * 300 + i[1]); });
+        nd::save_npy(D, filename);
+        auto E = nd::load_npy<int, 2>(filename);
+        REQUIRE(E.shape() == D.shape());
+        REQUIRE(bool((D == E) | nd::all()));
+
+        nd::save_npy(nd::ones<unsigned char>(7), filename);
+        REQUIRE((nd::load_npy<unsigned char, 1>(filename) | nd::sum()) == 7);
+    }
+
+    SECTION("files in Fortran order are loaded in row-major order")
+    {
+        auto header = std::string("\x93NUMPY\x01\x00\x76\x00", 10)
+        + "{'descr': '<i4', 'fortran_order': True, 'shape': (2, 3), }"
+        + std::string(59, ' ') + "\n";
+        auto values = std::vector<std::int32_t>{0, 3, 1, 4, 2, 5};
+        auto file = std::fopen(filename.data(), "wb");
+        std::fwrite(header.data(), 1, header.size(), file);
+        std::fwrite(values.data(), sizeof(std::int32_t), values.size(), file);
+        std::fclose(file);
+
+        auto A = nd::load_npy<std::int32_t, 2>(filename);
+        REQUIRE(A.shape() == nd::make_shape(2, 3));
+        REQUIRE(A(0, 1) == 1);
+        REQUIRE(A(1, 0) == 3);
+        REQUIRE(A(1, 2) == 5);
+        REQUIRE(std::equal(A.data(), A.data() + 6, std::vector<std::int32_t>{0, 1, 2, 3, 4, 5}.begin()));
+        REQUIRE_THROWS(nd::map_npy<std::int32_t, 2>(filename));
+    }
+
+    SECTION("the dtype and rank must match the file")
+    {
+        nd::save_npy(nd::linspace(0.0, 1.0, 10), filename);
+        REQUIRE_NOTHROW(nd::load_npy<double, 1>(filename));
+        REQUIRE_THROWS(nd::load_npy<float, 1>(filename));
+        REQUIRE_THROWS(nd::load_npy<double, 2>(filename));
+        REQUIRE_THROWS(nd::map_npy<std::int64_t, 1>(filename));
+        REQUIRE_THROWS(nd::load_npy<double, 1>("ndarray_test_missing.npy"));
+    }
+
+    SECTION("corrupt header lengths are rejected before anything is allocated")
+    {
+        for (auto preamble : {std::string("\x93NUMPY\x02\x00\xff\xff\xff\xff", 12), std::string("\x93NUMPY\x01\x00\x00\x01", 10)})
+        {
+            auto file = std::fopen(filename.data(), "wb");
+            auto dict = std::string("{'descr': '<f8', 'fortran_order': False, 'shape': (1,), }\n");
+            std::fwrite(preamble.data(), 1, preamble.size(), file);
+            std::fwrite(dict.data(), 1, dict.size(), file);
+            std::fclose(file);
+            REQUIRE_THROWS_WITH((nd::load_npy<double, 1>(filename)), Catch::Contains("corrupt npy header"));
+            REQUIRE_THROWS_WITH((nd::map_npy<double, 1>(filename)), Catch::Contains("corrupt npy header"));
+        }
+    }
+
+#if defined(__linux__)
+    SECTION("a failed write stops the evaluation of further blocks")
+    {
+        auto evaluated = std::size_t(0);
+        auto A = nd::index_array(1 << 20) | nd::map([&evaluated] (auto i) { ++evaluated; return double(i[0]); });
+        REQUIRE_THROWS_AS(nd::save_npy(A, "/dev/full"), std::runtime_error);
+        REQUIRE(evaluated == (1 << 19));
+    }
+#endif
+    std::remove(filename.data());
+}
+
+TEST_CASE("arrays can be saved to and loaded from chunked files", "[chunked]")
+{
+    auto filename = std::string("ndarray_test.chunked");
+    auto A = nd::index_array(10, 12) | nd::map([] (auto i) { return std::sin(0.1 * i[0]) + 1e-3 * i[1]; });
+
+    SECTION("compressed, shuffled chunks round trip and are read on demand")
+    {
+        nd::save_chunked(A, filename, nd::make_shape(4, 5), nd::chunk_codec_t::lz, true, 2);
+        auto B = nd::load_chunked<double, 2>(filename, 3);
+        auto& provider = B.get_provider();
+
+        REQUIRE(B.shape() == A.shape());
+        REQUIRE(provider.num_chunks() == 9);
+        REQUIRE(provider.num_chunk_reads() == 0);
+        REQUIRE(bool(((B | nd::select_from(4, 5).to(8, 10) | nd::to_shared()) == (A | nd::select_from(4, 5).to(8, 10))) | nd::all()));
+        REQUIRE(provider.num_chunk_reads() == 1);
+        REQUIRE(bool((B == A) | nd::all()));
+        REQUIRE(provider.num_chunk_reads() == 1 + 9);
+        REQUIRE(bool(((B | nd::to_shared_parallel(3)) == A) | nd::all()));
+    }
+
+    SECTION("compression shrinks files of repetitive data")
+    {
+        auto file_size = [&filename] ()
+        {
+            auto file = std::fopen(filename.data(), "rb");
+            std::fseek(file, 0, SEEK_END);
+            auto size = std::ftell(file);
+            std::fclose(file);
+            return std::size_t(size);
+        };
+        auto C = nd::ones<float>(64, 64) | nd::to_shared();
+
+        nd::save_chunked(C, filename, nd::make_shape(16, 64), nd::chunk_codec_t::none, false);
+        REQUIRE(file_size() > C.size() * sizeof(float));
+        REQUIRE((nd::load_chunked<float, 2>(filename) | nd::sum()) == 4096.f);
+
+        nd::save_chunked(C, filename, nd::make_shape(16, 64));
+        REQUIRE(file_size() < C.size() * sizeof(float) / 16);
+        REQUIRE((nd::load_chunked<float, 2>(filename) | nd::sum()) == 4096.f);
+
+        nd::save_chunked(nd::linspace(0.0, 1.0, 1000), filename, nd::make_shape(64));
+        REQUIRE(bool((nd::load_chunked<double, 1>(filename, 1) == nd::linspace(0.0, 1.0, 1000)) | nd::all()));
+        REQUIRE_THROWS(nd::load_chunked<float, 1>(filename));
+        REQUIRE_THROWS(nd::load_chunked<double, 2>(filename));
+    }
+
+    SECTION("the codec is read from the header, and chunks which don't match it are rejected")
+    {
+        auto patch_header = [&filename] (std::string from, std::string to)
+        {
+            auto file = std::fopen(filename.data(), "r+b");
+            auto header = std::string(256, '\0');
+            header.resize(std::fread(&header[0], 1, header.size(), file));
+            REQUIRE(header.find(from) != std::string::npos);
+            std::fseek(file, long(header.find(from)), SEEK_SET);
+            std::fwrite(to.data(), 1, to.size(), file);
+            std::fclose(file);
+        };
+        nd::save_chunked(nd::ones<float>(64, 64) | nd::to_shared(), filename, nd::make_shape(16, 64));
+        patch_header("'codec': 'lz', ", "'codec':'none',");
+        REQUIRE_THROWS_AS((nd::load_chunked<float, 2>(filename) | nd::sum()), std::runtime_error);
+        patch_header("'codec':'none',", "'codec':'zstd',");
+        REQUIRE_THROWS_AS((nd::load_chunked<float, 2>(filename)), std::runtime_error);
+    }
+    std::remove(filename.data());
+}
+
+TEST_CASE("arrays can be written to a sink in the background", "[async_write] [io]")
+{
+    auto filename = std::string("ndarray_test_async.bin");
+    auto A = nd::index_array(37, 101) | nd::map([] (auto i) { return double(i[0] * 101 + i[1]); });
+    auto B = A | nd::to_shared();
+    auto read_back = [&filename] ()
+    {
+        auto values = std::vector<double>(37 * 101);
+        auto file = std::fopen(filename.data(), "rb");
+        auto count = std::fread(values.data(), sizeof(double), values.size() + 1, file);
+        std::fclose(file);
+        return std::make_pair(count, values);
+    };
+
+    SECTION("lazy and memory-backed arrays are written in row-major order")
+    {
+        for (bool direct : {false, true})
+        {
+            auto future = nd::async_write(A, nd::file_sink_t(filename, direct), 1000);
+            future.get();
+            auto [count, values] = read_back();
+            REQUIRE(count == B.size());
+            REQUIRE(std::equal(values.begin(), values.end(), B.data()));
+
+            nd::async_write(B | nd::select_from(0, 1).to(37, 101), nd::file_sink_t(filename, direct)).get();
+            REQUIRE(read_back().first == 37 * 100);
+            REQUIRE(read_back().second[100] == 102.0);
+        }
+    }
+
+    SECTION("writes are queued in order, and errors reach the future")
+    {
+        auto written = std::make_shared<std::vector<double>>();
+
+        struct vector_sink_t
+        {
+            void write(const void* data, std::size_t bytes)
+            {
+                auto values = static_cast<const double*>(data);
+                target->insert(target->end(), values, values + bytes / sizeof(double));
+                sizes.push_back(bytes);
+            }
+            void close() {}
+            std::shared_ptr<std::vector<double>> target;
+            std::vector<std::size_t> sizes;
+        };
+        struct failing_sink_t
+        {
+            void write(const void*, std::size_t) { throw std::runtime_error("disk full"); }
+            void close() {}
+        };
+        auto first = nd::async_write(B, vector_sink_t{written, {}}, 512);
+        auto second = nd::async_write(A * 2.0, vector_sink_t{written, {}}, 512);
+        auto third = nd::async_write(A, failing_sink_t(), 512);
+        first.get();
+        second.get();
+        REQUIRE(written->size() == 2 * B.size());
+        REQUIRE(written->at(B.size() + 5) == 10.0);
+        REQUIRE_THROWS_WITH(third.get(), "disk full");
+
+        auto sink = vector_sink_t{written, {}};
+        nd::detail::write_double_buffered(A.get_provider(), sink, 1000);
+        REQUIRE(sink.sizes.size() > 1);
+        REQUIRE(std::all_of(sink.sizes.begin(), sink.sizes.end() - 1, [] (auto n) { return n == nd::file_sink_t::block_size; }));
+    }
+    std::remove(filename.data());
+}
+
+TEST_CASE("arrays can be streamed to a sink block by block", "[stream_to]")
+{
+    auto A = nd::index_array(7, 9, 4) | nd::map([] (auto i) { return double(i[0] * 36 + i[1] * 4 + i[2]); });
+    auto B = A | nd::to_shared();
+
+    SECTION("blocks arrive in row-major order, through one reused buffer")
+    {
+        auto target = nd::make_unique_array<double>(7, 9, 4);
+        auto buffers = std::vector<const double*>();
+        auto num_blocks = std::size_t(0);
+
+        A | nd::stream_to([&] (const nd::access_pattern_t<3>& region, const double* data)
+        {
+            for (auto index : region)
+            {
+                target(index) = *data++;
+            }
+            buffers.push_back(data - region.size());
+            ++num_blocks;
+        }, nd::make_shape(3, 4, 4));
+
+        REQUIRE(num_blocks == 3 * 3);
+        REQUIRE(std::count(buffers.begin(), buffers.end(), buffers[0]) == 9);
+        REQUIRE(bool((std::move(target).shared() == B) | nd::all()));
+    }
+
+    SECTION("memory-backed, strided, and lazy sources stream identically")
+    {
+        auto collect = [] (auto array)
+        {
+            auto values = std::vector<double>();
+            array | nd::stream_to([&values] (const auto&, const double* data) { values.push_back(*data); }, nd::make_shape(2, 2, 2));
+            return values;
+        };
+        REQUIRE(collect(A) == collect(B));
+        REQUIRE(collect(A | nd::permute_axes(2, 1, 0)) == collect(B | nd::permute_axes(2, 1, 0)));
+        REQUIRE(collect(A * 2.0) == collect(B * 2.0));
+    }
+
+    SECTION("a sink can accumulate a result, and byte sinks need contiguous blocks")
+    {
+        struct running_sum_t
+        {
+            void operator()(const nd::access_pattern_t<3>& region, const double* data) { total = std::accumulate(data, data + region.size(), total); }
+            double total = 0.0;
+        };
+        REQUIRE((A | nd::stream_to(running_sum_t(), nd::make_shape(1, 9, 4))).total == (B | nd::sum()));
+
+        struct byte_sink_t
+        {
+            void write(const void* data, std::size_t bytes) { values.insert(values.end(), (const double*) data, (const double*) data + bytes / sizeof(double)); }
+            std::vector<double> values;
+        };
+        REQUIRE((A | nd::stream_to(byte_sink_t(), nd::make_shape(2, 9, 4))).values == std::vector<double>(B.data(), B.data() + B.size()));
+        REQUIRE((A | nd::stream_to(byte_sink_t(), nd::make_shape(1, 3, 4))).values == std::vector<double>(B.data(), B.data() + B.size()));
+        REQUIRE_THROWS(A | nd::stream_to(byte_sink_t(), nd::make_shape(2, 3, 4)));
+        REQUIRE_THROWS(A | nd::stream_to(byte_sink_t(), nd::make_shape(2, 9, 2)));
+        REQUIRE_THROWS(A | nd::stream_to(byte_sink_t(), nd::make_shape(0, 9, 4)));
+
+        auto stream = nd::stream_to(byte_sink_t(), nd::make_shape(2, 9, 4));
+        REQUIRE((A | stream).values.size() == B.size());
+        REQUIRE((A | stream).values.size() == 2 * B.size());
+    }
+
+    SECTION("sinks are closed after the last block, unless passed by reference")
+    {
+        struct closing_sink_t
+        {
+            void write(const void*, std::size_t bytes) { written += bytes; }
+            void close() { if (fail) throw std::runtime_error("close failed"); ++closes; }
+            std::size_t written = 0;
+            int closes = 0;
+            bool fail = false;
+        };
+        REQUIRE((A | nd::stream_to(closing_sink_t(), nd::make_shape(2, 9, 4))).closes == 1);
+
+        auto failing = closing_sink_t();
+        failing.fail = true;
+        REQUIRE_THROWS_AS(A | nd::stream_to(failing, nd::make_shape(2, 9, 4)), std::runtime_error);
+
+        auto sink = closing_sink_t();
+        A | nd::stream_to(std::ref(sink), nd::make_shape(2, 9, 4));
+        B | nd::stream_to(std::ref(sink), nd::make_shape(1, 9, 4));
+        REQUIRE(sink.written == 2 * B.size() * sizeof(double));
+        REQUIRE(sink.closes == 0);
+    }
+
+#if defined(__linux__)
+    SECTION("a file sink which cannot be written throws from the last block")
+    {
+        REQUIRE_THROWS_AS(A | nd::stream_to(nd::file_sink_t("/dev/full"), nd::make_shape(7, 9, 4)), std::runtime_error);
+        REQUIRE_THROWS_AS(A | nd::stream_to(nd::file_sink_t("/dev/full", true), nd::make_shape(7, 9, 4)), std::runtime_error);
+    }
+#endif
+}
+
+TEST_CASE("lazy sub-expressions can be cached", "[cached_provider]")
+{
+    auto num_calls = std::make_shared<std::atomic<int>>(0);
+    auto expensive = [num_calls] (double x) { ++*num_calls; return x * x; };
+    auto A = nd::linspace(0.0, 1.0, 256 * 256) | nd::to_shared() | nd::reshape(256, 256);
+    auto E = (A | nd::map(expensive)) | nd::to_shared();
+    *num_calls = 0;
+
+    SECTION("each element is computed once, though read twice")
+    {
+        auto B = A | nd::map(expensive) | nd::cache();
+        auto C = B + (B | nd::permute_axes(1, 0)) | nd::to_shared();
+        REQUIRE(*num_calls == 256 * 256);
+        REQUIRE(bool((C == E + (E | nd::permute_axes(1, 0))) | nd::all()));
+        REQUIRE(B.get_provider().num_tile_evaluations() == (256 * 256) / B.get_provider().tile_shape().volume());
+    }
+
+    SECTION("parallel evaluators share the cached tiles")
+    {
+        auto B = A | nd::map(expensive) | nd::cache();
+        auto C = B + (B | nd::permute_axes(1, 0)) | nd::to_shared_parallel();
+        REQUIRE(*num_calls == 256 * 256);
+        REQUIRE(bool((C == E + (E | nd::permute_axes(1, 0))) | nd::all()));
+    }
+
+    SECTION("a budget smaller than the array still gives the right answer")
+    {
+        auto S = A | nd::select_axis(0).from(0).to(32) | nd::select_axis(1).from(0).to(32);
+        auto B = S | nd::map(expensive) | nd::cache(sizeof(double) * 64);
+        auto F = S | nd::map([] (double x) { return x * x; }) | nd::to_shared();
+        REQUIRE(bool(((B + (B | nd::permute_axes(1, 0))) == F + (F | nd::permute_axes(1, 0))) | nd::all()));
+    }
+
+    SECTION("memory-backed arrays are not cached")
+    {
+        REQUIRE((std::is_same<decltype(E | nd::cache()), decltype(E)>::value));
+    }
+}
+
+TEST_CASE("stencils can be applied to memory-backed arrays", "[stencil]")
+{
+    auto u = nd::index_array(12, 10, 8) | nd::map([] (auto i) { return double((i[0] * 7 + i[1] * i[1] + 3 * i[2]) % 17); }) | nd::to_shared();
+    auto w = nd::make_unique_array<double>(3, 3, 3);
+    w(1, 1, 1) = -6.0;
+    w(0, 1, 1) = w(2, 1, 1) = w(1, 0, 1) = w(1, 2, 1) = w(1, 1, 0) = w(1, 1, 2) = 1.0;
+    auto weights = std::move(w).shared();
+
+    auto laplacian = [u] (auto wrap)
+    {
+        return [u, wrap] (nd::index_t<3> i)
+        {
+            auto at = [&] (long di, long dj, long dk) { return u(wrap(long(i[0]) + di, 0), wrap(long(i[1]) + dj, 1), wrap(long(i[2]) + dk, 2)); };
+            return at(-1, 0, 0) + at(1, 0, 0) + at(0, -1, 0) + at(0, 1, 0) + at(0, 0, -1) + at(0, 0, 1) - 6.0 * at(0, 0, 0);
+        };
+    };
+    auto periodic = [u] (long i, std::size_t axis) { long n = u.shape(axis); return std::size_t((i + n) % n); };
+    auto clamp = [u] (long i, std::size_t axis) { return std::size_t(std::min(std::max(i, 0l), long(u.shape(axis)) - 1)); };
+    auto ghost = [] (long i, std::size_t) { return std::size_t(i + 1); };
+    auto reflect = [u] (long i, std::size_t axis) { return std::size_t(i < 0 ? -1 - i : i >= long(u.shape(axis)) ? 2 * u.shape(axis) - 1 - i : i); };
+
+    SECTION("a 7-point laplacian agrees with a hand-written one in each boundary mode")
+    {
+        auto L0 = u | nd::stencil(weights, nd::boundary_t::periodic) | nd::to_shared();
+        auto L1 = u | nd::stencil(weights, nd::boundary_t::clamp) | nd::to_shared();
+        auto L2 = u | nd::stencil(weights, nd::boundary_t::ghost) | nd::to_shared();
+
+        REQUIRE(L0.shape() == u.shape());
+        REQUIRE(L1.shape() == u.shape());
+        REQUIRE(L2.shape() == nd::make_shape(10, 8, 6));
+        REQUIRE(bool((L0 == nd::make_array(laplacian(periodic), L0.shape())) | nd::all()));
+        REQUIRE(bool((L1 == nd::make_array(laplacian(clamp), L1.shape())) | nd::all()));
+        REQUIRE(bool((L2 == nd::make_array(laplacian(ghost), L2.shape())) | nd::all()));
+        REQUIRE(bool(((u | nd::stencil(weights, nd::boundary_t::reflect)) == nd::make_array(laplacian(reflect), u.shape())) | nd::all()));
+        REQUIRE((u | nd::stencil(weights, nd::boundary_t::periodic))(0, 0, 0) == laplacian(periodic)(nd::make_index(0, 0, 0)));
+    }
+
+    SECTION("a kernel function gives the same result as the weights")
+    {
+        auto kernel = [] (auto at)
+        {
+            return at(-1, 0, 0) + at(1, 0, 0) + at(0, -1, 0) + at(0, 1, 0) + at(0, 0, -1) + at(0, 0, 1) - 6.0 * at(0, 0, 0);
+        };
+        auto A = u | nd::stencil(kernel, 1, nd::boundary_t::periodic) | nd::to_shared();
+        auto B = u | nd::stencil(weights, nd::boundary_t::periodic) | nd::to_shared();
+        REQUIRE(bool((A == B) | nd::all()));
+    }
+
+    SECTION("parallel, streamed, and strided evaluation agree with the serial one")
+    {
+        auto A = u | nd::stencil(weights, nd::boundary_t::periodic);
+        auto B = A | nd::to_shared();
+        REQUIRE(bool((B == (A | nd::to_shared_parallel(4))) | nd::all()));
+        REQUIRE(bool((B == (A | nd::cache())) | nd::all()));
+
+        auto P = u | nd::permute_axes(2, 1, 0);
+        auto C = P | nd::stencil(weights, nd::boundary_t::clamp) | nd::to_shared();
+        auto D = P | nd::to_shared() | nd::stencil(weights, nd::boundary_t::clamp) | nd::to_shared();
+        REQUIRE(bool((C == D) | nd::all()));
+    }
+
+    SECTION("a one-dimensional stencil with a wider radius")
+    {
+        auto x = nd::arange(20) | nd::map([] (int i) { return double(i * i); }) | nd::to_shared();
+        auto d = nd::make_unique_array<double>(5);
+        d(0) = 1.0; d(4) = -1.0;
+        auto D = x | nd::stencil(std::move(d).shared()) | nd::to_shared();
+        REQUIRE(D.shape() == nd::make_shape(16));
+        REQUIRE(D(0) == x(0) - x(4));
+        REQUIRE(D(15) == x(15) - x(19));
+    }
+
+    SECTION("bad stencils throw")
+    {
+        REQUIRE_THROWS(nd::stencil(nd::make_unique_array<double>(2, 3, 3).shared()));
+        REQUIRE_THROWS(nd::make_unique_array<double>(1, 10, 8).shared() | nd::stencil(weights));
+    }
+}
+
+TEST_CASE("padded arrays have ghost zones which are filled in place", "[padded_provider]")
+{
+    auto u = nd::index_array(6, 5, 4) | nd::map([] (auto i) { return double(i[0] * 100 + i[1] * 10 + i[2]); }) | nd::to_shared();
+    auto P = u | nd::pad(2, 1, 1);
+
+    SECTION("padding gives the interior, and the ghost zones are zero")
+    {
+        REQUIRE(P.shape() == nd::make_shape(10, 7, 6));
+        REQUIRE(P.get_provider().interior() == nd::make_access_pattern(10, 7, 6).with_start(2, 1, 1).with_final(8, 6, 5));
+        REQUIRE(bool(((P | nd::interior()) == u) | nd::all()));
+        REQUIRE(bool(((P | nd::select(P.get_provider().interior())) == u) | nd::all()));
+        REQUIRE((P | nd::interior()).data() == P.data() + (2 * 7 + 1) * 6 + 1);
+        REQUIRE((P | nd::sum()) == (u | nd::sum()));
+    }
+
+    SECTION("the ghost regions cover the padded array, with the interior")
+    {
+        auto counts = nd::make_unique_array<int>(P.shape());
+
+        for (const auto& region : P.get_provider().ghost_regions())
+        {
+            for (auto index : region)
+            {
+                counts(index) += 1;
+            }
+        }
+        for (auto index : P.get_provider().interior())
+        {
+            counts(index) += 1;
+        }
+        REQUIRE(bool((std::move(counts).shared() == 1) | nd::all()));
+    }
+
+    SECTION("halo fills write the ghost zones, and only them")
+    {
+        auto data = P.data();
+        auto check = [&] (nd::boundary_t boundary)
+        {
+            P.get_provider().fill_halo(boundary);
+            auto g = P.get_provider().ghost_width();
+            auto expected = nd::make_array([u, g, boundary] (auto i)
+            {
+                auto j = nd::index_t<3>();
+
+                for (std::size_t n = 0; n < 3; ++n)
+                {
+                    j[n] = nd::detail::boundary_index(long(i[n]) - long(g[n]), u.shape(n), boundary);
+                }
+                return u(j);
+            }, P.shape());
+            return bool((P == expected) | nd::all());
+        };
+        REQUIRE(check(nd::boundary_t::periodic));
+        REQUIRE(check(nd::boundary_t::clamp));
+        REQUIRE(check(nd::boundary_t::reflect));
+        REQUIRE(P(0, 0, 0) == u(1, 0, 0));
+        REQUIRE(P(1, 3, 5) == u(0, 2, 3));
+        REQUIRE(P.data() == data);
+        REQUIRE_THROWS(P.get_provider().fill_halo(nd::boundary_t::ghost));
+
+        P.get_provider().fill_halo([] (auto) { return -1.0; });
+        REQUIRE((P | nd::sum()) == (u | nd::sum()) - double(P.size() - u.size()));
+    }
+
+    SECTION("a padded solver matches a periodic stencil, without reallocating")
+    {
+        auto w = nd::make_unique_array<double>(3, 3, 3);
+        w(1, 1, 1) = -6.0;
+        w(0, 1, 1) = w(2, 1, 1) = w(1, 0, 1) = w(1, 2, 1) = w(1, 1, 0) = w(1, 1, 2) = 1.0;
+        auto weights = std::move(w).shared();
+
+        auto step = [weights] (auto v) { return (v + (v | nd::stencil(weights, nd::boundary_t::periodic)) * 0.1) | nd::to_shared(); };
+        auto A = u | nd::pad(1, 1, 1);
+        auto B = u | nd::pad(1, 1, 1);
+        auto data = std::make_pair(A.data(), B.data());
+        auto pool = nd::thread_pool_t(2);
+        auto scheduler = nd::tile_scheduler_t(pool, 2);
+        auto v = u;
+
+        for (int n = 0; n < 4; ++n)
+        {
+            A.get_provider().fill_halo(nd::boundary_t::periodic);
+            auto update = (A | nd::interior()) + (A | nd::stencil(weights)) * 0.1;
+
+            if (n % 2 == 0)
+            {
+                B.get_provider().assign_interior(update);
+            }
+            else
+            {
+                B.get_provider().assign_interior(update, scheduler);
+            }
+            std::swap(A, B);
+            v = step(v);
+        }
+        REQUIRE(bool(((A | nd::interior()) == v) | nd::all()));
+        REQUIRE(((data == std::make_pair(A.data(), B.data())) || (data == std::make_pair(B.data(), A.data()))));
+        REQUIRE_THROWS(A.get_provider().assign_interior(nd::zeros<double>(6, 5, 3)));
+    }
+}
+
+TEST_CASE("stencils can be applied repeatedly, with temporal blocking", "[repeat_stencil]")
+{
+    auto u = nd::index_array(40, 36, 30) | nd::map([] (auto i) { return double((i[0] * 7 + i[1] * i[1] + 3 * i[2]) % 17); }) | nd::to_shared();
+    auto w = nd::make_unique_array<double>(3, 3, 3);
+    w(1, 1, 1) = 0.4;
+    w(0, 1, 1) = w(2, 1, 1) = w(1, 0, 1) = w(1, 2, 1) = w(1, 1, 0) = w(1, 1, 2) = 0.1;
+    auto weights = std::move(w).shared();
+
+    auto sweeps = [] (auto array, auto stencil, std::size_t num_steps)
+    {
+        for (std::size_t n = 0; n < num_steps; ++n)
+        {
+            array = array | stencil | nd::to_shared();
+        }
+        return array;
+    };
+
+    SECTION("periodic and ghost boundaries give the same result as successive sweeps")
+    {
+        for (auto boundary : {nd::boundary_t::periodic, nd::boundary_t::ghost})
+        {
+            auto S = nd::stencil(weights, boundary);
+            auto A = u | nd::repeat_stencil(S, 11);
+            auto B = sweeps(u, S, 11);
+            REQUIRE(A.shape() == B.shape());
+            REQUIRE(bool((A == B) | nd::all()));
+        }
+        REQUIRE((u | nd::repeat_stencil(nd::stencil(weights), 11)).shape() == nd::make_shape(18, 14, 8));
+    }
+
+    SECTION("arrays larger than a tile are advanced tile by tile")
+    {
+        auto v = nd::index_array(520, 600) | nd::map([] (auto i) { return double((i[0] * 13 + i[1] * 5) % 23); }) | nd::to_shared();
+        auto kernel = [] (auto at) { return 0.6 * at(0, 0) + 0.1 * (at(-1, 0) + at(1, 0) + at(0, -1) + at(0, 1)); };
+
+        for (auto boundary : {nd::boundary_t::periodic, nd::boundary_t::ghost})
+        {
+            auto S = nd::stencil(kernel, 1, boundary);
+            REQUIRE(bool(((v | nd::repeat_stencil(S, 5)) == sweeps(v, S, 5)) | nd::all()));
+        }
+    }
+
+    SECTION("clamp and reflect boundaries, and kernel functions, also agree")
+    {
+        auto kernel = [] (auto at) { return 0.5 * at(0, 0, 0) + 0.25 * (at(0, 0, -2) + at(0, 0, 2)); };
+
+        for (auto boundary : {nd::boundary_t::clamp, nd::boundary_t::reflect, nd::boundary_t::periodic})
+        {
+            auto S = nd::stencil(kernel, 2, boundary);
+            REQUIRE(bool(((u | nd::repeat_stencil(S, 5)) == sweeps(u, S, 5)) | nd::all()));
+        }
+    }
+
+    SECTION("the steps can run on a tile scheduler, and zero steps copies the array")
+    {
+        auto pool = nd::thread_pool_t(3);
+        auto scheduler = nd::tile_scheduler_t(pool, 3);
+        auto S = nd::stencil(weights, nd::boundary_t::periodic);
+        auto A = u | nd::repeat_stencil(S, 9, scheduler);
+        REQUIRE(bool((A == sweeps(u, S, 9)) | nd::all()));
+        REQUIRE(bool(((u | nd::repeat_stencil(S, 0)) == u) | nd::all()));
+        REQUIRE_THROWS(u | nd::repeat_stencil(nd::stencil(weights), 16));
+    }
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+TEST_CASE("domains can be decomposed among processes over shared memory", "[shm_domain]")
+{
+    auto name = "/ndarray-test-" + std::to_string(::getpid());
+    auto shape = nd::make_shape(25, 10);
+    auto global = nd::index_array(shape) | nd::map([] (auto i) { return 100.0 * i[0] + i[1]; }) | nd::to_shared();
+    auto domain = nd::shm_domain_t<double, 2>(name, shape, 3, nd::make_shape(2, 1));
+
+    auto count_halo_errors = [&] (const nd::shm_domain_t<double, 2>& d, std::size_t rank, nd::boundary_t boundary)
+    {
+        auto u = d.subdomain(rank);
+        auto g = d.ghost_width();
+        auto start = d.partition(rank).start;
+        auto errors = std::size_t(0);
+
+        nd::for_each_index(nd::make_access_pattern(u.shape()), [&] (const nd::index_t<2>& i)
+        {
+            auto gi = long(start[0] + i[0]) - long(g[0]);
+            auto gj = long(i[1]) - long(g[1]);
+
+            if (boundary == nd::boundary_t::ghost && (gi < 0 || gi >= 25 || gj < 0 || gj >= 10))
+            {
+                return;
+            }
+            errors += u(i) != global(nd::detail::boundary_index(gi, 25, boundary), nd::detail::boundary_index(gj, 10, boundary));
+        });
+        return errors;
+    };
+    auto run_ranks = [&] (auto fn)
+    {
+        auto errors = std::atomic<std::size_t>(0);
+        auto threads = std::vector<std::thread>();
+
+        for (std::size_t rank = 0; rank < domain.num_ranks(); ++rank)
+        {
+            threads.emplace_back([&, rank] { errors += fn(rank); });
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        return errors.load();
+    };
+
+    REQUIRE(domain.shape() == shape);
+    REQUIRE(domain.num_ranks() == 3);
+    REQUIRE(domain.partition(2).start[0] == 16);
+    REQUIRE(domain.subdomain(2).shape() == nd::make_shape(13, 12));
+
+    SECTION("ranks running in threads exchange halos, for every boundary mode")
+    {
+        for (auto boundary : {nd::boundary_t::periodic, nd::boundary_t::clamp, nd::boundary_t::reflect, nd::boundary_t::ghost})
+        {
+            REQUIRE(run_ranks([&] (std::size_t rank)
+            {
+                auto u = domain.claim(rank);
+                u.get_provider().assign_interior(global | nd::select(domain.partition(rank)));
+                domain.exchange_halo(rank, boundary);
+                return count_halo_errors(domain, rank, boundary);
+            }) == 0);
+            REQUIRE(bool((domain.gather() == global) | nd::all()));
+        }
+    }
+
+    SECTION("time steps over two decomposed domains agree with stencils over the whole domain")
+    {
+        auto A = nd::shm_domain_t<double, 2>(name + "-a", shape, 3, nd::make_shape(1, 1));
+        auto B = nd::shm_domain_t<double, 2>(name + "-b", shape, 3, nd::make_shape(1, 1));
+        auto kernel = [] (auto at) { return 0.5 * at(0, 0) + 0.125 * (at(-1, 0) + at(1, 0) + at(0, -1) + at(0, 1)); };
+
+        run_ranks([&] (std::size_t rank)
+        {
+            auto source = &A;
+            auto a = A.claim(rank);
+            auto b = B.claim(rank);
+            a.get_provider().assign_interior(global | nd::select(A.partition(rank)));
+
+            for (int n = 0; n < 4; ++n)
+            {
+                source->exchange_halo(rank, nd::boundary_t::periodic);
+                b.get_provider().assign_interior(a | nd::stencil(kernel, 1));
+                source = source == &A ? &B : &A;
+                std::swap(a, b);
+            }
+            return std::size_t(0);
+        });
+        REQUIRE(bool((A.gather() == (global | nd::repeat_stencil(nd::stencil(kernel, 1, nd::boundary_t::periodic), 4))) | nd::all()));
+    }
+
+    SECTION("child processes attach to the domain by name")
+    {
+        auto children = std::vector<pid_t>();
+
+        for (std::size_t rank = 0; rank < 3; ++rank)
+        {
+            auto pid = ::fork();
+
+            if (pid == 0)
+            {
+                auto status = 1;
+
+                try {
+                    auto attached = nd::shm_domain_t<double, 2>(name);
+                    auto u = attached.claim(rank);
+                    u.get_provider().assign_interior(global | nd::select(attached.partition(rank)));
+                    attached.exchange_halo(rank, nd::boundary_t::periodic);
+                    status = count_halo_errors(attached, rank, nd::boundary_t::periodic) == 0 ? 0 : 2;
+                }
+                catch (...)
+                {
+                }
+                ::_exit(status);
+            }
+            children.push_back(pid);
+        }
+
+        // A child which fails before the barrier leaves the others waiting
+        // on it forever, so they are killed after the first failure, or if
+        // they take too long.
+        auto failures = std::size_t(0);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+
+        while (! children.empty())
+        {
+            if (failures > 0 || std::chrono::steady_clock::now() > deadline)
+            {
+                for (auto pid : children)
+                {
+                    ::kill(pid, SIGKILL);
+                }
+            }
+            for (auto pid = children.begin(); pid != children.end();)
+            {
+                auto status = 0;
+
+                if (::waitpid(*pid, &status, WNOHANG) == *pid)
+                {
+                    failures += ! WIFEXITED(status) || WEXITSTATUS(status) != 0;
+                    pid = children.erase(pid);
+                }
+                else
+                {
+                    ++pid;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        REQUIRE(failures == 0);
+        REQUIRE(bool((domain.gather() == global) | nd::all()));
+    }
+
+    SECTION("attaching checks the value type, and names are removed with the domain")
+    {
+        REQUIRE(nd::shm_domain_t<double, 2>(name).subdomain(1).shape() == nd::make_shape(12, 12));
+        REQUIRE_THROWS_AS((nd::shm_domain_t<float, 2>(name)), std::logic_error);
+        REQUIRE_THROWS((nd::shm_domain_t<double, 3>(name)));
+        REQUIRE_THROWS_AS((nd::shm_domain_t<double, 2>(name, shape, 3, nd::make_shape(2, 1))), std::runtime_error);
+        REQUIRE_THROWS_AS((nd::shm_domain_t<double, 2>(name, shape, 13, nd::make_shape(2, 1))), std::logic_error);
+        REQUIRE_THROWS_AS((nd::shm_domain_t<double, 2>("no-slash", shape, 3, nd::make_shape(2, 1))), std::logic_error);
+
+        {
+            auto other = nd::shm_domain_t<double, 2>(name + "-c", shape, 2, nd::make_shape(1, 1));
+        }
+        REQUIRE_THROWS_AS((nd::shm_domain_t<double, 2>(name + "-c")), std::runtime_error);
+    }
+}
+#endif